@@ -0,0 +1,37 @@
+// ASDF command set of the throttle quadrant
+
+#include "asdf_commands.h"
+
+unsigned int asdf_lever_size(unsigned char mode) {
+  return mode == MODE_12BIT ? 2 : 1;
+}
+
+int asdf_command_data_size(unsigned char code, unsigned char mode) {
+  switch (code) {
+    case CMD_RESET:
+    case CMD_POLL:
+    case CMD_LVR_RELS:
+    case CMD_ASDF:
+      return 0;
+    case CMD_MODE:
+      return 1;
+    case CMD_STREAM:
+      return 2;  // period (ms), deadband
+    case CMD_POLL_SET:
+      return 2 * asdf_lever_size(mode);
+    case CMD_LVR_MOVE:
+      return 2 * asdf_lever_size(mode) + 2;  // end positions, duration (ms)
+  }
+
+  if ((code & CMD_LVR_SET_MASK) == CMD_LVR_SET) {
+    // the host sends a position for every lever in the bitmask, speed brake included
+    int levers = ((code & CMD_LVR_SET_SPDBR) ? 1 : 0) + ((code & CMD_LVR_SET_TR1) ? 1 : 0) + ((code & CMD_LVR_SET_TR2) ? 1 : 0);
+    return levers * asdf_lever_size(mode);
+  }
+
+  return -1;
+}
+
+bool asdf_command_valid(unsigned char code, unsigned int frame_data_size, unsigned char mode) {
+  return asdf_command_data_size(code, mode) == (int)frame_data_size;
+}
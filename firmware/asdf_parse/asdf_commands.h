@@ -0,0 +1,55 @@
+#pragma once
+
+// ASDF command set of the throttle quadrant
+// Codes and data sizes must match host-add-on/HostAddOn/HostAddOn/ASDFProtocol.h.
+// Plain C++ with no Arduino dependency, so it also builds natively (see asdf_parse_test_native.cpp).
+
+// command codes
+#define CMD_RESET           (0x80)
+#define CMD_POLL            (0x81)
+#define CMD_LVR_RELS        (0x83)
+#define CMD_STREAM          (0x84)  // push ASDF_STREAM_REPORTs: period (ms), deadband; period 0 stops
+#define CMD_POLL_SET        (0x85)  // set both throttles and poll in one transaction
+#define CMD_MODE            (0x86)  // select the lever data format; see MODE_*
+#define CMD_LVR_MOVE        (0x87)  // move both throttles along a linear segment and poll
+#define CMD_ASDF            (0xFF)
+
+// CMD_LVR_SET: 0x82 with the levers to set in bits 6:4 (speed brake, throttle 1, throttle 2)
+#define CMD_LVR_SET_MASK    (0x8F)
+#define CMD_LVR_SET         (0x82)
+#define CMD_LVR_SET_SPDBR   (1 << 6)
+#define CMD_LVR_SET_TR1     (1 << 5)
+#define CMD_LVR_SET_TR2     (1 << 4)
+
+// response codes
+#define ASDF_ERROR          (0xFF)
+#define ASDF_ACK            (0x00)
+#define ASDF_RESET          (0x01)
+#define ASDF_POLL_OK        (0x02)
+#define ASDF_LVR_RELS_RESP  (0x83)
+
+// unsolicited: the pilot overrode the motors, which let go of the levers. data[0] is the bitmask
+// of the levers overridden (bit i = lever i of a poll report); seq is that of the last command
+// answered, so a host that does not know the code drops it as stale. Sent again after each A/T
+// set-point command until CMD_LVR_RELS, in case it was lost.
+#define ASDF_LVR_RELS_PILOT (0x03)
+
+// unsolicited lever/button report while streaming (see CMD_STREAM); same payload as ASDF_POLL_OK.
+// Numbered by its own sequence, one up per report
+#define ASDF_STREAM_REPORT  (0x04)
+
+// max time between two stream reports even if nothing moved (ms)
+#define ASDF_STREAM_KEEPALIVE_MS  (500)
+
+// lever data formats (CMD_MODE data[0]); boots in MODE_7BIT
+#define MODE_7BIT           (0)   // one byte per lever [0,127]
+#define MODE_12BIT          (1)   // two bytes per lever, little-endian [0,4095]
+
+/* # of bytes a lever position takes in @mode */
+unsigned int asdf_lever_size(unsigned char mode);
+
+/* # of data bytes command @code carries in @mode; -1 if the code is unknown */
+int asdf_command_data_size(unsigned char code, unsigned char mode);
+
+/* true if @frame_data_size is what command @code carries in @mode */
+bool asdf_command_valid(unsigned char code, unsigned int frame_data_size, unsigned char mode);
@@ -0,0 +1,82 @@
+#pragma once
+
+// ASDF v2 framing
+// Every packet, in either direction, goes on the wire as
+//     SYNC | LEN | SEQ | CODE | DATA[LEN] | CRC
+// LEN is the # of data bytes, SEQ a sequence number the device echoes in its response, and
+// CRC the CRC-8 (poly 0x07, init 0) of LEN through the last data byte.
+// The parser drops bytes until a frame checks out, so a lost, extra or corrupted byte costs
+// the frame it hits and nothing after it.
+// Copy of the host's host-add-on/HostAddOn/HostAddOn/ASDFFrame.h; keep the two in sync.
+
+#define ASDF_FRAME_SYNC		(0xA5)
+
+// max # of data bytes in a frame
+#define ASDF_FRAME_MAX_DATA	(16)
+
+// sync, length, sequence, code and CRC bytes around the data
+#define ASDF_FRAME_OVERHEAD	(5)
+
+// wire size of a frame carrying @data_size data bytes
+#define ASDF_FRAME_SIZE(data_size)	((data_size) + ASDF_FRAME_OVERHEAD)
+#define ASDF_FRAME_MAX_SIZE	ASDF_FRAME_SIZE(ASDF_FRAME_MAX_DATA)
+
+struct ASDFFrame {
+	unsigned char seq;		// sequence number
+	unsigned char code;		// command/response code
+	unsigned char data[ASDF_FRAME_MAX_DATA];
+	unsigned int data_size;
+};
+
+// resynchronizing receive parser; bytes go in with asdf_frame_push(), frames come out of asdf_frame_next()
+struct ASDFFrameParser {
+	unsigned char buf[2 * ASDF_FRAME_MAX_SIZE];	// bytes received but not parsed yet
+	unsigned int size;
+	unsigned long bad_frames;		// candidate frames dropped by the length or CRC check
+	unsigned long skipped_bytes;	// bytes dropped while hunting for a sync byte
+};
+
+// byte-at-a-time receive decoder; constant time per byte and no buffer to shift, so the device
+// can run it straight from its receive path and dispatch a command on its last byte. Unlike
+// ASDFFrameParser it cannot rescan a bad frame: hunting resumes after the byte that failed it.
+enum asdf_decode_state_t {
+	ASDF_DECODE_SYNC = 0,	// hunting for a sync byte
+	ASDF_DECODE_LEN,
+	ASDF_DECODE_SEQ,
+	ASDF_DECODE_CODE,
+	ASDF_DECODE_DATA,
+	ASDF_DECODE_CRC
+};
+
+struct ASDFFrameDecoder {
+	unsigned char state;	// asdf_decode_state_t
+	unsigned char crc;		// CRC-8 of the bytes from LEN on so far
+	unsigned int received;	// data bytes received so far
+	ASDFFrame frame;		// frame being received
+	unsigned long bad_frames;		// frames dropped by the length or CRC check
+	unsigned long skipped_bytes;	// bytes dropped while hunting for a sync byte
+};
+
+/* CRC-8 (poly 0x07, init 0) of @size bytes at @buf */
+unsigned char asdf_crc8(const unsigned char* buf, unsigned int size);
+
+/* CRC-8 @crc extended by byte @b */
+unsigned char asdf_crc8_update(unsigned char crc, unsigned char b);
+
+/* write @frame to @buf (at least ASDF_FRAME_SIZE(frame.data_size) bytes); returns its wire size, 0 if too long */
+unsigned int asdf_frame_encode(const ASDFFrame& frame, unsigned char* buf);
+
+/* forget buffered bytes and counters */
+void asdf_frame_parser_reset(ASDFFrameParser& parser);
+
+/* append @size received bytes; if the buffer is full, the oldest bytes are dropped */
+void asdf_frame_push(ASDFFrameParser& parser, const unsigned char* bytes, unsigned int size);
+
+/* take the next valid frame out of the buffered bytes; false if none is complete yet */
+bool asdf_frame_next(ASDFFrameParser& parser, ASDFFrame& frame);
+
+/* start hunting for a frame and forget counters */
+void asdf_frame_decoder_reset(ASDFFrameDecoder& decoder);
+
+/* feed one received byte; true if it completed a valid frame, which is copied to @frame */
+bool asdf_frame_decode(ASDFFrameDecoder& decoder, unsigned char b, ASDFFrame& frame);
@@ -0,0 +1,122 @@
+// Non-blocking multi-axis stepper motion
+
+#include "asdf_motion.h"
+
+// phase of one step
+#define STEP_PHASE  ((unsigned long)ASDF_MOTION_TICK_HZ << 8)
+
+static long clamp(long v, long lo, long hi) {
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+void asdf_motion_reset(ASDFMotion& motion, unsigned char axes) {
+  if (axes > ASDF_MOTION_MAX_AXES)
+    axes = ASDF_MOTION_MAX_AXES;
+  motion.axes = axes;
+  for (unsigned char i = 0; i < ASDF_MOTION_MAX_AXES; i++) {
+    ASDFMotionAxis& a = motion.axis[i];
+    a.position = a.target = 0;
+    a.min_pos = a.max_pos = 0;
+    a.max_speed_q8 = 0;
+    a.dv_q8 = 0;
+    a.accel = 0;
+    a.speed_q8 = 0;
+    a.phase = 0;
+    a.dir = 1;
+  }
+}
+
+void asdf_motion_config(ASDFMotion& motion, unsigned char i, long min_pos, long max_pos,
+  unsigned int max_speed, unsigned int accel) {
+  ASDFMotionAxis& a = motion.axis[i];
+  if (max_pos < min_pos)
+    max_pos = min_pos;
+  if (max_pos - min_pos > ASDF_MOTION_MAX_TRAVEL)
+    max_pos = min_pos + ASDF_MOTION_MAX_TRAVEL;
+  if (max_speed > ASDF_MOTION_MAX_SPEED)
+    max_speed = ASDF_MOTION_MAX_SPEED;
+  if (accel > ASDF_MOTION_MAX_ACCEL)
+    accel = ASDF_MOTION_MAX_ACCEL;
+  if (accel == 0)
+    accel = 1;
+
+  a.min_pos = min_pos;
+  a.max_pos = max_pos;
+  a.max_speed_q8 = (unsigned long)max_speed << 8;
+  a.accel = accel;
+  a.dv_q8 = ((unsigned long)accel << 8) / ASDF_MOTION_TICK_HZ;
+  if (a.dv_q8 == 0)
+    a.dv_q8 = 1;
+  a.position = clamp(a.position, min_pos, max_pos);
+  a.target = clamp(a.target, min_pos, max_pos);
+}
+
+void asdf_motion_set_position(ASDFMotion& motion, unsigned char i, long position) {
+  ASDFMotionAxis& a = motion.axis[i];
+  a.position = a.target = clamp(position, a.min_pos, a.max_pos);
+  a.speed_q8 = 0;
+  a.phase = 0;
+}
+
+void asdf_motion_set_target(ASDFMotion& motion, unsigned char i, long target) {
+  ASDFMotionAxis& a = motion.axis[i];
+  a.target = clamp(target, a.min_pos, a.max_pos);
+}
+
+bool asdf_motion_idle(const ASDFMotion& motion, unsigned char i) {
+  const ASDFMotionAxis& a = motion.axis[i];
+  return a.speed_q8 == 0 && a.position == a.target;
+}
+
+unsigned char asdf_motion_tick(ASDFMotion& motion, unsigned char* forward) {
+  unsigned char steps = 0;
+  *forward = 0;
+
+  for (unsigned char i = 0; i < motion.axes; i++) {
+    ASDFMotionAxis& a = motion.axis[i];
+    long to_go = a.target - a.position;
+    if (a.speed_q8 == 0) {
+      if (to_go == 0)
+        continue;
+      a.dir = to_go > 0 ? 1 : -1;   // turn round only at rest
+    }
+
+    // steps left in the direction of motion; <= 0 once the target is reached or behind
+    long ahead = to_go * a.dir;
+    unsigned long v = a.speed_q8 >> 8;
+    // braking from v takes v^2 / (2 accel) steps; both sides stay below 2^31
+    unsigned long stop_steps_x2a = v * v;
+    bool brake = ahead <= 0 || stop_steps_x2a >= 2UL * a.accel * (unsigned long)ahead
+      || a.speed_q8 > a.max_speed_q8;
+
+    if (brake)
+      a.speed_q8 = a.speed_q8 > a.dv_q8 ? a.speed_q8 - a.dv_q8 : 0;
+    else if (a.speed_q8 < a.max_speed_q8)
+      a.speed_q8 = a.speed_q8 + a.dv_q8 < a.max_speed_q8 ? a.speed_q8 + a.dv_q8 : a.max_speed_q8;
+
+    if (a.speed_q8 == 0) {
+      a.phase = 0;
+      continue;
+    }
+
+    a.phase += a.speed_q8;
+    if (a.phase < STEP_PHASE)
+      continue;
+    a.phase -= STEP_PHASE;
+
+    long next = a.position + a.dir;
+    if ((ahead <= 0 && stop_steps_x2a < 2UL * a.accel) || next < a.min_pos || next > a.max_pos) {
+      // slow enough to stop within a step, or at the end of travel: stop here rather than overshoot
+      a.speed_q8 = 0;
+      a.phase = 0;
+      continue;
+    }
+
+    a.position = next;
+    steps |= 1 << i;
+    if (a.dir > 0)
+      *forward |= 1 << i;
+  }
+
+  return steps;
+}
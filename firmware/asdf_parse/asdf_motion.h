@@ -0,0 +1,54 @@
+#pragma once
+
+// Non-blocking multi-axis stepper motion
+// A timer interrupt calls asdf_motion_tick() ASDF_MOTION_TICK_HZ times a second; each call
+// moves every axis one tick along a trapezoidal speed profile toward its target and says which
+// axes step now. loop() only sets targets, so it stays free for the serial link and the levers,
+// and a target may change at any time: the axis brakes, turns round if it has to, and goes on.
+// Plain C++ with no Arduino dependency, so it also builds natively (see asdf_parse_test_native.cpp).
+
+#define ASDF_MOTION_TICK_HZ     (2000)
+#define ASDF_MOTION_MAX_AXES    (3)
+
+// bounds of the per-axis settings; they keep the tick's arithmetic within 32 bits
+#define ASDF_MOTION_MAX_SPEED   (ASDF_MOTION_TICK_HZ)   // steps/s; at most one step per tick
+#define ASDF_MOTION_MAX_ACCEL   (30000)                 // steps/s^2
+#define ASDF_MOTION_MAX_TRAVEL  (30000)                 // steps between min_pos and max_pos
+
+struct ASDFMotionAxis {
+  long position;                // steps, as counted by the ticks
+  long target;                  // within [min_pos,max_pos]
+  long min_pos, max_pos;
+  unsigned long max_speed_q8;   // steps/s << 8
+  unsigned long dv_q8;          // speed change per tick, steps/s << 8
+  unsigned int accel;           // steps/s^2
+  unsigned long speed_q8;       // current speed, steps/s << 8; never negative, see dir
+  unsigned long phase;          // progress toward the next step, in speed_q8 ticks
+  signed char dir;              // +1 or -1, direction of the current motion
+};
+
+struct ASDFMotion {
+  unsigned char axes;
+  ASDFMotionAxis axis[ASDF_MOTION_MAX_AXES];
+};
+
+/* @axes axes, all at rest at 0 with no travel */
+void asdf_motion_reset(ASDFMotion& motion, unsigned char axes);
+
+/* travel [@min_pos,@max_pos], top speed @max_speed steps/s and acceleration @accel steps/s^2
+ * of axis @i; values past their bounds are clamped */
+void asdf_motion_config(ASDFMotion& motion, unsigned char i, long min_pos, long max_pos,
+  unsigned int max_speed, unsigned int accel);
+
+/* stop axis @i dead at @position (clamped to its travel), e.g. from a position sensor */
+void asdf_motion_set_position(ASDFMotion& motion, unsigned char i, long position);
+
+/* move axis @i to @target, clamped to its travel */
+void asdf_motion_set_target(ASDFMotion& motion, unsigned char i, long target);
+
+/* true if axis @i is at rest on its target */
+bool asdf_motion_idle(const ASDFMotion& motion, unsigned char i);
+
+/* advance all axes by one tick; returns a bitmask of the axes to step now (bit i = axis i),
+ * and in @forward which of them step toward max_pos */
+unsigned char asdf_motion_tick(ASDFMotion& motion, unsigned char* forward);
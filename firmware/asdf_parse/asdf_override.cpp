@@ -0,0 +1,51 @@
+// Pilot override detection
+
+#include "asdf_override.h"
+
+void asdf_override_config(ASDFOverride& ovr, unsigned int trip, unsigned int clear, unsigned int trip_ms) {
+  if (clear > trip)
+    clear = trip;
+  ovr.trip = trip;
+  ovr.clear = clear;
+  ovr.trip_ms = trip_ms;
+  asdf_override_reset(ovr);
+}
+
+void asdf_override_reset(ASDFOverride& ovr) {
+  for (unsigned char i = 0; i < ASDF_OVERRIDE_MAX_LEVERS; i++) {
+    ovr.lever[i].pending = false;
+    ovr.lever[i].tripped = false;
+    ovr.lever[i].since_ms = 0;
+  }
+}
+
+bool asdf_override_update(ASDFOverride& ovr, unsigned char i, long expected, long measured, unsigned long now_ms) {
+  ASDFOverrideLever& l = ovr.lever[i];
+  if (l.tripped)
+    return false;
+
+  unsigned long error = measured > expected ? measured - expected : expected - measured;
+  if (!l.pending) {
+    if (error < ovr.trip)
+      return false;
+    l.pending = true;
+    l.since_ms = now_ms;
+  } else if (error < ovr.clear) {
+    l.pending = false;    // let go before the debounce ran out
+    return false;
+  }
+
+  if (now_ms - l.since_ms < ovr.trip_ms)
+    return false;
+  l.pending = false;
+  l.tripped = true;
+  return true;
+}
+
+unsigned char asdf_override_tripped(const ASDFOverride& ovr) {
+  unsigned char mask = 0;
+  for (unsigned char i = 0; i < ASDF_OVERRIDE_MAX_LEVERS; i++)
+    if (ovr.lever[i].tripped)
+      mask |= 1 << i;
+  return mask;
+}
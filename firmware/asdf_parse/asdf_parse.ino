@@ -1,5 +1,67 @@
 #include "E:\SP2021\Arduino\libraries\Arduino_SoftwareReset-3.0.0\src\SoftwareReset.h"
 #include <avr/wdt.h>
+#include "asdf_frame.h"
+#include "asdf_commands.h"
+#include "asdf_sampler.h"
+#include "asdf_motion.h"
+#include "asdf_override.h"
+
+unsigned char lever_mode = MODE_7BIT;
+
+// commands from the host, decoded a byte at a time as they arrive; see asdf_frame.h
+ASDFFrameDecoder decoder;
+
+// levers A0..A2 = speed brake, throttle 1, throttle 2, sampled by the ADC interrupt; see asdf_sampler.h
+#define LEVER_CHANNELS      (3)
+#define OVERSAMPLE_BITS     (2)   // 16 samples per value: 12 bits, a new set every ~5 ms
+ASDFSampler sampler;
+
+// throttle motors (17HS4401, full steps) on levers 1 and 2; the Timer1 interrupt steps them, so
+// loop() only sets targets. Pins and pot offsets as in motor_control_sample.ino; the speed brake
+// has no motor here.
+#define MOTORS              (2)
+#define MOTOR_TRAVEL        (50)    // steps from idle to full, 90 degrees
+#define MOTOR_MAX_SPEED     (100)   // steps/s
+#define MOTOR_MAX_ACCEL     (400)   // steps/s^2
+const unsigned char COIL_PINS[MOTORS][4] = {
+  {4, 5, 6, 7},     // L engine
+  {8, 9, 10, 11}    // R engine
+};
+// full-step sequence of a 4-wire motor, as the Stepper library drives it
+const unsigned char COIL_STEPS[4] = {0b1010, 0b0110, 0b0101, 0b1001};
+unsigned char coil_step[MOTORS] = {0, 0};
+// lever position [0,4095] at motor step 0; step MOTOR_TRAVEL is 4095
+const unsigned int LEVER_IDLE[MOTORS] = {2482, 2202};
+ASDFMotion motion;
+
+// streaming; see CMD_STREAM. Any other command ends it.
+unsigned char stream_period_ms = 0;   // report period (ms); 0 => streaming off
+unsigned char stream_deadband = 0;    // min lever change to report, in lever_mode units; 0 => every period
+unsigned long stream_check_ms = 0;    // last time the levers were checked for a report
+unsigned long stream_report_ms = 0;   // last time a report was sent
+unsigned int stream_last[LEVER_CHANNELS + 1] = {0};  // as last reported, see leverState()
+unsigned char stream_seq = 0;         // sequence number of the next report
+
+// A/T: set by the first set-point command, cleared by CMD_LVR_RELS; the motors hold the throttles
+// at throttle_target [0,4095] while it is on and let go of them otherwise
+bool at_engaged = false;
+unsigned int throttle_target[MOTORS] = {0, 0};
+
+// pilot override: a throttle this far (lever units) from where its motor has stepped it for
+// OVERRIDE_TRIP_MS, never falling back under OVERRIDE_CLEAR, is held by the pilot; see asdf_override.h
+#define OVERRIDE_TRIP       (400)
+#define OVERRIDE_CLEAR      (200)
+#define OVERRIDE_TRIP_MS    (40)
+ASDFOverride pilot;                 // levers as in a poll report: 1 and 2 are the throttles
+unsigned char override_levers = 0;  // tripped levers, latched until CMD_LVR_RELS
+unsigned char last_seq = 0;         // sequence number of the last command answered
+
+// CMD_LVR_MOVE segment throttle_target follows, while move_active
+bool move_active = false;
+unsigned int move_start[MOTORS] = {0, 0};
+unsigned int move_end[MOTORS] = {0, 0};
+unsigned long move_start_ms = 0;
+unsigned int move_duration_ms = 0;
 
 
 void debugLED () {
@@ -17,126 +79,397 @@ void softReset(){ // Software reset (Does not reset IO or clear registers)
   asm volatile (" jmp 0");
 }
 
+// send a response frame with @size data bytes; @seq echoes the command's
+void sendFrame(unsigned char seq, unsigned char code, const unsigned char* data, unsigned int size) {
+  ASDFFrame frame;
+  frame.seq = seq;
+  frame.code = code;
+  frame.data_size = size;
+  for (unsigned int i = 0; i < size; i++)
+    frame.data[i] = data[i];
+
+  unsigned char buf[ASDF_FRAME_MAX_SIZE];
+  Serial.write(buf, asdf_frame_encode(frame, buf));
+}
+
 int bootDone (){
-  Serial.write("DONE");
+  sendFrame(0, ASDF_RESET, NULL, 0);
   return 1;
 }
 
+// start a conversion of lever @i; the ADC interrupts when it is done
+void startConversion(unsigned char i) {
+#ifdef analogPinToChannel
+  unsigned char ch = analogPinToChannel(i);  // A0 is ADC7 on the Leonardo
+#else
+  unsigned char ch = i;
+#endif
+#ifdef MUX5
+  ADCSRB = (ADCSRB & ~(1 << MUX5)) | (((ch >> 3) & 0x01) << MUX5);
+#endif
+  ADMUX = (1 << REFS0) | (ch & 0x07);  // AVcc reference
+  ADCSRA |= (1 << ADSC);
+}
+
+// conversion done: hand it to the sampler and go straight on with the next channel. Single
+// conversions chained from here rather than the ADC's free-running mode, which would take
+// the channel switch one conversion late.
+ISR(ADC_vect) {
+  unsigned int raw = ADC;
+  startConversion(asdf_sampler_add(sampler, raw));
+}
+
+void startSampling() {
+  asdf_sampler_reset(sampler, LEVER_CHANNELS, OVERSAMPLE_BITS);
+  ADCSRA = (1 << ADEN) | (1 << ADIE) | (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);  // 125 kHz ADC clock
+  startConversion(0);
+
+  unsigned char seq = sampler.seq;
+  while (sampler.seq == seq) {}  // first full set
+}
+
+// latest lever samples [0,4095] into @pos: speed brake, throttle 1, throttle 2. Takes no ADC time.
+void leverPositions(unsigned int* pos) {
+  unsigned int stat[LEVER_CHANNELS];
+  asdf_sampler_read(sampler, stat);
+  unsigned long full_scale = asdf_sampler_max(sampler);
+  for (int i = 0; i < LEVER_CHANNELS; i++)
+    pos[i] = (stat[i] * 4095UL + full_scale / 2) / full_scale;
+}
+
+// button status (none wired yet), then the latest lever samples in lever_mode units, into @state
+void leverState(unsigned int* state) {
+  unsigned int lever[LEVER_CHANNELS];
+  leverPositions(lever);
+
+  state[0] = 0;
+  for (int i = 0; i < LEVER_CHANNELS; i++)
+    state[i + 1] = lever_mode == MODE_12BIT ? lever[i] : lever[i] >> 5;  // [0,4095] or [0,127]
+}
+
+// write leverState() into @report as ASDF_POLL_OK and ASDF_STREAM_REPORT carry it; returns its size
+unsigned int leverReport(unsigned char* report) {
+  unsigned int state[LEVER_CHANNELS + 1];
+  leverState(state);
+
+  unsigned int size = 0;
+  report[size++] = state[0];
+  for (int i = 1; i <= LEVER_CHANNELS; i++) {
+    if (lever_mode == MODE_12BIT) {
+      report[size++] = state[i] % 256;  // low
+      report[size++] = state[i] / 256;  // high
+    } else {
+      report[size++] = state[i];
+    }
+  }
+  return size;
+}
+
+// true if a button changed or a lever moved more than stream_deadband since the last report
+bool streamChanged() {
+  unsigned int state[LEVER_CHANNELS + 1];
+  leverState(state);
+
+  if (state[0] != stream_last[0])
+    return true;
+  for (int i = 1; i <= LEVER_CHANNELS; i++) {
+    unsigned int change = state[i] > stream_last[i] ? state[i] - stream_last[i] : stream_last[i] - state[i];
+    if (change > stream_deadband)
+      return true;
+  }
+  return false;
+}
+
+void sendStreamReport() {
+  unsigned char report[7];
+  sendFrame(stream_seq++, ASDF_STREAM_REPORT, report, leverReport(report));
+
+  leverState(stream_last);
+  stream_report_ms = millis();
+}
+
+// lever position sent in lever_mode at @data, as [0,4095]
+unsigned int getLever(const unsigned char* data) {
+  if (lever_mode == MODE_12BIT) {
+    unsigned int pos = data[0] | (data[1] << 8);
+    return pos > 4095 ? 4095 : pos;
+  }
+  return ((data[0] & 0x7F) * 4095UL + 63) / 127;
+}
+
+// energize motor @m's coils for sequence step @step; -1 releases them
+void writeCoils(unsigned char m, int step) {
+  for (int k = 0; k < 4; k++)
+    digitalWrite(COIL_PINS[m][k], step >= 0 && (COIL_STEPS[step] & (0b1000 >> k)) ? HIGH : LOW);
+}
+
+// motion tick: both motors step in the same interrupt, neither waits for the other
+ISR(TIMER1_COMPA_vect) {
+  unsigned char forward;
+  unsigned char steps = asdf_motion_tick(motion, &forward);
+  for (unsigned char m = 0; m < MOTORS; m++) {
+    if (!(steps & (1 << m)))
+      continue;
+    coil_step[m] = (coil_step[m] + ((forward & (1 << m)) ? 1 : 3)) % 4;
+    writeCoils(m, coil_step[m]);
+  }
+}
+
+// run the motion tick at ASDF_MOTION_TICK_HZ on Timer1, motors released
+void startMotion() {
+  asdf_motion_reset(motion, MOTORS);
+  for (unsigned char m = 0; m < MOTORS; m++) {
+    for (int k = 0; k < 4; k++)
+      pinMode(COIL_PINS[m][k], OUTPUT);
+    writeCoils(m, -1);
+    asdf_motion_config(motion, m, 0, MOTOR_TRAVEL, MOTOR_MAX_SPEED, MOTOR_MAX_ACCEL);
+  }
+
+  TCCR1A = 0;
+  TCCR1B = (1 << WGM12) | (1 << CS11);  // CTC, 16 MHz / 8
+  OCR1A = F_CPU / 8 / ASDF_MOTION_TICK_HZ - 1;
+  TIMSK1 = (1 << OCIE1A);
+}
+
+// motor step that puts throttle @m at lever position @pos
+long leverToStep(unsigned char m, unsigned int pos) {
+  if (pos <= LEVER_IDLE[m])
+    return 0;
+  unsigned long range = 4095 - LEVER_IDLE[m];
+  return ((pos - LEVER_IDLE[m]) * (unsigned long)MOTOR_TRAVEL + range / 2) / range;
+}
+
+// lever position of throttle @m at motor step @step
+unsigned int stepToLever(unsigned char m, long step) {
+  return LEVER_IDLE[m] + (step * (4095UL - LEVER_IDLE[m]) + MOTOR_TRAVEL / 2) / MOTOR_TRAVEL;
+}
+
+// where motor @m has stepped its throttle to
+long motorPosition(unsigned char m) {
+  noInterrupts();
+  long position = motion.axis[m].position;
+  interrupts();
+  return position;
+}
+
+// move throttle @m to lever position @pos; the move starts at once and loop() goes on
+void setThrottle(unsigned char m, unsigned int pos) {
+  throttle_target[m] = pos;
+  noInterrupts();  // the tick reads the target
+  asdf_motion_set_target(motion, m, leverToStep(m, pos));
+  interrupts();
+}
+
+// A/T drives the throttles from where they are, unless the pilot overrode it; true if it does
+bool takeLevers() {
+  if (override_levers != 0)
+    return false;
+  if (!at_engaged) {
+    asdf_override_reset(pilot);
+    unsigned int pos[LEVER_CHANNELS];
+    leverPositions(pos);
+    noInterrupts();
+    for (unsigned char m = 0; m < MOTORS; m++) {
+      throttle_target[m] = pos[m + 1];
+      asdf_motion_set_position(motion, m, leverToStep(m, pos[m + 1]));
+      writeCoils(m, coil_step[m]);  // the motor holds the lever from now on
+    }
+    interrupts();
+    at_engaged = true;
+  }
+  return true;
+}
+
+// stop both motors where they are and let go of the throttles
+void releaseLevers() {
+  noInterrupts();
+  for (unsigned char m = 0; m < MOTORS; m++) {
+    asdf_motion_set_position(motion, m, motion.axis[m].position);
+    writeCoils(m, -1);
+  }
+  interrupts();
+  at_engaged = false;
+  move_active = false;
+}
+
+// tell the host the pilot overrode the motors; see ASDF_LVR_RELS_PILOT
+void sendPilotOverride() {
+  sendFrame(last_seq, ASDF_LVR_RELS_PILOT, &override_levers, 1);
+}
+
+// compare each throttle with where its motor has stepped it, moving or not; let go of both
+// once one trips, so the pilot does not fight the motors
+void detectOverride() {
+  unsigned int pos[LEVER_CHANNELS];
+  leverPositions(pos);
+  unsigned long now = millis();
+  for (unsigned char m = 0; m < MOTORS; m++)
+    asdf_override_update(pilot, m + 1, stepToLever(m, motorPosition(m)), pos[m + 1], now);
+
+  override_levers = asdf_override_tripped(pilot);
+  if (override_levers == 0)
+    return;
+  releaseLevers();
+  sendPilotOverride();
+}
+
 void setup() {
   Serial.begin(115200);
-  Serial.setTimeout(1);
   while (!Serial) {} // Wait for serial ready
+  asdf_frame_decoder_reset(decoder);
+  startSampling();
+  startMotion();
+  asdf_override_config(pilot, OVERRIDE_TRIP, OVERRIDE_CLEAR, OVERRIDE_TRIP_MS);
 }
 
-char str1[] = "128\r";
 int resetFlag = 0;
 
 void loop () {
-  
-  // Read position of all levers / buttons
-  int stat[7] = {0,0,0,0,0,0,0};
-  stat[0] = 2;
-  stat[1] = analogRead(A0);
-  stat[2] = analogRead(A1);
-  stat[3] = analogRead(A2);
-  stat[4] = analogRead(A3);
-  stat[5] = analogRead(A4);
-  stat[6] = 0; // sacrificial position, not used for interpretation
-
-  
   if (resetFlag == 0){ // report reset done
     resetFlag = bootDone();
   }
-  
-  int input;
-  while(!Serial.available()){}
-  input = Serial.readString().toInt();
 
-  // input parser
-  switch (input) {
+  // A/T targets along the current segment; the motion tick takes each one up at once
+  if (move_active) {
+    unsigned long t = millis() - move_start_ms;
+    if (t >= move_duration_ms)
+      move_active = false;
+    for (unsigned char m = 0; m < MOTORS; m++)
+      setThrottle(m, !move_active ? move_end[m] :
+        move_start[m] + ((long)move_end[m] - (long)move_start[m]) * (long)t / move_duration_ms);
+  }
+  if (at_engaged)
+    detectOverride();
+
+  // push a report if streaming and due
+  if (stream_period_ms != 0 && millis() - stream_check_ms >= stream_period_ms) {
+    stream_check_ms = millis();
+    if (stream_deadband == 0 || streamChanged() || millis() - stream_report_ms >= ASDF_STREAM_KEEPALIVE_MS)
+      sendStreamReport();
+  }
+
+  // never wait for input: each command runs as soon as its last byte is in, and bytes that
+  // do not make a frame are dropped on the way
+  while (Serial.available() > 0) {
+    ASDFFrame cmd;
+    if (asdf_frame_decode(decoder, Serial.read(), cmd))
+      runCommand(cmd);
+  }
+}
+
+// execute @cmd; responses echo its sequence number
+void runCommand(const ASDFFrame& cmd) {
+  if (!asdf_command_valid(cmd.code, cmd.data_size, lever_mode)) {
+    sendFrame(cmd.seq, ASDF_ERROR, NULL, 0);  // unrecognized command or wrong length
+    return;
+  }
+  last_seq = cmd.seq;
+  if (cmd.code != CMD_STREAM)
+    stream_period_ms = 0;  // the host polls again
+
+  switch (cmd.code) {
     
-    case 128 : // CMD_RESET - reset hardware
+    case CMD_RESET : // reset hardware
     {
       hardReset();
       break;
     }
     
-    case 129 : // CMD_POLL - reset
+    case CMD_POLL :
     {
-      for(int i = 0; i < 7; i++){ // Breakdown ints to be sent as bytes.
-        byte low = stat[i] % 256;
-        byte high = stat[i] / 256;
-        Serial.write(low);
-        Serial.write(high);
-      }
+      unsigned char resp[7];
+      sendFrame(cmd.seq, ASDF_POLL_OK, resp, leverReport(resp));
       break;
     }
 
-    case 131 : // CMD_LVR_RELS
+    case CMD_MODE :
     {
-       // TODO: thrust lever release function
-       Serial.write(131); // report release done
-       break;
+      if (cmd.data[0] != MODE_7BIT && cmd.data[0] != MODE_12BIT) {
+        sendFrame(cmd.seq, ASDF_ERROR, NULL, 0);
+        break;
+      }
+      lever_mode = cmd.data[0];  // responses after the ACK are in the new format
+      sendFrame(cmd.seq, ASDF_ACK, NULL, 0);
+      break;
     }
 
-    // CMD_LVR_SET cases
-
-    case 130 :
+    case CMD_LVR_RELS :
     {
-      int pos[3] = {0,0,0}; 
-      break;  
+       releaseLevers();
+       override_levers = 0;  // the host knows
+       sendFrame(cmd.seq, ASDF_LVR_RELS_RESP, NULL, 0); // report release done
+       break;
     }
 
-    case 146 :
-    {
-      int pos[3] = {0,0,0}; 
-      break;  
-    }
-    
-    case 162 :
-    {
-      int pos[3] = {0,0,0}; 
-      break;  
-    }
-    
-    case 178 :
+    case CMD_ASDF : // debug only
     {
-      int pos[3] = {0,0,0}; 
-      break;  
+      sendFrame(cmd.seq, ASDF_ACK, NULL, 0);
+      break;
     }
 
-    case 194 :
+    case CMD_POLL_SET : // CMD_LVR_SET of both throttles and CMD_POLL in one transaction
     {
-      int pos[3] = {0,0,0}; 
-      break;  
+      if (takeLevers()) {
+        move_active = false;
+        setThrottle(0, getLever(cmd.data));
+        setThrottle(1, getLever(cmd.data + asdf_lever_size(lever_mode)));
+      }
+      unsigned char resp[7];
+      sendFrame(cmd.seq, ASDF_POLL_OK, resp, leverReport(resp));  // measured, not the targets
+      if (override_levers != 0)
+        sendPilotOverride();
+      break;
     }
 
-    case 210 :
+    case CMD_LVR_MOVE : // both throttles along a segment, and CMD_POLL
     {
-      int pos[3] = {0,0,0}; 
-      break;  
+      if (takeLevers()) {
+        // from the running A/T targets, which start where the levers are
+        unsigned int size = asdf_lever_size(lever_mode);
+        for (unsigned char m = 0; m < MOTORS; m++) {
+          move_start[m] = throttle_target[m];
+          move_end[m] = getLever(cmd.data + m * size);
+        }
+        move_duration_ms = cmd.data[2 * size] | (cmd.data[2 * size + 1] << 8);
+        move_start_ms = millis();
+        move_active = true;
+      }
+      unsigned char resp[7];
+      sendFrame(cmd.seq, ASDF_POLL_OK, resp, leverReport(resp));
+      if (override_levers != 0)
+        sendPilotOverride();
+      break;
     }
 
-    case 226 :
+    case CMD_STREAM : // period 0 stops it
     {
-      int pos[3] = {0,0,0}; 
-      break;  
+      stream_period_ms = cmd.data[0] & 0x7F;
+      stream_deadband = cmd.data[1] & 0x7F;
+      sendFrame(cmd.seq, ASDF_ACK, NULL, 0);  // ACK precedes the first report
+
+      stream_check_ms = millis();
+      if (stream_period_ms != 0)
+        sendStreamReport();
+      break;
     }
 
-    case 242 :
+    default : // CMD_LVR_SET cases; asdf_command_valid() let nothing else through
     {
-      int pos[3] = {0,0,0}; 
-      break;  
+      if (takeLevers()) {
+        move_active = false;
+        // a position per lever in the bitmask; the speed brake's is skipped
+        unsigned int n = (cmd.code & CMD_LVR_SET_SPDBR) ? asdf_lever_size(lever_mode) : 0;
+        if (cmd.code & CMD_LVR_SET_TR1) {
+          setThrottle(0, getLever(cmd.data + n));
+          n += asdf_lever_size(lever_mode);
+        }
+        if (cmd.code & CMD_LVR_SET_TR2)
+          setThrottle(1, getLever(cmd.data + n));
+      }
+      sendFrame(cmd.seq, ASDF_ACK, NULL, 0);
+      if (override_levers != 0)
+        sendPilotOverride();
+      break;
     }
-
-    // end of CMD_LVR_SET cases
-    
-//    Unused  
-//    case 255 :
-//    {
-//         
-//    } 
   }
-  
-
 }
@@ -0,0 +1,59 @@
+// Oversampling lever sampler
+
+#include "asdf_sampler.h"
+
+void asdf_sampler_reset(ASDFSampler& sampler, unsigned char channels, unsigned char oversample_bits) {
+  if (channels > ASDF_SAMPLER_MAX_CHANNELS)
+    channels = ASDF_SAMPLER_MAX_CHANNELS;
+  if (oversample_bits > ASDF_SAMPLER_MAX_OVERSAMPLE_BITS)
+    oversample_bits = ASDF_SAMPLER_MAX_OVERSAMPLE_BITS;
+
+  sampler.channels = channels;
+  sampler.oversample_bits = oversample_bits;
+  sampler.channel = 0;
+  sampler.rounds = 0;
+  for (unsigned char i = 0; i < ASDF_SAMPLER_MAX_CHANNELS; i++) {
+    sampler.sums[i] = 0;
+    sampler.sets[0][i] = sampler.sets[1][i] = 0;
+  }
+  sampler.front = 0;
+  sampler.seq = 0;
+}
+
+unsigned char asdf_sampler_add(ASDFSampler& sampler, unsigned int raw) {
+  sampler.sums[sampler.channel] += raw;
+  if (++sampler.channel < sampler.channels)
+    return sampler.channel;
+
+  // round complete; channels are interleaved so they all cover the same time span
+  sampler.channel = 0;
+  if (++sampler.rounds < (1 << (2 * sampler.oversample_bits)))
+    return 0;
+
+  // decimate: the sum of 4^n samples holds n extra bits over its noise; keep those
+  unsigned char back = sampler.front ^ 1;
+  for (unsigned char i = 0; i < sampler.channels; i++) {
+    sampler.sets[back][i] = sampler.sums[i] >> sampler.oversample_bits;
+    sampler.sums[i] = 0;
+  }
+  sampler.rounds = 0;
+  sampler.front = back;
+  sampler.seq++;
+  return 0;
+}
+
+unsigned char asdf_sampler_read(const ASDFSampler& sampler, unsigned int* values) {
+  // a publish during the copy may rewrite the set being copied; retry until none did
+  unsigned char seq;
+  do {
+    seq = sampler.seq;
+    unsigned char front = sampler.front;
+    for (unsigned char i = 0; i < sampler.channels; i++)
+      values[i] = sampler.sets[front][i];
+  } while (seq != sampler.seq);
+  return seq;
+}
+
+unsigned int asdf_sampler_max(const ASDFSampler& sampler) {
+  return ((1u << ASDF_SAMPLER_ADC_BITS) - 1) << sampler.oversample_bits;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+// Oversampling lever sampler
+// The ADC interrupt feeds it one conversion at a time, round-robin over the lever channels.
+// Every 4^oversample_bits rounds it decimates the per-channel sums to 10 + oversample_bits bits
+// and publishes them into the idle half of a double buffer, so loop() can always copy the
+// latest complete set without stopping the ADC.
+// Plain C++ with no Arduino dependency, so it also builds natively (see asdf_parse_test_native.cpp).
+
+// max # of channels sampled
+#define ASDF_SAMPLER_MAX_CHANNELS       (4)
+
+// max extra bits of resolution; 4^3 = 64 samples of 1023 still fit a 16-bit sum
+#define ASDF_SAMPLER_MAX_OVERSAMPLE_BITS (3)
+
+// resolution of the ADC (bits)
+#define ASDF_SAMPLER_ADC_BITS           (10)
+
+struct ASDFSampler {
+  unsigned char channels;         // # of channels sampled, round-robin
+  unsigned char oversample_bits;  // extra bits of resolution
+  unsigned char channel;          // channel the next conversion is for
+  unsigned char rounds;           // rounds summed so far
+  unsigned int sums[ASDF_SAMPLER_MAX_CHANNELS];
+
+  // published values, [0,asdf_sampler_max()]; the ISR fills sets[!front], then flips front
+  volatile unsigned int sets[2][ASDF_SAMPLER_MAX_CHANNELS];
+  volatile unsigned char front;
+  volatile unsigned char seq;     // bumped on every publish
+};
+
+/* start over with @channels channels and 4^@oversample_bits samples per published value;
+ * both are clamped to their max */
+void asdf_sampler_reset(ASDFSampler& sampler, unsigned char channels, unsigned char oversample_bits);
+
+/* add conversion @raw of the current channel; returns the channel the next conversion is for */
+unsigned char asdf_sampler_add(ASDFSampler& sampler, unsigned int raw);
+
+/* copy the latest published values into @values (sampler.channels of them); safe against
+ * asdf_sampler_add() interrupting it; returns the seq of the set copied */
+unsigned char asdf_sampler_read(const ASDFSampler& sampler, unsigned int* values);
+
+/* full scale of the published values */
+unsigned int asdf_sampler_max(const ASDFSampler& sampler);
@@ -0,0 +1,629 @@
+// asdf_parse_test_native.cpp : Checks the firmware's frame decoder, command table, lever sampler, stepper motion and override
+// detection on the PC.
+//
+// Builds the same asdf_*.cpp the sketches use, without the board:
+//     g++ -std=c++17 -O2 -Iasdf_parse asdf_parse_test_native.cpp asdf_parse/asdf_frame.cpp asdf_parse/asdf_commands.cpp asdf_parse/asdf_sampler.cpp asdf_parse/asdf_motion.cpp asdf_parse/asdf_override.cpp -o asdf_parse_test_native
+//     ./asdf_parse_test_native
+// Prints each failed check and exits non-zero if there was any.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "asdf_frame.h"
+#include "asdf_commands.h"
+#include "asdf_sampler.h"
+#include "asdf_motion.h"
+#include "asdf_override.h"
+
+static int checks = 0;
+static int failures = 0;
+
+// # of frames in test_back_to_back()
+#define TEST_FRAMES (20)
+
+#define CHECK(cond) do { \
+    checks++; \
+    if (!(cond)) { \
+      failures++; \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    } \
+  } while (0)
+
+// encode a frame into @buf; returns its wire size
+static unsigned int encode(unsigned char seq, unsigned char code, const unsigned char* data,
+  unsigned int size, unsigned char* buf) {
+  ASDFFrame frame;
+  frame.seq = seq;
+  frame.code = code;
+  frame.data_size = size;
+  if (size != 0)
+    memcpy(frame.data, data, size);
+  return asdf_frame_encode(frame, buf);
+}
+
+// feed @size bytes one at a time; returns the # of frames completed, the last one in @frame,
+// and in @last_at the index of the byte that completed it
+static int feed(ASDFFrameDecoder& decoder, const unsigned char* bytes, unsigned int size,
+  ASDFFrame& frame, unsigned int* last_at = NULL) {
+  int frames = 0;
+  for (unsigned int i = 0; i < size; i++) {
+    if (asdf_frame_decode(decoder, bytes[i], frame)) {
+      frames++;
+      if (last_at != NULL)
+        *last_at = i;
+    }
+  }
+  return frames;
+}
+
+static void test_crc() {
+  // CRC-8/SMBUS check value
+  const unsigned char check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+  CHECK(asdf_crc8(check, sizeof(check)) == 0xF4);
+  CHECK(asdf_crc8(check, 0) == 0);
+
+  unsigned char crc = 0;
+  for (unsigned int i = 0; i < sizeof(check); i++)
+    crc = asdf_crc8_update(crc, check[i]);
+  CHECK(crc == 0xF4);
+}
+
+static void test_decode_each_byte() {
+  const unsigned char data[] = { MODE_12BIT };
+  unsigned char buf[ASDF_FRAME_MAX_SIZE];
+  unsigned int size = encode(7, CMD_MODE, data, sizeof(data), buf);
+  CHECK(size == ASDF_FRAME_SIZE(1));
+
+  ASDFFrameDecoder decoder;
+  asdf_frame_decoder_reset(decoder);
+  ASDFFrame frame;
+  unsigned int last_at = 0;
+  CHECK(feed(decoder, buf, size, frame, &last_at) == 1);
+  CHECK(last_at == size - 1);  // dispatched on the last byte, not later
+  CHECK(frame.seq == 7);
+  CHECK(frame.code == CMD_MODE);
+  CHECK(frame.data_size == 1);
+  CHECK(frame.data[0] == MODE_12BIT);
+  CHECK(decoder.bad_frames == 0);
+  CHECK(decoder.skipped_bytes == 0);
+}
+
+static void test_no_data() {
+  unsigned char buf[ASDF_FRAME_MAX_SIZE];
+  unsigned int size = encode(0, CMD_POLL, NULL, 0, buf);
+
+  ASDFFrameDecoder decoder;
+  asdf_frame_decoder_reset(decoder);
+  ASDFFrame frame;
+  CHECK(feed(decoder, buf, size, frame) == 1);
+  CHECK(frame.code == CMD_POLL);
+  CHECK(frame.data_size == 0);
+}
+
+static void test_max_data() {
+  unsigned char data[ASDF_FRAME_MAX_DATA];
+  for (unsigned int i = 0; i < sizeof(data); i++)
+    data[i] = (unsigned char)(0xA0 + i);  // includes the sync byte
+  unsigned char buf[ASDF_FRAME_MAX_SIZE];
+  unsigned int size = encode(200, CMD_ASDF, data, sizeof(data), buf);
+  CHECK(size == ASDF_FRAME_MAX_SIZE);
+
+  ASDFFrameDecoder decoder;
+  asdf_frame_decoder_reset(decoder);
+  ASDFFrame frame;
+  CHECK(feed(decoder, buf, size, frame) == 1);
+  CHECK(frame.data_size == ASDF_FRAME_MAX_DATA);
+  CHECK(memcmp(frame.data, data, sizeof(data)) == 0);
+}
+
+static void test_leading_garbage() {
+  unsigned char buf[3 + ASDF_FRAME_MAX_SIZE] = { 0x81, 0x00, 0x7F };  // e.g. a v1 host's bare code
+  unsigned int size = 3 + encode(1, CMD_POLL, NULL, 0, buf + 3);
+
+  ASDFFrameDecoder decoder;
+  asdf_frame_decoder_reset(decoder);
+  ASDFFrame frame;
+  CHECK(feed(decoder, buf, size, frame) == 1);
+  CHECK(frame.seq == 1);
+  CHECK(decoder.skipped_bytes == 3);
+}
+
+static void test_bad_length() {
+  // a sync byte followed by an impossible length, then sync again and a real frame
+  unsigned char buf[2 + ASDF_FRAME_MAX_SIZE] = { ASDF_FRAME_SYNC, ASDF_FRAME_MAX_DATA + 1 };
+  unsigned int size = 2 + encode(2, CMD_POLL, NULL, 0, buf + 2);
+
+  ASDFFrameDecoder decoder;
+  asdf_frame_decoder_reset(decoder);
+  ASDFFrame frame;
+  CHECK(feed(decoder, buf, size, frame) == 1);
+  CHECK(frame.seq == 2);
+  CHECK(decoder.bad_frames == 1);
+
+  // sync as the length byte: it may start the real frame
+  unsigned char buf2[1 + ASDF_FRAME_MAX_SIZE] = { ASDF_FRAME_SYNC };
+  unsigned int size2 = 1 + encode(3, CMD_POLL, NULL, 0, buf2 + 1);
+  asdf_frame_decoder_reset(decoder);
+  CHECK(feed(decoder, buf2, size2, frame) == 1);
+  CHECK(frame.seq == 3);
+  CHECK(decoder.bad_frames == 1);
+}
+
+static void test_corrupted_then_valid() {
+  const unsigned char data[] = { 0x10, 0x20 };
+  unsigned char buf[2 * ASDF_FRAME_MAX_SIZE];
+  unsigned int size = encode(4, CMD_STREAM, data, sizeof(data), buf);
+  buf[4] ^= 0x01;  // flip a data bit
+  size += encode(5, CMD_STREAM, data, sizeof(data), buf + size);
+
+  ASDFFrameDecoder decoder;
+  asdf_frame_decoder_reset(decoder);
+  ASDFFrame frame;
+  CHECK(feed(decoder, buf, size, frame) == 1);
+  CHECK(frame.seq == 5);
+  CHECK(frame.data[0] == 0x10 && frame.data[1] == 0x20);
+  CHECK(decoder.bad_frames == 1);
+}
+
+static void test_lost_byte() {
+  // the first frame loses its code byte, so its CRC lands on the second frame's first bytes;
+  // the second frame is lost with it, the third comes through
+  unsigned char buf[3 * ASDF_FRAME_MAX_SIZE];
+  unsigned int size = encode(6, CMD_POLL, NULL, 0, buf);
+  memmove(buf + 3, buf + 4, size - 4);
+  size--;
+  size += encode(7, CMD_POLL, NULL, 0, buf + size);
+  size += encode(8, CMD_POLL, NULL, 0, buf + size);
+
+  ASDFFrameDecoder decoder;
+  asdf_frame_decoder_reset(decoder);
+  ASDFFrame frame;
+  CHECK(feed(decoder, buf, size, frame) >= 1);
+  CHECK(frame.seq == 8);
+  CHECK(decoder.bad_frames >= 1);
+}
+
+static void test_back_to_back() {
+  unsigned char buf[TEST_FRAMES * ASDF_FRAME_MAX_SIZE];
+  unsigned int size = 0;
+  for (unsigned int i = 0; i < TEST_FRAMES; i++) {
+    unsigned char data[2] = { (unsigned char)i, (unsigned char)(i * 3) };
+    size += encode((unsigned char)i, CMD_POLL_SET, data, i % 3, buf + size);
+  }
+
+  ASDFFrameDecoder decoder;
+  asdf_frame_decoder_reset(decoder);
+  unsigned int frames = 0;
+  for (unsigned int i = 0; i < size; i++) {
+    ASDFFrame frame;
+    if (!asdf_frame_decode(decoder, buf[i], frame))
+      continue;
+    CHECK(frame.seq == frames);
+    CHECK(frame.data_size == frames % 3);
+    if (frame.data_size > 0)
+      CHECK(frame.data[0] == frames);
+    frames++;
+  }
+  CHECK(frames == TEST_FRAMES);
+  CHECK(decoder.bad_frames == 0);
+  CHECK(decoder.skipped_bytes == 0);
+}
+
+static void test_command_sizes() {
+  CHECK(asdf_command_data_size(CMD_RESET, MODE_7BIT) == 0);
+  CHECK(asdf_command_data_size(CMD_POLL, MODE_12BIT) == 0);
+  CHECK(asdf_command_data_size(CMD_LVR_RELS, MODE_7BIT) == 0);
+  CHECK(asdf_command_data_size(CMD_ASDF, MODE_7BIT) == 0);
+  CHECK(asdf_command_data_size(CMD_MODE, MODE_12BIT) == 1);
+  CHECK(asdf_command_data_size(CMD_STREAM, MODE_12BIT) == 2);
+  CHECK(asdf_command_data_size(CMD_POLL_SET, MODE_7BIT) == 2);
+  CHECK(asdf_command_data_size(CMD_POLL_SET, MODE_12BIT) == 4);
+  CHECK(asdf_command_data_size(CMD_LVR_MOVE, MODE_7BIT) == 4);
+  CHECK(asdf_command_data_size(CMD_LVR_MOVE, MODE_12BIT) == 6);
+
+  // CMD_LVR_SET: one position per lever in the bitmask, as craft_lvr_set() sends them
+  CHECK(asdf_command_data_size(0x82, MODE_7BIT) == 0);
+  CHECK(asdf_command_data_size(0x92, MODE_7BIT) == 1);
+  CHECK(asdf_command_data_size(0xA2, MODE_12BIT) == 2);
+  CHECK(asdf_command_data_size(0xB2, MODE_7BIT) == 2);
+  CHECK(asdf_command_data_size(0xB2, MODE_12BIT) == 4);
+  CHECK(asdf_command_data_size(0xC2, MODE_7BIT) == 1);
+  CHECK(asdf_command_data_size(0xC2, MODE_12BIT) == 2);
+  CHECK(asdf_command_data_size(0xD2, MODE_7BIT) == 2);
+  CHECK(asdf_command_data_size(0xF2, MODE_7BIT) == 3);
+  CHECK(asdf_command_data_size(0xF2, MODE_12BIT) == 6);
+
+  // not commands
+  CHECK(asdf_command_data_size(0x00, MODE_7BIT) == -1);
+  CHECK(asdf_command_data_size(0x7F, MODE_7BIT) == -1);
+  CHECK(asdf_command_data_size(0x88, MODE_7BIT) == -1);
+  CHECK(asdf_command_data_size(0x8A, MODE_7BIT) == -1);
+
+  CHECK(asdf_command_valid(CMD_MODE, 1, MODE_7BIT));
+  CHECK(!asdf_command_valid(CMD_MODE, 0, MODE_7BIT));
+  CHECK(!asdf_command_valid(CMD_POLL_SET, 2, MODE_12BIT));
+  CHECK(!asdf_command_valid(0x88, 0, MODE_7BIT));
+}
+
+// run one round of conversions, channel i reading @raw[i]
+static void sample_round(ASDFSampler& sampler, const unsigned int* raw) {
+  for (unsigned char i = 0; i < sampler.channels; i++) {
+    unsigned char next = asdf_sampler_add(sampler, raw[i]);
+    CHECK(next == (i + 1) % sampler.channels);
+  }
+}
+
+static void test_sampler_decimation() {
+  ASDFSampler sampler;
+  asdf_sampler_reset(sampler, 3, 2);
+  CHECK(asdf_sampler_max(sampler) == 4092);
+
+  // nothing published before 16 rounds
+  const unsigned int full[3] = { 1023, 0, 512 };
+  for (int r = 0; r < 15; r++)
+    sample_round(sampler, full);
+  CHECK(sampler.seq == 0);
+  sample_round(sampler, full);
+  CHECK(sampler.seq == 1);
+
+  unsigned int values[3];
+  CHECK(asdf_sampler_read(sampler, values) == 1);
+  CHECK(values[0] == 4092);
+  CHECK(values[1] == 0);
+  CHECK(values[2] == 2048);
+
+  // a level between two ADC codes comes out between them: 10.25 LSB => 41 in 12 bits
+  for (int r = 0; r < 16; r++) {
+    const unsigned int dither[3] = { r < 4 ? 11u : 10u, 0, 0 };
+    sample_round(sampler, dither);
+  }
+  CHECK(asdf_sampler_read(sampler, values) == 2);
+  CHECK(values[0] == 41);
+}
+
+static void test_sampler_no_oversampling() {
+  ASDFSampler sampler;
+  asdf_sampler_reset(sampler, 2, 0);
+  CHECK(asdf_sampler_max(sampler) == 1023);
+
+  const unsigned int raw[2] = { 100, 900 };
+  sample_round(sampler, raw);
+  unsigned int values[2];
+  CHECK(asdf_sampler_read(sampler, values) == 1);
+  CHECK(values[0] == 100 && values[1] == 900);
+}
+
+static void test_sampler_limits() {
+  ASDFSampler sampler;
+  asdf_sampler_reset(sampler, ASDF_SAMPLER_MAX_CHANNELS + 1, ASDF_SAMPLER_MAX_OVERSAMPLE_BITS + 1);
+  CHECK(sampler.channels == ASDF_SAMPLER_MAX_CHANNELS);
+  CHECK(sampler.oversample_bits == ASDF_SAMPLER_MAX_OVERSAMPLE_BITS);
+
+  // the largest sum must fit 16 bits, as an AVR unsigned int
+  unsigned int raw[ASDF_SAMPLER_MAX_CHANNELS];
+  for (int i = 0; i < ASDF_SAMPLER_MAX_CHANNELS; i++)
+    raw[i] = 1023;
+  for (int r = 0; r < (1 << (2 * ASDF_SAMPLER_MAX_OVERSAMPLE_BITS)); r++) {
+    sample_round(sampler, raw);
+    CHECK(sampler.sums[0] <= 0xFFFF);
+  }
+  unsigned int values[ASDF_SAMPLER_MAX_CHANNELS];
+  CHECK(asdf_sampler_read(sampler, values) == 1);
+  CHECK(values[0] == asdf_sampler_max(sampler));
+}
+
+static void test_sampler_double_buffer() {
+  ASDFSampler sampler;
+  asdf_sampler_reset(sampler, 1, 0);
+
+  // each publish goes to the half loop() is not reading
+  asdf_sampler_add(sampler, 10);
+  unsigned char front = sampler.front;
+  CHECK(sampler.sets[front][0] == 10);
+  asdf_sampler_add(sampler, 20);
+  CHECK(sampler.front != front);
+  CHECK(sampler.sets[front][0] == 10);
+  CHECK(sampler.sets[sampler.front][0] == 20);
+}
+
+// a motion run, tick by tick, with what the checks need about it
+struct MotionRun {
+  long ticks;                               // until all axes were idle, or the limit
+  long steps[ASDF_MOTION_MAX_AXES];         // steps emitted
+  long driven[ASDF_MOTION_MAX_AXES];        // net steps emitted, as a driver would count them
+  unsigned long max_speed_q8[ASDF_MOTION_MAX_AXES];
+  unsigned long max_dv_q8[ASDF_MOTION_MAX_AXES];  // largest speed change in one tick
+  long first_step[ASDF_MOTION_MAX_AXES];    // tick of the first step; -1 if none
+  long peak[ASDF_MOTION_MAX_AXES];          // furthest position reached toward max_pos
+};
+
+// tick @motion until all axes are idle or @max_ticks pass
+static MotionRun run_motion(ASDFMotion& motion, long max_ticks) {
+  MotionRun run;
+  memset(&run, 0, sizeof(run));
+  for (int i = 0; i < ASDF_MOTION_MAX_AXES; i++) {
+    run.first_step[i] = -1;
+    run.peak[i] = motion.axis[i].position;
+  }
+
+  for (run.ticks = 0; run.ticks < max_ticks; run.ticks++) {
+    bool idle = true;
+    for (unsigned char i = 0; i < motion.axes; i++)
+      idle = idle && asdf_motion_idle(motion, i);
+    if (idle)
+      break;
+
+    unsigned long before[ASDF_MOTION_MAX_AXES];
+    for (unsigned char i = 0; i < motion.axes; i++)
+      before[i] = motion.axis[i].speed_q8;
+
+    unsigned char forward;
+    unsigned char steps = asdf_motion_tick(motion, &forward);
+    CHECK((forward & ~steps) == 0);
+
+    for (unsigned char i = 0; i < motion.axes; i++) {
+      unsigned long speed = motion.axis[i].speed_q8;
+      unsigned long dv = speed > before[i] ? speed - before[i] : before[i] - speed;
+      // a stop within a step may drop the last bit of speed at once
+      if (speed != 0 && dv > run.max_dv_q8[i])
+        run.max_dv_q8[i] = dv;
+      if (speed > run.max_speed_q8[i])
+        run.max_speed_q8[i] = speed;
+      if (steps & (1 << i)) {
+        run.steps[i]++;
+        run.driven[i] += (forward & (1 << i)) ? 1 : -1;
+        if (run.first_step[i] < 0)
+          run.first_step[i] = run.ticks;
+        if (motion.axis[i].position > run.peak[i])
+          run.peak[i] = motion.axis[i].position;
+      }
+    }
+  }
+  return run;
+}
+
+static void test_motion_trapezoid() {
+  ASDFMotion motion;
+  asdf_motion_reset(motion, 1);
+  asdf_motion_config(motion, 0, 0, 1000, 200, 400);
+  asdf_motion_set_target(motion, 0, 500);
+
+  MotionRun run = run_motion(motion, 10 * ASDF_MOTION_TICK_HZ);
+  CHECK(asdf_motion_idle(motion, 0));
+  CHECK(motion.axis[0].position == 500);
+  CHECK(run.steps[0] == 500);
+  CHECK(run.driven[0] == 500);
+  CHECK(run.max_speed_q8[0] == 200UL << 8);
+  CHECK(run.max_dv_q8[0] <= motion.axis[0].dv_q8);
+
+  // 0.5 s up to speed, 0.5 s down, 2 s at 200 steps/s in between: 3 s
+  double seconds = (double)run.ticks / ASDF_MOTION_TICK_HZ;
+  CHECK(seconds > 2.9 && seconds < 3.1);
+}
+
+static void test_motion_short_move() {
+  // too short to reach top speed: a triangle, still exact
+  ASDFMotion motion;
+  asdf_motion_reset(motion, 1);
+  asdf_motion_config(motion, 0, -100, 100, 1000, 400);
+  asdf_motion_set_target(motion, 0, -10);
+
+  MotionRun run = run_motion(motion, 10 * ASDF_MOTION_TICK_HZ);
+  CHECK(motion.axis[0].position == -10);
+  CHECK(run.driven[0] == -10);
+  CHECK(run.steps[0] == 10);
+  CHECK(run.max_speed_q8[0] < 100UL << 8);  // sqrt(400 * 10) ~ 63 steps/s
+
+  // one step
+  asdf_motion_set_target(motion, 0, -9);
+  run = run_motion(motion, ASDF_MOTION_TICK_HZ);
+  CHECK(motion.axis[0].position == -9);
+  CHECK(run.steps[0] == 1);
+}
+
+static void test_motion_concurrent() {
+  // all axes move in the same ticks; none waits for another
+  ASDFMotion motion;
+  asdf_motion_reset(motion, 3);
+  for (unsigned char i = 0; i < 3; i++)
+    asdf_motion_config(motion, i, 0, 50, 100, 400);
+  asdf_motion_set_target(motion, 0, 50);
+  asdf_motion_set_target(motion, 1, 20);
+  asdf_motion_set_target(motion, 2, 35);
+
+  MotionRun run = run_motion(motion, 10 * ASDF_MOTION_TICK_HZ);
+  CHECK(motion.axis[0].position == 50);
+  CHECK(motion.axis[1].position == 20);
+  CHECK(motion.axis[2].position == 35);
+  CHECK(run.first_step[0] == run.first_step[1]);
+  CHECK(run.first_step[1] == run.first_step[2]);
+  // the whole run takes as long as the longest move alone: 0.25 + 0.25 + 0.25 s
+  double seconds = (double)run.ticks / ASDF_MOTION_TICK_HZ;
+  CHECK(seconds > 0.7 && seconds < 0.8);
+}
+
+static void test_motion_reverse() {
+  // target moves behind the axis while it travels: it brakes, turns round and lands exactly
+  ASDFMotion motion;
+  asdf_motion_reset(motion, 1);
+  asdf_motion_config(motion, 0, 0, 1000, 200, 400);
+  asdf_motion_set_position(motion, 0, 500);
+  asdf_motion_set_target(motion, 0, 900);
+  for (int t = 0; t < ASDF_MOTION_TICK_HZ; t++) {
+    unsigned char forward;
+    asdf_motion_tick(motion, &forward);
+  }
+  long turned_at = motion.axis[0].position;
+  CHECK(turned_at > 600);
+
+  asdf_motion_set_target(motion, 0, 550);
+  MotionRun run = run_motion(motion, 10 * ASDF_MOTION_TICK_HZ);
+  CHECK(motion.axis[0].position == 550);
+  CHECK(run.driven[0] == 550 - turned_at);
+  CHECK(run.steps[0] > turned_at - 550);     // overshot while braking
+  CHECK(run.peak[0] <= turned_at + 51);       // by no more than braking from 200 steps/s takes
+  CHECK(run.max_dv_q8[0] <= motion.axis[0].dv_q8);
+}
+
+static void test_motion_travel() {
+  ASDFMotion motion;
+  asdf_motion_reset(motion, 1);
+  asdf_motion_config(motion, 0, 0, 50, 100, 400);
+
+  // targets are clamped to the travel, and no step leaves it
+  asdf_motion_set_target(motion, 0, 80);
+  CHECK(motion.axis[0].target == 50);
+  MotionRun run = run_motion(motion, 10 * ASDF_MOTION_TICK_HZ);
+  CHECK(motion.axis[0].position == 50);
+
+  asdf_motion_set_target(motion, 0, 0);
+  for (int t = 0; t < ASDF_MOTION_TICK_HZ / 4; t++) {
+    unsigned char forward;
+    asdf_motion_tick(motion, &forward);
+  }
+  asdf_motion_set_target(motion, 0, 50);  // turn round at speed, 50 steps from the end
+  for (int t = 0; t < 10 * ASDF_MOTION_TICK_HZ; t++) {
+    unsigned char forward;
+    asdf_motion_tick(motion, &forward);
+    CHECK(motion.axis[0].position >= 0 && motion.axis[0].position <= 50);
+  }
+  CHECK(asdf_motion_idle(motion, 0));
+  CHECK(motion.axis[0].position == 50);
+
+  // a sensed position stops the axis dead
+  asdf_motion_set_target(motion, 0, 0);
+  for (int t = 0; t < ASDF_MOTION_TICK_HZ / 4; t++) {
+    unsigned char forward;
+    asdf_motion_tick(motion, &forward);
+  }
+  asdf_motion_set_position(motion, 0, 30);
+  CHECK(asdf_motion_idle(motion, 0));
+  run = run_motion(motion, ASDF_MOTION_TICK_HZ);
+  CHECK(run.steps[0] == 0);
+}
+
+static void test_motion_limits() {
+  // settings past their bounds are clamped, and the tick stays exact at the extremes
+  ASDFMotion motion;
+  asdf_motion_reset(motion, ASDF_MOTION_MAX_AXES + 1);
+  CHECK(motion.axes == ASDF_MOTION_MAX_AXES);
+  asdf_motion_config(motion, 0, 0, 100000, 60000, 60000);
+  CHECK(motion.axis[0].max_pos == ASDF_MOTION_MAX_TRAVEL);
+  CHECK(motion.axis[0].max_speed_q8 == (unsigned long)ASDF_MOTION_MAX_SPEED << 8);
+  CHECK(motion.axis[0].accel == ASDF_MOTION_MAX_ACCEL);
+
+  asdf_motion_set_target(motion, 0, ASDF_MOTION_MAX_TRAVEL);
+  MotionRun run = run_motion(motion, 100 * ASDF_MOTION_TICK_HZ);
+  CHECK(motion.axis[0].position == ASDF_MOTION_MAX_TRAVEL);
+  CHECK(run.steps[0] == ASDF_MOTION_MAX_TRAVEL);
+
+  // slowest: a step every few seconds still gets there
+  asdf_motion_config(motion, 1, 0, 3, 1, 1);
+  asdf_motion_set_target(motion, 1, 3);
+  run = run_motion(motion, 100 * ASDF_MOTION_TICK_HZ);
+  CHECK(motion.axis[1].position == 3);
+}
+
+// thresholds of the override tests, in lever units and ms
+#define TEST_TRIP     (100)
+#define TEST_CLEAR    (50)
+#define TEST_TRIP_MS  (40)
+
+// feed lever @i an error of @error every ms from @from_ms for @ms; returns the ms it tripped at, -1 if none
+static long hold_error(ASDFOverride& ovr, unsigned char i, long error, unsigned long from_ms, unsigned long ms) {
+  for (unsigned long t = from_ms; t < from_ms + ms; t++)
+    if (asdf_override_update(ovr, i, 1000, 1000 + error, t))
+      return (long)t;
+  return -1;
+}
+
+static void test_override_debounce() {
+  ASDFOverride ovr;
+  asdf_override_config(ovr, TEST_TRIP, TEST_CLEAR, TEST_TRIP_MS);
+
+  // just under the trip threshold never trips, however long it lasts
+  CHECK(hold_error(ovr, 1, TEST_TRIP - 1, 0, 1000) == -1);
+
+  // at it, trips once the debounce runs out, in either direction
+  CHECK(hold_error(ovr, 1, TEST_TRIP, 1000, 1000) == 1000 + TEST_TRIP_MS);
+  CHECK(hold_error(ovr, 2, -TEST_TRIP, 1000, 1000) == 1000 + TEST_TRIP_MS);
+  CHECK(asdf_override_tripped(ovr) == 0b110);
+
+  // no debounce trips on the first sample
+  asdf_override_config(ovr, TEST_TRIP, TEST_CLEAR, 0);
+  CHECK(hold_error(ovr, 0, TEST_TRIP, 0, 1) == 0);
+}
+
+static void test_override_hysteresis() {
+  ASDFOverride ovr;
+  asdf_override_config(ovr, TEST_TRIP, TEST_CLEAR, TEST_TRIP_MS);
+
+  // noise across the trip threshold, staying above clear, does not restart the debounce
+  unsigned long t = 0;
+  for (; t < TEST_TRIP_MS; t++)
+    CHECK(!asdf_override_update(ovr, 0, 0, t % 2 ? TEST_CLEAR : TEST_TRIP, t));
+  CHECK(asdf_override_update(ovr, 0, 0, TEST_CLEAR, t));
+
+  // a bump shorter than the debounce that falls back under clear is forgotten
+  asdf_override_reset(ovr);
+  CHECK(hold_error(ovr, 0, TEST_TRIP, 0, TEST_TRIP_MS - 1) == -1);
+  CHECK(hold_error(ovr, 0, TEST_CLEAR - 1, TEST_TRIP_MS - 1, 1) == -1);
+  CHECK(hold_error(ovr, 0, TEST_TRIP, TEST_TRIP_MS, TEST_TRIP_MS - 1) == -1);
+  CHECK(asdf_override_tripped(ovr) == 0);
+  CHECK(hold_error(ovr, 0, TEST_TRIP, 2 * TEST_TRIP_MS - 1, 2) == 2 * TEST_TRIP_MS);
+
+  // the debounce survives millis() wrapping round
+  asdf_override_reset(ovr);
+  unsigned long wrap_ms = 0UL - 0x10;
+  CHECK(!asdf_override_update(ovr, 0, 0, TEST_TRIP, wrap_ms));
+  CHECK(hold_error(ovr, 0, TEST_TRIP, 0, 0x100) == TEST_TRIP_MS - 0x10);
+}
+
+static void test_override_latch() {
+  ASDFOverride ovr;
+  asdf_override_config(ovr, TEST_TRIP, TEST_TRIP + 1, TEST_TRIP_MS);
+  CHECK(ovr.clear == TEST_TRIP);
+
+  // a tripped lever reports once and stays tripped, even if the pilot lets go
+  CHECK(hold_error(ovr, 1, TEST_TRIP, 0, 1000) == TEST_TRIP_MS);
+  CHECK(hold_error(ovr, 1, TEST_TRIP, 1000, 1000) == -1);
+  CHECK(hold_error(ovr, 1, 0, 2000, 1000) == -1);
+  CHECK(asdf_override_tripped(ovr) == 0b010);
+
+  // the other levers are watched independently
+  CHECK(hold_error(ovr, 2, TEST_TRIP, 3000, 1000) == 3000 + TEST_TRIP_MS);
+  CHECK(asdf_override_tripped(ovr) == 0b110);
+
+  asdf_override_reset(ovr);
+  CHECK(asdf_override_tripped(ovr) == 0);
+  CHECK(hold_error(ovr, 1, TEST_TRIP, 4000, 1000) == 4000 + TEST_TRIP_MS);
+}
+
+int main() {
+  test_crc();
+  test_decode_each_byte();
+  test_no_data();
+  test_max_data();
+  test_leading_garbage();
+  test_bad_length();
+  test_corrupted_then_valid();
+  test_lost_byte();
+  test_back_to_back();
+  test_command_sizes();
+  test_sampler_decimation();
+  test_sampler_no_oversampling();
+  test_sampler_limits();
+  test_sampler_double_buffer();
+  test_motion_trapezoid();
+  test_motion_short_move();
+  test_motion_concurrent();
+  test_motion_reverse();
+  test_motion_travel();
+  test_motion_limits();
+  test_override_debounce();
+  test_override_hysteresis();
+  test_override_latch();
+
+  printf("%d checks, %d failed\n", checks, failures);
+  return failures == 0 ? 0 : 1;
+}
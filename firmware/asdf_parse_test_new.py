@@ -7,8 +7,13 @@ import sys
 CMD_RESET	 = (0x80)
 CMD_POLL	 = (0x81)
 CMD_LVR_RELS = (0x83)
+CMD_MODE	 = (0x86)
 CMD_ASDF	 = (0xFF)
 
+# lever data formats (CMD_MODE data[0])
+MODE_7BIT	 = (0)
+MODE_12BIT	 = (1)
+
 # CMD_LVR_SET command list
 # cmd[6:4] => 000, 001, 010, 011, 100, 101, 110, 111
 CMD_LVR_SET_MAP = {
@@ -36,6 +41,7 @@ str2cmd_map = {
     "reset": CMD_RESET,
     "poll": CMD_POLL,
     "lvrrels": CMD_LVR_RELS,
+    "mode": CMD_MODE,
     "asdf": CMD_ASDF,
     "lvrset": CMD_LVR_SET_MAP
 }
@@ -49,6 +55,20 @@ resp2str_map = {
     ASDF_LVR_RELS_RESP: "release lever done"
 }
 
+# ASDF v2 framing: SYNC | LEN | SEQ | CODE | DATA[LEN] | CRC-8 of LEN..DATA
+FRAME_SYNC = (0xA5)
+FRAME_MAX_DATA = (16)
+
+def crc8(data): # poly 0x07, init 0
+    crc = 0
+    for b in data:
+        crc ^= b
+        for i in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+seq = 0
+
 def readCmd(n):
     if n == 0:
         data = arduino.read(arduino.in_waiting)
@@ -56,11 +76,35 @@ def readCmd(n):
         data = arduino.read(n)
     return data
 
-def writeCmd(data): # data should be a byte
-    length = arduino.write(bytes([data]))
+def writeCmd(code, data = []): # send a command frame
+    global seq
+    body = bytes([len(data), seq, code] + data)
+    seq = (seq + 1) % 256
+    length = arduino.write(bytes([FRAME_SYNC]) + body + bytes([crc8(body)]))
     print("write size: ", length)
     return length
 
+def readFrame(): # next valid frame as (seq, code, data); None on timeout
+    while True:
+        b = readCmd(1)
+        if len(b) == 0:
+            return None
+        if b[0] != FRAME_SYNC:
+            continue
+        head = readCmd(3)
+        if len(head) < 3 or head[0] > FRAME_MAX_DATA:
+            continue
+        rest = readCmd(head[0] + 1)
+        if len(rest) < head[0] + 1 or crc8(head + rest[:-1]) != rest[-1]:
+            print("bad frame")
+            continue
+        return (head[1], head[2], list(rest[:-1]))
+
+def parsePoll(data): # ASDF_POLL_OK data as (buttons, [speed brake, thrust 1, thrust 2]) in [0,4095]
+    if len(data) == 7: # MODE_12BIT
+        return (data[0], [data[1 + 2 * i] | (data[2 + 2 * i] << 8) for i in range(3)])
+    return (data[0], [(v * 4095 + 63) // 127 for v in data[1:4]])
+
 # serial_port = input("Input Serial Port Name: ")
 # baudrate = int(input("Input Baud Rate: "))
 
@@ -94,9 +138,8 @@ while True:
         arduino.open()
         while True:
             #wait_for_serial()
-            rdy = int.from_bytes(readCmd(1), "big")
-            #print(resp2str_map[rdy])
-            if rdy == ASDF_RESET:
+            rdy = readFrame()
+            if rdy is not None and rdy[1] == ASDF_RESET:
                 print("Device reset done")
                 break
 
@@ -104,16 +147,22 @@ while True:
         t = time.time()
         writeCmd(str2cmd_map[cmd])
         #wait_for_serial()
-        acquired = readCmd(5)
-        acq_array = list(acquired)
-        print(acq_array)
+        frame = readFrame()
+        print(frame)
+        if frame is not None and frame[1] == ASDF_POLL_OK:
+            print("levers: ", parsePoll(frame[2]))
         print("rate =", 1 / (time.time() - t), "polls/sec") # Calculate poll rate
+
+    if cmd == "mode": # CMD_MODE
+        bits = input("Input Lever Bits (7 or 12): ")
+        writeCmd(str2cmd_map[cmd], [MODE_12BIT if bits == "12" else MODE_7BIT])
+        print(readFrame())
     
     if cmd == "lvrrels": # CMD_LVR_RELS
         writeCmd(str2cmd_map[cmd])
         #wait_for_serial()
         # time.sleep(0.05)
-        print(readCmd(1))
+        print(readFrame())
 
     if cmd == "lvrset": # CMD_LVR_SET
         bitmask = input("Input Lever Bitmask ({speed brake, thrust 1, thrust 2}): ")
@@ -123,17 +172,15 @@ while True:
         print("Command: ", str2cmd_map[cmd][bitmask])
         if bitmask == "000":
             pass
-        writeCmd(str2cmd_map[cmd][bitmask])
-        for val in lvr_vals:
-            writeCmd(val)
+        writeCmd(str2cmd_map[cmd][bitmask], lvr_vals)
 
         #wait_for_serial()
-        print(readCmd(1))
+        print(readFrame())
 
     if cmd == "asdf":
         writeCmd(str2cmd_map[cmd])
         #wait_for_serial()
-        print(readCmd(1))
+        print(readFrame())
 
 
 print("closing debug session")
@@ -0,0 +1,692 @@
+// DeviceEmulator.cpp : Software stand-in for the throttle quadrant Arduino on a pseudo-terminal (Linux only).
+//
+// Speaks the ASDF command set of arduino_ino_tests/serial_test/serial_test.ino, so TQThreadTest,
+// TQThread and the benchmarks run without the rig:
+//     g++ -std=c++17 -O2 -IHostAddOn/HostAddOn HostAddOn/DeviceEmulator/DeviceEmulator.cpp HostAddOn/HostAddOn/ASDFFrame.cpp HostAddOn/HostAddOn/AsyncLog.cpp -pthread -o DeviceEmulator
+//     ./DeviceEmulator -b 115200 -l 500 -j 200 -d 0.001 &
+//     ASDF_PORT=<printed pty> ./TQThreadTest poll 10000 4
+//
+// Link impairments (all default off):
+//     -b baud		pace both directions at 10 bits per byte
+//     -l us		latency added before each response
+//     -j us		uniform jitter (+/-) on that latency
+//     -d prob		probability of losing each byte, in either direction
+//     -c prob		probability of flipping a bit of each byte, in either direction
+//     -w prob		probability of the device hanging after a command; it ignores the host meanwhile
+//     -W ms		how long a hang lasts (default 500)
+//     -s seed		random seed for jitter and loss
+//     -p ms		period of the scripted pilot lever motion; 0 holds the levers still
+//     -o ms		the pilot grabs the throttles this long after A/T takes them and holds them against
+//     			the motor until the host releases them; 0 (default) never
+//     -r ms		time from the host opening the port to ASDF_RESET after a reset
+//     -L path		also create a symlink @path to the pty
+// Bytes the device sends while the host has the port closed are lost, as with the real board.
+//     -v			log every command
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <random>
+
+#include "ASDFProtocol.h"
+#include "debug.h"
+
+// return if lever @i should be set, provided CMD_LVR_SET command @cmd (as in serial_test.ino)
+#define shouldSetLever(cmd, i)	((cmd) & (1 << (6 - i)))
+
+// the emulated motor moves a lever by MOTOR_STEP ASDF units every MOTOR_STEP_MS under A/T
+#define MOTOR_STEP_MS	(5)
+#define MOTOR_STEP		(8)
+
+// pilot override detection, as asdf_override.h does it on the board: a throttle this far (ASDF units)
+// from where its motor has stepped it for OVERRIDE_TRIP_MS, never falling back under OVERRIDE_CLEAR
+#define OVERRIDE_TRIP		(400)
+#define OVERRIDE_CLEAR		(200)
+#define OVERRIDE_TRIP_MS	(40)
+
+// link settings
+static unsigned long baud_rate = 0;			// 0 => unpaced
+static unsigned long latency_us = 0;
+static unsigned long jitter_us = 0;
+static double loss_prob = 0;
+static double corrupt_prob = 0;
+static double hang_prob = 0;
+static unsigned long hang_ms = 500;
+static unsigned long pilot_period_ms = 4000;
+static unsigned long pilot_grab_ms = 0;
+static unsigned long reset_ms = 1000;		// serial_test.ino waits 1 s in setup() once the port is open
+static bool verbose = false;
+
+static std::mt19937 rng;
+static volatile sig_atomic_t quit = 0;
+
+// a byte in flight and the time (us) it comes out of the link
+struct LinkByte {
+	unsigned char b;
+	unsigned long long ready_us;
+};
+
+static std::deque<LinkByte> rx_queue;	// host -> device
+static std::deque<LinkByte> tx_queue;	// device -> host
+static unsigned long long rx_last_us = 0;	// ready time of the last byte queued in each direction
+static unsigned long long tx_last_us = 0;
+
+// link statistics
+static unsigned long long rx_bytes = 0, tx_bytes = 0;
+static unsigned long long rx_lost = 0, tx_lost = 0;
+static unsigned long long rx_corrupted = 0, tx_corrupted = 0;
+static unsigned long long commands = 0;
+static unsigned long long setpoint_commands = 0;	// commands carrying A/T lever positions
+static unsigned long long hangs = 0;
+static unsigned long long overrides = 0;
+
+// false while the host has the port closed; whatever the device sends meanwhile is lost
+static bool host_connected = false;
+
+// device state; mirrors the globals of serial_test.ino. lever positions are [0,ASDF_LEVER_MAX]
+static unsigned short speed_brake_level = 0;
+static unsigned short throttle_level[2] = { 0, 0 };		// A/T targets
+static unsigned short throttle_measured[2] = { 0, 0 };
+static unsigned short motor_position[2] = { 0, 0 };		// where the motor has stepped the throttles to
+static unsigned char button_status = 0;
+static unsigned char AT_Engaged = 0;
+static unsigned long long AT_taken_us = 0;		// when A/T took the levers
+static unsigned char last_seq = 0;		// sequence number of the last command answered
+
+// the pilot holding the throttles at pilot_hold (see -o); and the override the device detected,
+// bit i = lever i of a poll report, latched until CMD_LVR_RELS
+static bool pilot_holding = false;
+static unsigned short pilot_hold[2] = { 0, 0 };
+static bool override_pending[2] = { false, false };
+static unsigned long long override_since_us[2] = { 0, 0 };
+static unsigned char override_levers = 0;
+
+// CMD_LVR_MOVE segment the A/T targets follow, while move_active
+static bool move_active = false;
+static unsigned short move_start[2] = { 0, 0 };
+static unsigned short move_end[2] = { 0, 0 };
+static unsigned long long move_start_us = 0;
+static unsigned long long move_duration_us = 0;
+static unsigned char lever_mode = ASDF_MODE_7BIT;	// see CMD_MODE
+
+static unsigned char stream_period_ms = 0;
+static unsigned char stream_deadband = 0;		// in lever_mode units
+static unsigned long long stream_check_us = 0;
+static unsigned long long stream_report_us = 0;
+static unsigned short stream_last[4] = { 0 };	// button status and lever positions in lever_mode units
+static unsigned char stream_seq = 0;	// sequence number of the next stream report
+
+// frames from the host, decoded a byte at a time as asdf_parse.ino does
+static ASDFFrameDecoder rx_decoder;
+
+// device is rebooting after CMD_RESET; setup() waits for the host to open the port,
+// then reset_ms more before it reports ASDF_RESET
+static bool booting = false;
+static unsigned long long boot_connected_us = 0;	// when the host opened the port; 0 => not yet
+
+// device hangs until then (see -w)
+static unsigned long long hang_until_us = 0;
+
+// microseconds on the monotonic clock
+static unsigned long long now_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// wire time of one byte at baud_rate (8N1)
+static unsigned long long byte_time_us() {
+	return baud_rate ? 10000000ULL / baud_rate : 0;
+}
+
+static bool lose_byte() {
+	return loss_prob > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < loss_prob;
+}
+
+// @b with one random bit flipped at corrupt_prob; counted in @corrupted
+static unsigned char corrupt_byte(unsigned char b, unsigned long long& corrupted) {
+	if (corrupt_prob <= 0 || std::uniform_real_distribution<double>(0, 1)(rng) >= corrupt_prob)
+		return b;
+	corrupted++;
+	return b ^ (unsigned char)(1 << std::uniform_int_distribution<int>(0, 7)(rng));
+}
+
+// queue bytes from the device; latency and jitter apply to the first one
+static void device_write(const unsigned char* buf, unsigned int size) {
+	unsigned long long t = now_us() + latency_us;
+	if (jitter_us) {
+		long j = std::uniform_int_distribution<long>(-(long)jitter_us, (long)jitter_us)(rng);
+		t = (j < 0 && (unsigned long long)-j > t) ? 0 : t + j;
+	}
+
+	for (unsigned int i = 0; i < size; i++) {
+		unsigned long long ready = (t > tx_last_us ? t : tx_last_us) + byte_time_us();
+		tx_last_us = ready;
+		if (lose_byte()) {
+			tx_lost++;
+			continue;
+		}
+		tx_queue.push_back({ corrupt_byte(buf[i], tx_corrupted), ready });
+	}
+}
+
+// queue a response frame with @size data bytes
+static void device_write_frame(unsigned char seq, unsigned char code, const unsigned char* data = NULL, unsigned int size = 0) {
+	ASDFFrame frame;
+	frame.seq = seq;
+	frame.code = code;
+	frame.data_size = size;
+	for (unsigned int i = 0; i < size; i++)
+		frame.data[i] = data[i];
+
+	unsigned char buf[ASDF_FRAME_MAX_SIZE];
+	device_write(buf, asdf_frame_encode(frame, buf));
+}
+
+// # of bytes a lever position takes in lever_mode
+static unsigned int lever_size() {
+	return lever_mode == ASDF_MODE_12BIT ? 2 : 1;
+}
+
+// lever position received in lever_mode at @data
+static unsigned short get_lever(const unsigned char* data) {
+	if (lever_mode == ASDF_MODE_12BIT)
+		return std::min((unsigned int)(data[0] | (data[1] << 8)), (unsigned int)ASDF_LEVER_MAX);
+	return ASDF_LEVER_FROM_7BIT(data[0] & 0x7F);
+}
+
+// button status and measured lever positions in lever_mode units
+static void lever_state(unsigned short* state) {
+	state[0] = button_status;
+	state[1] = speed_brake_level;
+	state[2] = throttle_measured[0];
+	state[3] = throttle_measured[1];
+	for (int i = 1; i < 4 && lever_mode == ASDF_MODE_7BIT; i++)
+		state[i] = ASDF_LEVER_TO_7BIT(state[i]);
+}
+
+// current button status and measured lever positions, as carried by ASDF_POLL_OK and ASDF_STREAM_REPORT;
+// returns the report size
+static unsigned int lever_report(unsigned char* report) {
+	unsigned short state[4];
+	lever_state(state);
+
+	unsigned int size = 0;
+	report[size++] = (unsigned char)state[0];
+	for (int i = 1; i < 4; i++) {
+		report[size++] = state[i] & 0xFF;
+		if (lever_mode == ASDF_MODE_12BIT)
+			report[size++] = state[i] >> 8;
+	}
+	return size;
+}
+
+static bool stream_changed() {
+	unsigned short state[4];
+	lever_state(state);
+
+	if (state[0] != stream_last[0])
+		return true;
+	for (int i = 1; i < 4; i++)
+		if (abs((int)state[i] - (int)stream_last[i]) > stream_deadband)
+			return true;
+	return false;
+}
+
+static void send_stream_report(unsigned long long now) {
+	unsigned char report[ASDF_POLL_DATA_SIZE_12BIT];
+	device_write_frame(stream_seq++, ASDF_STREAM_REPORT, report, lever_report(report));
+
+	lever_state(stream_last);
+	stream_report_us = now;
+}
+
+static void device_reset() {
+	speed_brake_level = 0;
+	throttle_level[0] = throttle_level[1] = 0;
+	button_status = 0;
+	AT_Engaged = 0;
+	move_active = false;
+	pilot_holding = false;
+	override_levers = 0;
+	lever_mode = ASDF_MODE_7BIT;
+	stream_period_ms = 0;
+	stream_seq = 0;
+	asdf_frame_decoder_reset(rx_decoder);
+	rx_queue.clear();
+	tx_queue.clear();
+	booting = true;
+	boot_connected_us = 0;
+}
+
+// tell the host the pilot overrode the motors; see ASDF_LVR_RELS_PILOT
+static void send_pilot_override() {
+	device_write_frame(last_seq, ASDF_LVR_RELS_PILOT, &override_levers, 1);
+}
+
+// A/T drives the levers from where they are, unless the pilot overrode it; true if it does
+static bool take_levers() {
+	if (override_levers != 0)
+		return false;
+	if (!AT_Engaged) {
+		for (int i = 0; i < 2; i++)
+			motor_position[i] = throttle_measured[i];
+		override_pending[0] = override_pending[1] = false;
+		AT_taken_us = now_us();
+	}
+	AT_Engaged = 1;
+	return true;
+}
+
+// compare each throttle with where its motor has it; let go of both once one trips
+static void detect_override(unsigned long long now) {
+	for (int i = 0; i < 2; i++) {
+		int error = abs((int)throttle_measured[i] - (int)motor_position[i]);
+		if (!override_pending[i]) {
+			if (error < OVERRIDE_TRIP)
+				continue;
+			override_pending[i] = true;
+			override_since_us[i] = now;
+		} else if (error < OVERRIDE_CLEAR) {
+			override_pending[i] = false;
+			continue;
+		}
+		if (now - override_since_us[i] >= OVERRIDE_TRIP_MS * 1000ULL)
+			override_levers |= 1 << (i + 1);
+	}
+	if (override_levers == 0)
+		return;
+
+	AT_Engaged = 0;
+	move_active = false;
+	overrides++;
+	Log("DeviceEmulator: pilot override (levers 0x%02X); motors released\n", override_levers);
+	send_pilot_override();
+}
+
+// move the levers: scripted pilot input while the levers are free, the motor while A/T drives them
+static void update_levers(unsigned long long now) {
+	static unsigned long long motor_us = 0;
+
+	if (AT_Engaged) {
+		if (move_active) {
+			unsigned long long t = now - move_start_us;
+			if (t >= move_duration_us)
+				move_active = false;
+			for (int i = 0; i < 2; i++)
+				throttle_level[i] = !move_active ? move_end[i] :
+					(unsigned short)(move_start[i] + ((int)move_end[i] - (int)move_start[i]) * (double)t / move_duration_us);
+		}
+
+		if (pilot_grab_ms != 0 && !pilot_holding && now - AT_taken_us >= pilot_grab_ms * 1000ULL) {
+			pilot_holding = true;
+			pilot_hold[0] = throttle_measured[0];
+			pilot_hold[1] = throttle_measured[1];
+		}
+
+		if (now - motor_us < MOTOR_STEP_MS * 1000)
+			return;
+		motor_us = now;
+		for (int i = 0; i < 2; i++) {
+			// a stepper held back skips steps; its count goes on
+			if (motor_position[i] + MOTOR_STEP <= throttle_level[i])
+				motor_position[i] += MOTOR_STEP;
+			else if (motor_position[i] >= throttle_level[i] + MOTOR_STEP)
+				motor_position[i] -= MOTOR_STEP;
+			else
+				motor_position[i] = throttle_level[i];
+			throttle_measured[i] = pilot_holding ? pilot_hold[i] : motor_position[i];
+		}
+		detect_override(now);
+		return;
+	}
+
+	if (pilot_period_ms == 0 || pilot_holding)
+		return;
+	double phase = 2 * M_PI * (double)(now / 1000 % pilot_period_ms) / pilot_period_ms;
+	throttle_measured[0] = (unsigned short)(ASDF_LEVER_MAX * (0.5 + 0.31 * sin(phase)));
+	throttle_measured[1] = (unsigned short)(ASDF_LEVER_MAX * (0.5 + 0.31 * sin(phase + M_PI / 8)));
+	speed_brake_level = (unsigned short)(ASDF_LEVER_MAX * (0.16 + 0.16 * sin(phase / 2)));
+}
+
+// # of data bytes command @cmd takes; -1 if @cmd is not a command
+static int command_data_size(unsigned char cmd) {
+	switch (cmd) {
+		case CMD_RESET:
+		case CMD_POLL:
+		case CMD_LVR_RELS:
+		case CMD_ASDF:
+			return 0;
+		case CMD_MODE:
+			return 1;
+		case CMD_STREAM:
+			return 2;
+		case CMD_POLL_SET:
+			return 2 * lever_size();
+		case CMD_LVR_MOVE:
+			return 2 * lever_size() + 2;
+	}
+
+	for (unsigned int i = 0; i < sizeof(CMD_LVR_SET_LIST) / sizeof(CMD_LVR_SET_LIST[0]); i++)
+		if (cmd == CMD_LVR_SET_LIST[i])	// a speed brake position is sent and skipped; it has no motor
+			return ((shouldSetLever(cmd, 0) ? 1 : 0) + (shouldSetLever(cmd, 1) ? 1 : 0) + (shouldSetLever(cmd, 2) ? 1 : 0)) * lever_size();
+
+	return -1;
+}
+
+// execute the command in @frame; responses echo its sequence number
+static void run_command(const ASDFFrame& frame) {
+	unsigned char cmd = frame.code;
+	const unsigned char* data = frame.data;
+
+	if (command_data_size(cmd) != (int)frame.data_size) {
+		device_write_frame(frame.seq, ASDF_ERROR);	// unrecognized command or wrong length
+		return;
+	}
+
+	commands++;
+	last_seq = frame.seq;
+	if (verbose)
+		Log("DeviceEmulator: command 0x%02X, seq %u\n", cmd, frame.seq);
+
+	switch (cmd) {
+		case CMD_RESET:
+			device_reset();
+			break;
+
+		case CMD_POLL:
+		{
+			unsigned char report[ASDF_POLL_DATA_SIZE_12BIT];
+			device_write_frame(frame.seq, ASDF_POLL_OK, report, lever_report(report));
+			break;
+		}
+
+		case CMD_POLL_SET:
+		{
+			setpoint_commands++;
+			if (take_levers()) {
+				move_active = false;
+				throttle_level[0] = get_lever(data);
+				throttle_level[1] = get_lever(data + lever_size());
+			}
+
+			unsigned char report[ASDF_POLL_DATA_SIZE_12BIT];
+			device_write_frame(frame.seq, ASDF_POLL_OK, report, lever_report(report));
+			if (override_levers != 0)
+				send_pilot_override();
+			break;
+		}
+
+		case CMD_LVR_MOVE:
+		{
+			// from the running A/T target, or from the levers as A/T takes them
+			setpoint_commands++;
+			for (int i = 0; i < 2; i++) {
+				move_start[i] = AT_Engaged ? throttle_level[i] : throttle_measured[i];
+				move_end[i] = get_lever(data + i * lever_size());
+			}
+			if (take_levers()) {
+				move_start_us = now_us();
+				move_duration_us = (data[2 * lever_size()] | (data[2 * lever_size() + 1] << 8)) * 1000ULL;
+				move_active = true;
+			}
+
+			unsigned char report[ASDF_POLL_DATA_SIZE_12BIT];
+			device_write_frame(frame.seq, ASDF_POLL_OK, report, lever_report(report));
+			if (override_levers != 0)
+				send_pilot_override();
+			break;
+		}
+
+		case CMD_MODE:
+			if (data[0] != ASDF_MODE_7BIT && data[0] != ASDF_MODE_12BIT) {
+				device_write_frame(frame.seq, ASDF_ERROR);
+				break;
+			}
+			lever_mode = data[0];
+			device_write_frame(frame.seq, ASDF_ACK);
+			break;
+
+		case CMD_STREAM:
+		{
+			unsigned long long now = now_us();
+			stream_period_ms = data[0] & 0x7F;
+			stream_deadband = data[1] & 0x7F;
+			device_write_frame(frame.seq, ASDF_ACK);
+
+			stream_check_us = now;
+			if (stream_period_ms != 0)
+				send_stream_report(now);
+			break;
+		}
+
+		case CMD_LVR_RELS:
+			AT_Engaged = 0;
+			move_active = false;
+			pilot_holding = false;		// the pilot has the levers to themselves now
+			override_levers = 0;
+			device_write_frame(frame.seq, ASDF_LVR_RELS_RESP);
+			break;
+
+		case CMD_ASDF:
+			device_write_frame(frame.seq, ASDF_ACK);
+			break;
+
+		default:	// CMD_LVR_SET variants
+		{
+			setpoint_commands++;
+			if (take_levers()) {
+				move_active = false;
+				unsigned int n = shouldSetLever(cmd, 0) ? lever_size() : 0;
+				if (shouldSetLever(cmd, 1)) {
+					throttle_level[0] = get_lever(data + n);
+					n += lever_size();
+				}
+				if (shouldSetLever(cmd, 2))
+					throttle_level[1] = get_lever(data + n);
+			}
+			device_write_frame(frame.seq, ASDF_ACK);
+			if (override_levers != 0)
+				send_pilot_override();
+			break;
+		}
+	}
+}
+
+// feed one byte received from the host to the frame decoder and run the command it completes
+static void device_read(unsigned char b) {
+	ASDFFrame frame;
+	if (booting || hang_until_us != 0 || !asdf_frame_decode(rx_decoder, b, frame))
+		return;
+
+	run_command(frame);
+	if (hang_prob > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < hang_prob) {
+		hang_until_us = now_us() + hang_ms * 1000ULL;
+		hangs++;
+	}
+}
+
+// one pass of the device main loop
+static void device_loop(unsigned long long now) {
+	if (booting) {
+		if (!host_connected)
+			boot_connected_us = 0;
+		else if (boot_connected_us == 0)
+			boot_connected_us = now;
+
+		if (boot_connected_us == 0 || now - boot_connected_us < reset_ms * 1000ULL) {
+			rx_queue.clear();	// nobody listens while the board reboots
+			return;
+		}
+		booting = false;
+		device_write_frame(0, ASDF_RESET);	// report init complete
+	}
+
+	update_levers(now);
+
+	if (hang_until_us != 0) {
+		if (now < hang_until_us) {
+			rx_queue.clear();	// lost, as if the board sat in a blocking call with its buffer overflowing
+			return;
+		}
+		hang_until_us = 0;
+		asdf_frame_decoder_reset(rx_decoder);
+	}
+
+	while (!rx_queue.empty() && rx_queue.front().ready_us <= now) {
+		unsigned char b = rx_queue.front().b;
+		rx_queue.pop_front();
+		device_read(b);
+		if (booting)
+			return;
+	}
+
+	if (stream_period_ms != 0 && now - stream_check_us >= stream_period_ms * 1000ULL) {
+		stream_check_us = now;
+		if (stream_deadband == 0 || stream_changed() || now - stream_report_us >= ASDF_STREAM_KEEPALIVE_MS * 1000ULL)
+			send_stream_report(now);
+	}
+}
+
+// open a pty and return its master fd; the host opens (and reopens) the slave like a serial port
+static int open_pty(char* slave_name, size_t size) {
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+		Err("DeviceEmulator: cannot create pty: %s\n", strerror(errno));
+		return -1;
+	}
+	snprintf(slave_name, size, "%s", ptsname(master));
+
+	fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+	return master;
+}
+
+static void on_signal(int) {
+	quit = 1;
+}
+
+static void usage(const char* argv0) {
+	Err("usage: %s [-b baud] [-l latency_us] [-j jitter_us] [-d loss_prob] [-c corrupt_prob] [-w hang_prob] [-W hang_ms] [-s seed] "
+		"[-p pilot_period_ms] [-o pilot_grab_ms] [-r reset_ms] [-L link] [-v]\n", argv0);
+}
+
+int main(int argc, char* argv[]) {
+	const char* link_path = NULL;
+	unsigned long seed = 1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "b:l:j:d:c:w:W:s:p:o:r:L:v")) != -1) {
+		switch (opt) {
+			case 'b': baud_rate = strtoul(optarg, NULL, 0); break;
+			case 'l': latency_us = strtoul(optarg, NULL, 0); break;
+			case 'j': jitter_us = strtoul(optarg, NULL, 0); break;
+			case 'd': loss_prob = atof(optarg); break;
+			case 'c': corrupt_prob = atof(optarg); break;
+			case 'w': hang_prob = atof(optarg); break;
+			case 'W': hang_ms = strtoul(optarg, NULL, 0); break;
+			case 's': seed = strtoul(optarg, NULL, 0); break;
+			case 'p': pilot_period_ms = strtoul(optarg, NULL, 0); break;
+			case 'o': pilot_grab_ms = strtoul(optarg, NULL, 0); break;
+			case 'r': reset_ms = strtoul(optarg, NULL, 0); break;
+			case 'L': link_path = optarg; break;
+			case 'v': verbose = true; break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	rng.seed(seed);
+
+	char slave_name[64];
+	int master = open_pty(slave_name, sizeof(slave_name));
+	if (master < 0)
+		return 1;
+	if (link_path != NULL) {
+		unlink(link_path);
+		if (symlink(slave_name, link_path) != 0)
+			Err("DeviceEmulator: cannot link %s: %s\n", link_path, strerror(errno));
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	printf("%s\n", slave_name);
+	fflush(stdout);
+	Log("DeviceEmulator: baud %lu, latency %lu us, jitter %lu us, loss %g, corruption %g\n",
+		baud_rate, latency_us, jitter_us, loss_prob, corrupt_prob);
+
+	device_reset();		// boot like the board does when the port is opened
+
+	while (!quit) {
+		unsigned long long now = now_us();
+
+		// bytes from the host enter the link; EIO means nobody has the slave open
+		unsigned char buf[256];
+		ssize_t n;
+		while ((n = read(master, buf, sizeof(buf))) > 0) {
+			host_connected = true;
+			for (ssize_t i = 0; i < n; i++) {
+				rx_bytes++;
+				unsigned long long ready = (now > rx_last_us ? now : rx_last_us) + byte_time_us();
+				rx_last_us = ready;
+				if (lose_byte()) {
+					rx_lost++;
+					continue;
+				}
+				rx_queue.push_back({ corrupt_byte(buf[i], rx_corrupted), ready });
+			}
+		}
+		if (n < 0)
+			host_connected = errno != EIO;
+
+		device_loop(now);
+
+		// bytes to the host leave the link
+		now = now_us();
+		if (!host_connected)
+			tx_queue.clear();
+		while (!tx_queue.empty() && tx_queue.front().ready_us <= now) {
+			unsigned char b = tx_queue.front().b;
+			if (write(master, &b, 1) != 1)
+				break;
+			tx_queue.pop_front();
+			tx_bytes++;
+		}
+
+		// sleep until the next byte is due, the host sends something, or the device ticks (1 ms)
+		unsigned long long wake = now + 1000;
+		if (!rx_queue.empty() && rx_queue.front().ready_us < wake)
+			wake = rx_queue.front().ready_us;
+		if (!tx_queue.empty() && tx_queue.front().ready_us < wake)
+			wake = tx_queue.front().ready_us;
+
+		struct timespec timeout = { 0, (long)(wake > now ? wake - now : 0) * 1000 };
+		if (host_connected) {
+			struct pollfd pfd = { master, POLLIN, 0 };
+			ppoll(&pfd, 1, &timeout, NULL);
+		} else {
+			nanosleep(&timeout, NULL);	// the master reports POLLHUP until the host opens the port
+		}
+	}
+
+	if (link_path != NULL)
+		unlink(link_path);
+
+	Log("DeviceEmulator: %llu commands (%llu A/T set-points), %llu pilot overrides, %llu hangs, %lu bad frames\n",
+		commands, setpoint_commands, overrides, hangs, rx_decoder.bad_frames);
+	Log("DeviceEmulator: rx %llu bytes (%llu lost, %llu corrupted); tx %llu bytes (%llu lost, %llu corrupted)\n",
+		rx_bytes, rx_lost, rx_corrupted, tx_bytes, tx_lost, tx_corrupted);
+	return 0;
+}
+
+#endif	// !_WIN32
@@ -0,0 +1,532 @@
+// FakeSimConnect.cpp : In-process SimConnect server that scripts a PMDG 777 session.
+//
+// Implements the SimConnect calls ThrottleControl.cpp makes. A sim thread runs frames at a fixed
+// rate: it plays the scenario script (see FakeSimConnect.h), slews the throttles while the A/T is
+// engaged, and queues SimObject data, PMDG client data and events for the client, signaling the
+// event handle given to SimConnect_Open(). Only one session at a time is supported.
+
+#include "SimConnect.h"
+#include "FakeSimConnect.h"
+#include "PMDG_777X_SDK.h"
+#include "debug.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// handle returned by SimConnect_Open(); there is only one session
+#define FAKE_SIMCONNECT_HANDLE	((HANDLE)0x5C)
+
+// SimConnect interface version reported in every record
+#define FAKE_SIMCONNECT_VERSION	(4)
+
+// sim variable carrying throttle lever n (1-based) in percent
+static const char* THROTTLE_VAR_PREFIX = "GENERAL ENG THROTTLE LEVER POSITION:";
+
+// how fast the A/T moves a lever (percent per second)
+static const double AT_SLEW_RATE = 20.0;
+
+static const char* DEFAULT_SCRIPT =
+	"0 aircraft SimObjects\\Airplanes\\PMDG 777-200LR\\Boeing 777-200LR.air\n"
+	"0 sim 1\n"
+	"0 pause 0\n"
+	"3000 at_target 85 85\n"
+	"3000 at 1\n"
+	"6000 at 0\n"
+	"9000 quit\n";
+
+struct ScriptStep {
+	unsigned long long time_ms;
+	string cmd;
+	string arg;		// rest of the line
+};
+
+// SimConnect_RequestDataOnSimObject() registration
+struct DataRequest {
+	DWORD define_id;
+	SIMCONNECT_PERIOD period;
+	DWORD flags;
+	vector<double> last;	// values last sent
+	bool sent;
+	unsigned long long last_frame;
+};
+
+// everything below is guarded by session_lock
+static mutex session_lock;
+static bool session_open = false;
+static notifier_t client_event = NOTIFIER_INVALID;
+static deque<vector<unsigned char>> inbox;		// records waiting for the client
+static vector<unsigned char> dispatching;		// record handed out by the last SimConnect_GetNextDispatch()
+
+// client registrations
+static map<DWORD, vector<string>> data_definitions;		// DefineID -> datum names
+static map<DWORD, DataRequest> data_requests;			// RequestID -> request
+static map<DWORD, DWORD> client_data_requests;			// RequestID -> ClientDataID
+static map<DWORD, string> client_event_names;			// client EventID -> sim event name
+static map<DWORD, DWORD> notification_groups;			// client EventID -> GroupID
+static map<string, DWORD> system_events;				// system event name -> client EventID
+
+// sim model
+static double throttle[2];
+static double at_target[2];
+static string aircraft_path;
+static PMDG_777X_Data pmdg_data;
+static unsigned long long frame_count;
+static unsigned long long start_us;
+
+// scenario
+static string script_path;		// empty => DEFAULT_SCRIPT
+static vector<ScriptStep> script;
+static size_t script_pos;
+static unsigned int frame_rate = 60;
+static thread sim_thread;
+static atomic<bool> sim_thread_quit(false);
+
+// measurements
+static FakeSimConnectStats stats;
+static vector<FakeThrottleRecord> throttle_writes;
+static vector<FakeThrottleRecord> throttle_reports;
+
+static unsigned long long now_us() {
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// queue a record of @size bytes for the client and wake it up
+static void queue_record(SIMCONNECT_RECV* rec, size_t size, SIMCONNECT_RECV_ID id) {
+	rec->dwSize = (DWORD)size;
+	rec->dwVersion = FAKE_SIMCONNECT_VERSION;
+	rec->dwID = id;
+
+	const unsigned char* bytes = (const unsigned char*)rec;
+	inbox.push_back(vector<unsigned char>(bytes, bytes + size));
+	stats.messages++;
+	notifier_signal(client_event);
+}
+
+static void send_exception(SIMCONNECT_EXCEPTION exception) {
+	SIMCONNECT_RECV_EXCEPTION rec;
+	rec.dwException = exception;
+	rec.dwSendID = SIMCONNECT_RECV_EXCEPTION::UNKNOWN_SENDID;
+	rec.dwIndex = SIMCONNECT_RECV_EXCEPTION::UNKNOWN_INDEX;
+	queue_record(&rec, sizeof(rec), SIMCONNECT_RECV_ID_EXCEPTION);
+	stats.exceptions++;
+}
+
+static void send_event(DWORD group_id, DWORD event_id, DWORD data) {
+	SIMCONNECT_RECV_EVENT rec;
+	rec.uGroupID = group_id;
+	rec.uEventID = event_id;
+	rec.dwData = data;
+	queue_record(&rec, sizeof(rec), SIMCONNECT_RECV_ID_EVENT);
+}
+
+// a SimObject or client data record carrying @size bytes of @data
+static void send_data(SIMCONNECT_RECV_ID id, DWORD request_id, DWORD define_id, DWORD count, const void* data, size_t size) {
+	const size_t header = sizeof(SIMCONNECT_RECV_SIMOBJECT_DATA) - sizeof(DWORD);	// data replaces dwData
+	vector<unsigned char> buf(header + size);
+	SIMCONNECT_RECV_SIMOBJECT_DATA* rec = (SIMCONNECT_RECV_SIMOBJECT_DATA*)buf.data();
+
+	rec->dwRequestID = request_id;
+	rec->dwObjectID = SIMCONNECT_OBJECT_ID_USER;
+	rec->dwDefineID = define_id;
+	rec->dwFlags = 0;
+	rec->dwentrynumber = 1;
+	rec->dwoutof = 1;
+	rec->dwDefineCount = count;
+	memcpy(buf.data() + header, data, size);
+	queue_record(rec, buf.size(), id);
+}
+
+// a sim event the client mapped and put in a notification group
+static void notify_event(DWORD event_id, DWORD data) {
+	auto group = notification_groups.find(event_id);
+	if (group != notification_groups.end())
+		send_event(group->second, event_id, data);
+}
+
+// current value of sim variable @name
+static double sim_var(const string& name) {
+	if (name.compare(0, strlen(THROTTLE_VAR_PREFIX), THROTTLE_VAR_PREFIX) == 0) {
+		int engine = atoi(name.c_str() + strlen(THROTTLE_VAR_PREFIX));
+		if (engine >= 1 && engine <= 2)
+			return throttle[engine - 1];
+	}
+	return 0;
+}
+
+static void send_pmdg_data() {
+	for (auto& req : client_data_requests)
+		if (req.second == PMDG_777X_DATA_ID)
+			send_data(SIMCONNECT_RECV_ID_CLIENT_DATA, req.first, PMDG_777X_DATA_DEFINITION, 1, &pmdg_data, sizeof(pmdg_data));
+}
+
+static void set_at_engaged(bool engaged) {
+	if (pmdg_data.MCP_annunAT == engaged)
+		return;
+	pmdg_data.MCP_annunAT = engaged;
+	send_pmdg_data();	// PMDG publishes its data area on every change
+}
+
+// answer the data requests due in this frame
+static void send_requested_data() {
+	for (auto& r : data_requests) {
+		DataRequest& req = r.second;
+
+		bool due = false;
+		switch (req.period) {
+			case SIMCONNECT_PERIOD_ONCE:			due = !req.sent; break;
+			case SIMCONNECT_PERIOD_VISUAL_FRAME:
+			case SIMCONNECT_PERIOD_SIM_FRAME:		due = true; break;
+			case SIMCONNECT_PERIOD_SECOND:			due = !req.sent || frame_count - req.last_frame >= frame_rate; break;
+			default:								break;
+		}
+		if (!due)
+			continue;
+
+		vector<double> values;
+		bool has_throttles = false;
+		for (const string& name : data_definitions[req.define_id]) {
+			values.push_back(sim_var(name));
+			has_throttles = has_throttles || name.compare(0, strlen(THROTTLE_VAR_PREFIX), THROTTLE_VAR_PREFIX) == 0;
+		}
+
+		if ((req.flags & SIMCONNECT_DATA_REQUEST_FLAG_CHANGED) && req.sent && values == req.last)
+			continue;
+
+		send_data(SIMCONNECT_RECV_ID_SIMOBJECT_DATA, r.first, req.define_id, (DWORD)values.size(),
+			values.data(), values.size() * sizeof(double));
+		req.last = values;
+		req.sent = true;
+		req.last_frame = frame_count;
+		if (req.period == SIMCONNECT_PERIOD_ONCE)
+			req.period = SIMCONNECT_PERIOD_NEVER;
+
+		if (has_throttles)
+			throttle_reports.push_back({ now_us(), { throttle[0], throttle[1] } });
+	}
+}
+
+static void run_step(const ScriptStep& step) {
+	LogV("FakeSimConnect: %llu ms: %s %s\n", step.time_ms, step.cmd.c_str(), step.arg.c_str());
+
+	if (step.cmd == "sim" || step.cmd == "pause") {
+		auto ev = system_events.find(step.cmd == "sim" ? "Sim" : "Pause");
+		if (ev != system_events.end())
+			send_event(SIMCONNECT_RECV_EVENT::UNKNOWN_GROUP, ev->second, (DWORD)atoi(step.arg.c_str()));
+	} else if (step.cmd == "aircraft") {
+		aircraft_path = step.arg;
+	} else if (step.cmd == "at") {
+		set_at_engaged(atoi(step.arg.c_str()) != 0);
+	} else if (step.cmd == "at_target") {
+		istringstream(step.arg) >> at_target[0] >> at_target[1];
+	} else if (step.cmd == "quit") {
+		SIMCONNECT_RECV_QUIT rec;
+		queue_record(&rec, sizeof(rec), SIMCONNECT_RECV_ID_QUIT);
+		sim_thread_quit = true;
+	} else {
+		Err("FakeSimConnect: unknown script step: %s\n", step.cmd.c_str());
+	}
+}
+
+// one sim frame
+static void frame() {
+	unsigned long long elapsed_ms = (now_us() - start_us) / 1000;
+	while (script_pos < script.size() && script[script_pos].time_ms <= elapsed_ms && !sim_thread_quit)
+		run_step(script[script_pos++]);
+
+	// the A/T slews the levers towards its targets
+	if (pmdg_data.MCP_annunAT) {
+		double step = AT_SLEW_RATE / frame_rate;
+		for (int i = 0; i < 2; i++) {
+			if (throttle[i] < at_target[i])
+				throttle[i] = throttle[i] + step < at_target[i] ? throttle[i] + step : at_target[i];
+			else if (throttle[i] > at_target[i])
+				throttle[i] = throttle[i] - step > at_target[i] ? throttle[i] - step : at_target[i];
+		}
+	}
+
+	send_requested_data();
+	frame_count++;
+	stats.frames++;
+}
+
+static void sim_thread_main() {
+	auto period = chrono::microseconds(1000000 / frame_rate);
+	auto next = chrono::steady_clock::now();
+
+	while (!sim_thread_quit) {
+		{
+			lock_guard<mutex> guard(session_lock);
+			frame();
+		}
+		next += period;
+		this_thread::sleep_until(next);
+	}
+}
+
+static bool load_script() {
+	string text = DEFAULT_SCRIPT;
+	if (!script_path.empty()) {
+		ifstream file(script_path);
+		if (!file) {
+			Err("FakeSimConnect: cannot open script %s\n", script_path.c_str());
+			return false;
+		}
+		stringstream ss;
+		ss << file.rdbuf();
+		text = ss.str();
+	}
+
+	script.clear();
+	script_pos = 0;
+
+	istringstream lines(text);
+	string line;
+	while (getline(lines, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		ScriptStep step;
+		istringstream fields(line);
+		if (!(fields >> step.time_ms >> step.cmd))
+			continue;
+		getline(fields >> ws, step.arg);
+		script.push_back(step);
+	}
+	return true;
+}
+
+/* test controls */
+
+void fake_sc_set_script(const char* path) {
+	lock_guard<mutex> guard(session_lock);
+	script_path = path ? path : "";
+}
+
+void fake_sc_set_frame_rate(unsigned int hz) {
+	lock_guard<mutex> guard(session_lock);
+	frame_rate = hz ? hz : 1;
+}
+
+void fake_sc_get_stats(FakeSimConnectStats& out) {
+	lock_guard<mutex> guard(session_lock);
+	out = stats;
+}
+
+void fake_sc_get_throttle_writes(vector<FakeThrottleRecord>& records) {
+	lock_guard<mutex> guard(session_lock);
+	records = throttle_writes;
+}
+
+void fake_sc_get_throttle_reports(vector<FakeThrottleRecord>& records) {
+	lock_guard<mutex> guard(session_lock);
+	records = throttle_reports;
+}
+
+/* SimConnect API */
+
+SIMCONNECTAPI SimConnect_Open(HANDLE* phSimConnect, LPCSTR szName, HWND hWnd, DWORD UserEventWin32, notifier_t hEventHandle, DWORD ConfigIndex) {
+	lock_guard<mutex> guard(session_lock);
+	if (session_open || !load_script())
+		return E_FAIL;
+
+	inbox.clear();
+	data_definitions.clear();
+	data_requests.clear();
+	client_data_requests.clear();
+	client_event_names.clear();
+	notification_groups.clear();
+	system_events.clear();
+
+	throttle[0] = throttle[1] = 0;
+	at_target[0] = at_target[1] = 0;
+	aircraft_path.clear();
+	memset(&pmdg_data, 0, sizeof(pmdg_data));
+	frame_count = 0;
+	stats = FakeSimConnectStats();
+	throttle_writes.clear();
+	throttle_reports.clear();
+
+	client_event = hEventHandle;
+	session_open = true;
+	start_us = now_us();
+	sim_thread_quit = false;
+	sim_thread = thread(sim_thread_main);
+
+	Log("FakeSimConnect: %s connected; %zu script steps at %u frames/s\n", szName, script.size(), frame_rate);
+	*phSimConnect = FAKE_SIMCONNECT_HANDLE;
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_Close(HANDLE hSimConnect) {
+	sim_thread_quit = true;
+	if (sim_thread.joinable())
+		sim_thread.join();
+
+	lock_guard<mutex> guard(session_lock);
+	session_open = false;
+	client_event = NOTIFIER_INVALID;
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_GetNextDispatch(HANDLE hSimConnect, SIMCONNECT_RECV** ppData, DWORD* pcbData) {
+	lock_guard<mutex> guard(session_lock);
+	if (inbox.empty())
+		return E_FAIL;
+
+	dispatching.swap(inbox.front());
+	inbox.pop_front();
+	stats.dispatched++;
+
+	*ppData = (SIMCONNECT_RECV*)dispatching.data();
+	*pcbData = (DWORD)dispatching.size();
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_CallDispatch(HANDLE hSimConnect, DispatchProc pfcnDispatch, void* pContext) {
+	SIMCONNECT_RECV* pData;
+	DWORD cbData;
+
+	while (SUCCEEDED(SimConnect_GetNextDispatch(hSimConnect, &pData, &cbData)))
+		pfcnDispatch(pData, cbData, pContext);
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_AddToDataDefinition(HANDLE hSimConnect, SIMCONNECT_DATA_DEFINITION_ID DefineID, const char* DatumName, const char* UnitsName, SIMCONNECT_DATATYPE DatumType, float fEpsilon, DWORD DatumID) {
+	lock_guard<mutex> guard(session_lock);
+	if (DatumType != SIMCONNECT_DATATYPE_FLOAT64) {
+		send_exception(SIMCONNECT_EXCEPTION_ERROR);	// only doubles are modeled
+		return S_OK;
+	}
+	data_definitions[DefineID].push_back(DatumName);
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_RequestDataOnSimObject(HANDLE hSimConnect, SIMCONNECT_DATA_REQUEST_ID RequestID, SIMCONNECT_DATA_DEFINITION_ID DefineID, SIMCONNECT_OBJECT_ID ObjectID, SIMCONNECT_PERIOD Period, SIMCONNECT_DATA_REQUEST_FLAG Flags, DWORD origin, DWORD interval, DWORD limit) {
+	lock_guard<mutex> guard(session_lock);
+	if (data_definitions.find(DefineID) == data_definitions.end()) {
+		send_exception(SIMCONNECT_EXCEPTION_UNRECOGNIZED_ID);
+		return S_OK;
+	}
+	data_requests[RequestID] = { DefineID, Period, Flags, {}, false, 0 };
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_SetDataOnSimObject(HANDLE hSimConnect, SIMCONNECT_DATA_DEFINITION_ID DefineID, SIMCONNECT_OBJECT_ID ObjectID, SIMCONNECT_DATA_SET_FLAG Flags, DWORD ArrayCount, DWORD cbUnitSize, void* pDataSet) {
+	unsigned long long time_us = now_us();
+	lock_guard<mutex> guard(session_lock);
+	stats.set_data++;
+
+	auto def = data_definitions.find(DefineID);
+	if (def == data_definitions.end()) {
+		send_exception(SIMCONNECT_EXCEPTION_UNRECOGNIZED_ID);
+		return S_OK;
+	}
+	if (cbUnitSize != def->second.size() * sizeof(double)) {
+		send_exception(SIMCONNECT_EXCEPTION_SIZE_MISMATCH);
+		return S_OK;
+	}
+
+	const double* values = (const double*)pDataSet;
+	for (size_t i = 0; i < def->second.size(); i++) {
+		const string& name = def->second[i];
+		if (name.compare(0, strlen(THROTTLE_VAR_PREFIX), THROTTLE_VAR_PREFIX) == 0) {
+			int engine = atoi(name.c_str() + strlen(THROTTLE_VAR_PREFIX));
+			if (engine >= 1 && engine <= 2)
+				throttle[engine - 1] = values[i];
+		}
+	}
+	throttle_writes.push_back({ time_us, { throttle[0], throttle[1] } });
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_SubscribeToSystemEvent(HANDLE hSimConnect, SIMCONNECT_CLIENT_EVENT_ID EventID, const char* SystemEventName) {
+	lock_guard<mutex> guard(session_lock);
+	system_events[SystemEventName] = EventID;
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_RequestSystemState(HANDLE hSimConnect, SIMCONNECT_DATA_REQUEST_ID RequestID, const char* szState) {
+	lock_guard<mutex> guard(session_lock);
+	if (strcmp(szState, "AircraftLoaded") != 0) {
+		send_exception(SIMCONNECT_EXCEPTION_NAME_UNRECOGNIZED);
+		return S_OK;
+	}
+
+	SIMCONNECT_RECV_SYSTEM_STATE rec;
+	rec.dwRequestID = RequestID;
+	rec.dwInteger = 0;
+	rec.fFloat = 0;
+	snprintf(rec.szString, sizeof(rec.szString), "%s", aircraft_path.c_str());
+	queue_record(&rec, sizeof(rec), SIMCONNECT_RECV_ID_SYSTEM_STATE);
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_MapClientDataNameToID(HANDLE hSimConnect, const char* szClientDataName, SIMCONNECT_CLIENT_DATA_ID ClientDataID) {
+	lock_guard<mutex> guard(session_lock);
+	if (strcmp(szClientDataName, PMDG_777X_DATA_NAME) != 0 || ClientDataID != PMDG_777X_DATA_ID)
+		send_exception(SIMCONNECT_EXCEPTION_NAME_UNRECOGNIZED);	// only the PMDG data area is modeled
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_AddToClientDataDefinition(HANDLE hSimConnect, SIMCONNECT_CLIENT_DATA_DEFINITION_ID DefineID, DWORD dwOffset, DWORD dwSizeOrType, float fEpsilon, DWORD DatumID) {
+	return S_OK;	// the whole PMDG_777X_Data area is always sent
+}
+
+SIMCONNECTAPI SimConnect_RequestClientData(HANDLE hSimConnect, SIMCONNECT_CLIENT_DATA_ID ClientDataID, SIMCONNECT_DATA_REQUEST_ID RequestID, SIMCONNECT_CLIENT_DATA_DEFINITION_ID DefineID, SIMCONNECT_CLIENT_DATA_PERIOD Period, SIMCONNECT_CLIENT_DATA_REQUEST_FLAG Flags, DWORD origin, DWORD interval, DWORD limit) {
+	lock_guard<mutex> guard(session_lock);
+	if (Period == SIMCONNECT_CLIENT_DATA_PERIOD_NEVER) {
+		client_data_requests.erase(RequestID);
+		return S_OK;
+	}
+	client_data_requests[RequestID] = ClientDataID;
+	if (ClientDataID == PMDG_777X_DATA_ID)
+		send_data(SIMCONNECT_RECV_ID_CLIENT_DATA, RequestID, DefineID, 1, &pmdg_data, sizeof(pmdg_data));
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_MapClientEventToSimEvent(HANDLE hSimConnect, SIMCONNECT_CLIENT_EVENT_ID EventID, const char* EventName) {
+	lock_guard<mutex> guard(session_lock);
+	client_event_names[EventID] = EventName;
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_AddClientEventToNotificationGroup(HANDLE hSimConnect, SIMCONNECT_NOTIFICATION_GROUP_ID GroupID, SIMCONNECT_CLIENT_EVENT_ID EventID, BOOL bMaskable) {
+	lock_guard<mutex> guard(session_lock);
+	notification_groups[EventID] = GroupID;
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_SetNotificationGroupPriority(HANDLE hSimConnect, SIMCONNECT_NOTIFICATION_GROUP_ID GroupID, DWORD uPriority) {
+	return S_OK;
+}
+
+SIMCONNECTAPI SimConnect_TransmitClientEvent(HANDLE hSimConnect, SIMCONNECT_OBJECT_ID ObjectID, SIMCONNECT_CLIENT_EVENT_ID EventID, DWORD dwData, SIMCONNECT_NOTIFICATION_GROUP_ID GroupID, SIMCONNECT_EVENT_FLAG Flags) {
+	lock_guard<mutex> guard(session_lock);
+	stats.client_events++;
+
+	auto name = client_event_names.find(EventID);
+	if (name == client_event_names.end()) {
+		send_exception(SIMCONNECT_EXCEPTION_UNRECOGNIZED_ID);
+		return S_OK;
+	}
+
+	// the PMDG A/T reacts to TO/GA and to a click on either A/T disengage switch
+	if (name->second == "AUTO_THROTTLE_TO_GA")
+		set_at_engaged(true);
+	else if ((name->second == "#70134" || name->second == "#70138") && dwData == MOUSE_FLAG_LEFTSINGLE)
+		set_at_engaged(false);
+
+	notify_event(EventID, dwData);	// subscribers see the event, the sender included
+	return S_OK;
+}
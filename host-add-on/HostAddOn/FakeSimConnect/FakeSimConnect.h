@@ -0,0 +1,46 @@
+#pragma once
+
+// Test controls and measurements of the fake SimConnect server (see FakeSimConnect.cpp)
+
+#include <vector>
+
+/*
+ * Scenario script, one step per line; blank lines and '#' comments are ignored:
+ *     <time_ms> sim <0|1>				Sim system event (start/stop)
+ *     <time_ms> pause <0|1>			Pause system event
+ *     <time_ms> aircraft <path>		aircraft reported for the AircraftLoaded system state
+ *     <time_ms> at <0|1>				A/T engaged/disengaged from the MCP (PMDG MCP_annunAT)
+ *     <time_ms> at_target <t1> <t2>	throttle levels the A/T drives to, percent
+ *     <time_ms> quit					sim exits; the client receives SIMCONNECT_RECV_ID_QUIT
+ * <time_ms> counts from SimConnect_Open().
+ */
+
+// run the script in file @path on the next SimConnect_Open(); NULL selects the built-in scenario
+void fake_sc_set_script(const char* path);
+
+// sim frames per second (default 60)
+void fake_sc_set_frame_rate(unsigned int hz);
+
+struct FakeSimConnectStats {
+	unsigned long long frames = 0;		// sim frames simulated
+	unsigned long long messages = 0;	// messages queued to the client
+	unsigned long long dispatched = 0;	// messages taken by the client
+	unsigned long long set_data = 0;	// SimConnect_SetDataOnSimObject() calls
+	unsigned long long client_events = 0;	// SimConnect_TransmitClientEvent() calls
+	unsigned long long exceptions = 0;	// SIMCONNECT_RECV_ID_EXCEPTION sent
+};
+
+/* both throttle levers at one instant; @time_us is on the steady clock, like shared_clock_us() */
+struct FakeThrottleRecord {
+	unsigned long long time_us;
+	double throttle_level[2];
+};
+
+// copy out the counters
+void fake_sc_get_stats(FakeSimConnectStats& stats);
+
+// every throttle write received from the client (SimConnect_SetDataOnSimObject)
+void fake_sc_get_throttle_writes(std::vector<FakeThrottleRecord>& records);
+
+// every throttle report sent to the client (SIMCONNECT_RECV_ID_SIMOBJECT_DATA)
+void fake_sc_get_throttle_reports(std::vector<FakeThrottleRecord>& records);
@@ -0,0 +1,206 @@
+#pragma once
+
+// Local stand-in for the Prepar3D SimConnect client library.
+// Declares the subset of inc/SimConnect/SimConnect.h used by ThrottleControl.cpp, with the same
+// names and record layouts, so SCThread builds and runs against FakeSimConnect.cpp on Linux.
+// Put this directory in front of the include path instead of inc/SimConnect.
+
+#include "Notifier.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <stdint.h>
+typedef uint32_t DWORD;		// 32 bits, as on Windows, so record layouts match
+typedef int32_t HRESULT;
+typedef int BOOL;
+typedef void* HANDLE;
+typedef void* HWND;
+typedef const char* LPCSTR;
+
+#define CALLBACK
+#define __stdcall
+#define S_OK		((HRESULT)0)
+#define E_FAIL		((HRESULT)0x80004005)
+#define SUCCEEDED(hr)	(((HRESULT)(hr)) >= 0)
+#define FAILED(hr)		(((HRESULT)(hr)) < 0)
+#define MAX_PATH	260
+#ifndef FALSE
+#define FALSE		0
+#define TRUE		1
+#endif
+#endif	// _WIN32
+
+#ifndef DWORD_MAX
+#define DWORD_MAX 0xFFFFFFFF
+#endif
+
+typedef DWORD SIMCONNECT_OBJECT_ID;
+
+static const DWORD SIMCONNECT_UNUSED           = DWORD_MAX;   // special value to indicate unused event, ID
+static const DWORD SIMCONNECT_OBJECT_ID_USER   = 0;           // proxy value for User vehicle ObjectID
+
+// Notification Group priority values
+static const DWORD SIMCONNECT_GROUP_PRIORITY_HIGHEST              =          1;      // highest priority
+static const DWORD SIMCONNECT_GROUP_PRIORITY_STANDARD             = 1900000000;      // standard priority
+static const DWORD SIMCONNECT_GROUP_PRIORITY_DEFAULT              = 2000000000;      // default priority
+
+// Receive data types
+enum SIMCONNECT_RECV_ID {
+    SIMCONNECT_RECV_ID_NULL,
+    SIMCONNECT_RECV_ID_EXCEPTION,
+    SIMCONNECT_RECV_ID_OPEN,
+    SIMCONNECT_RECV_ID_QUIT,
+    SIMCONNECT_RECV_ID_EVENT,
+    SIMCONNECT_RECV_ID_EVENT_OBJECT_ADDREMOVE,
+    SIMCONNECT_RECV_ID_EVENT_FILENAME,
+    SIMCONNECT_RECV_ID_EVENT_FRAME,
+    SIMCONNECT_RECV_ID_SIMOBJECT_DATA,
+    SIMCONNECT_RECV_ID_SIMOBJECT_DATA_BYTYPE,
+    SIMCONNECT_RECV_ID_WEATHER_OBSERVATION,
+    SIMCONNECT_RECV_ID_CLOUD_STATE,
+    SIMCONNECT_RECV_ID_ASSIGNED_OBJECT_ID,
+    SIMCONNECT_RECV_ID_RESERVED_KEY,
+    SIMCONNECT_RECV_ID_CUSTOM_ACTION,
+    SIMCONNECT_RECV_ID_SYSTEM_STATE,
+    SIMCONNECT_RECV_ID_CLIENT_DATA,
+};
+
+// Data data types
+enum SIMCONNECT_DATATYPE {
+    SIMCONNECT_DATATYPE_INVALID,        // invalid data type
+    SIMCONNECT_DATATYPE_INT32,          // 32-bit integer number
+    SIMCONNECT_DATATYPE_INT64,          // 64-bit integer number
+    SIMCONNECT_DATATYPE_FLOAT32,        // 32-bit floating-point number (float)
+    SIMCONNECT_DATATYPE_FLOAT64,        // 64-bit floating-point number (double)
+};
+
+// Exception error types
+enum SIMCONNECT_EXCEPTION {
+    SIMCONNECT_EXCEPTION_NONE,
+
+    SIMCONNECT_EXCEPTION_ERROR,
+    SIMCONNECT_EXCEPTION_SIZE_MISMATCH,
+    SIMCONNECT_EXCEPTION_UNRECOGNIZED_ID,
+    SIMCONNECT_EXCEPTION_UNOPENED,
+    SIMCONNECT_EXCEPTION_VERSION_MISMATCH,
+    SIMCONNECT_EXCEPTION_TOO_MANY_GROUPS,
+    SIMCONNECT_EXCEPTION_NAME_UNRECOGNIZED,
+};
+
+// Object Data Request Period values
+enum SIMCONNECT_PERIOD {
+    SIMCONNECT_PERIOD_NEVER,
+    SIMCONNECT_PERIOD_ONCE,
+    SIMCONNECT_PERIOD_VISUAL_FRAME,
+    SIMCONNECT_PERIOD_SIM_FRAME,
+    SIMCONNECT_PERIOD_SECOND,
+};
+
+// ClientData Request Period values
+enum SIMCONNECT_CLIENT_DATA_PERIOD {
+    SIMCONNECT_CLIENT_DATA_PERIOD_NEVER,
+    SIMCONNECT_CLIENT_DATA_PERIOD_ONCE,
+    SIMCONNECT_CLIENT_DATA_PERIOD_VISUAL_FRAME,
+    SIMCONNECT_CLIENT_DATA_PERIOD_ON_SET,
+    SIMCONNECT_CLIENT_DATA_PERIOD_SECOND,
+};
+
+typedef DWORD SIMCONNECT_EVENT_FLAG;
+    static const DWORD SIMCONNECT_EVENT_FLAG_DEFAULT                  = 0x00000000;
+    static const DWORD SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY      = 0x00000010;      // interpret GroupID parameter as priority value
+
+typedef DWORD SIMCONNECT_DATA_REQUEST_FLAG;
+    static const DWORD SIMCONNECT_DATA_REQUEST_FLAG_DEFAULT           = 0x00000000;
+    static const DWORD SIMCONNECT_DATA_REQUEST_FLAG_CHANGED           = 0x00000001;      // send requested data when value(s) change
+
+typedef DWORD SIMCONNECT_DATA_SET_FLAG;
+    static const DWORD SIMCONNECT_DATA_SET_FLAG_DEFAULT               = 0x00000000;
+
+typedef DWORD SIMCONNECT_CLIENT_DATA_REQUEST_FLAG;
+    static const DWORD SIMCONNECT_CLIENT_DATA_REQUEST_FLAG_DEFAULT    = 0x00000000;
+    static const DWORD SIMCONNECT_CLIENT_DATA_REQUEST_FLAG_CHANGED    = 0x00000001;      // send requested ClientData when value(s) change
+
+typedef DWORD SIMCONNECT_NOTIFICATION_GROUP_ID;     //client-defined notification group ID
+typedef DWORD SIMCONNECT_DATA_DEFINITION_ID;        //client-defined data definition ID
+typedef DWORD SIMCONNECT_DATA_REQUEST_ID;           //client-defined request data ID
+typedef DWORD SIMCONNECT_CLIENT_EVENT_ID;           //client-defined client event ID
+typedef DWORD SIMCONNECT_CLIENT_DATA_ID;            //client-defined client data ID
+typedef DWORD SIMCONNECT_CLIENT_DATA_DEFINITION_ID; //client-defined client data definition ID
+
+#pragma pack(push, 1)
+
+struct SIMCONNECT_RECV
+{
+    DWORD   dwSize;         // record size
+    DWORD   dwVersion;      // interface version
+    DWORD   dwID;           // see SIMCONNECT_RECV_ID
+};
+
+struct SIMCONNECT_RECV_EXCEPTION : public SIMCONNECT_RECV   // when dwID == SIMCONNECT_RECV_ID_EXCEPTION
+{
+    DWORD   dwException;    // see SIMCONNECT_EXCEPTION
+    static const DWORD UNKNOWN_SENDID = 0;
+    DWORD   dwSendID;       // see SimConnect_GetLastSentPacketID
+    static const DWORD UNKNOWN_INDEX = DWORD_MAX;
+    DWORD   dwIndex;        // index of parameter that was source of error
+};
+
+struct SIMCONNECT_RECV_QUIT : public SIMCONNECT_RECV   // when dwID == SIMCONNECT_RECV_ID_QUIT
+{
+};
+
+struct SIMCONNECT_RECV_EVENT : public SIMCONNECT_RECV       // when dwID == SIMCONNECT_RECV_ID_EVENT
+{
+    static const DWORD UNKNOWN_GROUP = DWORD_MAX;
+    DWORD   uGroupID;
+    DWORD   uEventID;
+    DWORD   dwData;       // uEventID-dependent context
+};
+
+struct SIMCONNECT_RECV_SIMOBJECT_DATA : public SIMCONNECT_RECV           // when dwID == SIMCONNECT_RECV_ID_SIMOBJECT_DATA
+{
+    DWORD   dwRequestID;
+    DWORD   dwObjectID;
+    DWORD   dwDefineID;
+    DWORD   dwFlags;            // SIMCONNECT_DATA_REQUEST_FLAG
+    DWORD   dwentrynumber;      // if multiple objects returned, this is number <entrynumber> out of <outof>.
+    DWORD   dwoutof;            // note: starts with 1, not 0.
+    DWORD   dwDefineCount;      // data count (number of datums, *not* byte count)
+    DWORD   dwData;             // data begins here, dwDefineCount data items
+};
+
+struct SIMCONNECT_RECV_CLIENT_DATA : public SIMCONNECT_RECV_SIMOBJECT_DATA    // when dwID == SIMCONNECT_RECV_ID_CLIENT_DATA
+{
+};
+
+struct SIMCONNECT_RECV_SYSTEM_STATE : public SIMCONNECT_RECV // when dwID == SIMCONNECT_RECV_ID_SYSTEM_STATE
+{
+    DWORD   dwRequestID;
+    DWORD   dwInteger;
+    float   fFloat;
+    char    szString[MAX_PATH];
+};
+
+#pragma pack(pop)
+
+#define SIMCONNECTAPI extern "C" HRESULT __stdcall
+
+typedef void (CALLBACK *DispatchProc)(SIMCONNECT_RECV* pData, DWORD cbData, void* pContext);
+
+SIMCONNECTAPI SimConnect_MapClientEventToSimEvent(HANDLE hSimConnect, SIMCONNECT_CLIENT_EVENT_ID EventID, const char * EventName = "");
+SIMCONNECTAPI SimConnect_TransmitClientEvent(HANDLE hSimConnect, SIMCONNECT_OBJECT_ID ObjectID, SIMCONNECT_CLIENT_EVENT_ID EventID, DWORD dwData, SIMCONNECT_NOTIFICATION_GROUP_ID GroupID, SIMCONNECT_EVENT_FLAG Flags);
+SIMCONNECTAPI SimConnect_AddClientEventToNotificationGroup(HANDLE hSimConnect, SIMCONNECT_NOTIFICATION_GROUP_ID GroupID, SIMCONNECT_CLIENT_EVENT_ID EventID, BOOL bMaskable = FALSE);
+SIMCONNECTAPI SimConnect_SetNotificationGroupPriority(HANDLE hSimConnect, SIMCONNECT_NOTIFICATION_GROUP_ID GroupID, DWORD uPriority);
+SIMCONNECTAPI SimConnect_AddToDataDefinition(HANDLE hSimConnect, SIMCONNECT_DATA_DEFINITION_ID DefineID, const char * DatumName, const char * UnitsName, SIMCONNECT_DATATYPE DatumType = SIMCONNECT_DATATYPE_FLOAT64, float fEpsilon = 0, DWORD DatumID = SIMCONNECT_UNUSED);
+SIMCONNECTAPI SimConnect_RequestDataOnSimObject(HANDLE hSimConnect, SIMCONNECT_DATA_REQUEST_ID RequestID, SIMCONNECT_DATA_DEFINITION_ID DefineID, SIMCONNECT_OBJECT_ID ObjectID, SIMCONNECT_PERIOD Period, SIMCONNECT_DATA_REQUEST_FLAG Flags = 0, DWORD origin = 0, DWORD interval = 0, DWORD limit = 0);
+SIMCONNECTAPI SimConnect_SetDataOnSimObject(HANDLE hSimConnect, SIMCONNECT_DATA_DEFINITION_ID DefineID, SIMCONNECT_OBJECT_ID ObjectID, SIMCONNECT_DATA_SET_FLAG Flags, DWORD ArrayCount, DWORD cbUnitSize, void * pDataSet);
+SIMCONNECTAPI SimConnect_SubscribeToSystemEvent(HANDLE hSimConnect, SIMCONNECT_CLIENT_EVENT_ID EventID, const char * SystemEventName);
+SIMCONNECTAPI SimConnect_Open(HANDLE * phSimConnect, LPCSTR szName, HWND hWnd, DWORD UserEventWin32, notifier_t hEventHandle, DWORD ConfigIndex);
+SIMCONNECTAPI SimConnect_Close(HANDLE hSimConnect);
+SIMCONNECTAPI SimConnect_CallDispatch(HANDLE hSimConnect, DispatchProc pfcnDispatch, void * pContext);
+SIMCONNECTAPI SimConnect_GetNextDispatch(HANDLE hSimConnect, SIMCONNECT_RECV ** ppData, DWORD * pcbData);
+SIMCONNECTAPI SimConnect_RequestSystemState(HANDLE hSimConnect, SIMCONNECT_DATA_REQUEST_ID RequestID, const char * szState);
+SIMCONNECTAPI SimConnect_MapClientDataNameToID(HANDLE hSimConnect, const char * szClientDataName, SIMCONNECT_CLIENT_DATA_ID ClientDataID);
+SIMCONNECTAPI SimConnect_AddToClientDataDefinition(HANDLE hSimConnect, SIMCONNECT_CLIENT_DATA_DEFINITION_ID DefineID, DWORD dwOffset, DWORD dwSizeOrType, float fEpsilon = 0, DWORD DatumID = SIMCONNECT_UNUSED);
+SIMCONNECTAPI SimConnect_RequestClientData(HANDLE hSimConnect, SIMCONNECT_CLIENT_DATA_ID ClientDataID, SIMCONNECT_DATA_REQUEST_ID RequestID, SIMCONNECT_CLIENT_DATA_DEFINITION_ID DefineID, SIMCONNECT_CLIENT_DATA_PERIOD Period = SIMCONNECT_CLIENT_DATA_PERIOD_ONCE, SIMCONNECT_CLIENT_DATA_REQUEST_FLAG Flags = 0, DWORD origin = 0, DWORD interval = 0, DWORD limit = 0);
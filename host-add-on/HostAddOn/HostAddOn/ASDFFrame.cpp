@@ -0,0 +1,160 @@
+// ASDF v2 framing
+
+#include "ASDFFrame.h"
+#include <string.h>
+
+unsigned char asdf_crc8_update(unsigned char crc, unsigned char b) {
+	crc ^= b;
+	for (int bit = 0; bit < 8; bit++)
+		crc = (crc & 0x80) ? (unsigned char)((crc << 1) ^ 0x07) : (unsigned char)(crc << 1);
+	return crc;
+}
+
+unsigned char asdf_crc8(const unsigned char* buf, unsigned int size) {
+	unsigned char crc = 0;
+	for (unsigned int i = 0; i < size; i++)
+		crc = asdf_crc8_update(crc, buf[i]);
+	return crc;
+}
+
+unsigned int asdf_frame_encode(const ASDFFrame& frame, unsigned char* buf) {
+	if (frame.data_size > ASDF_FRAME_MAX_DATA)
+		return 0;
+
+	unsigned int size = 0;
+	buf[size++] = ASDF_FRAME_SYNC;
+	buf[size++] = (unsigned char)frame.data_size;
+	buf[size++] = frame.seq;
+	buf[size++] = frame.code;
+	for (unsigned int i = 0; i < frame.data_size; i++)
+		buf[size++] = frame.data[i];
+	buf[size] = asdf_crc8(buf + 1, size - 1);
+	return size + 1;
+}
+
+void asdf_frame_parser_reset(ASDFFrameParser& parser) {
+	parser.size = 0;
+	parser.bad_frames = 0;
+	parser.skipped_bytes = 0;
+}
+
+// drop the first @n buffered bytes
+static void parser_drop(ASDFFrameParser& parser, unsigned int n) {
+	memmove(parser.buf, parser.buf + n, parser.size - n);
+	parser.size -= n;
+}
+
+void asdf_frame_push(ASDFFrameParser& parser, const unsigned char* bytes, unsigned int size) {
+	for (unsigned int i = 0; i < size; i++) {
+		if (parser.size == sizeof(parser.buf)) {
+			parser_drop(parser, 1);
+			parser.skipped_bytes++;
+		}
+		parser.buf[parser.size++] = bytes[i];
+	}
+}
+
+bool asdf_frame_next(ASDFFrameParser& parser, ASDFFrame& frame) {
+	while (parser.size > 0) {
+		// hunt for a sync byte
+		unsigned int skip = 0;
+		while (skip < parser.size && parser.buf[skip] != ASDF_FRAME_SYNC)
+			skip++;
+		if (skip != 0) {
+			parser_drop(parser, skip);
+			parser.skipped_bytes += skip;
+			continue;
+		}
+
+		if (parser.size < 2)
+			return false;
+		unsigned int data_size = parser.buf[1];
+		if (data_size > ASDF_FRAME_MAX_DATA) {
+			// not a frame; the sync byte was data or noise
+			parser_drop(parser, 1);
+			parser.bad_frames++;
+			continue;
+		}
+
+		unsigned int frame_size = ASDF_FRAME_SIZE(data_size);
+		if (parser.size < frame_size)
+			return false;
+		if (asdf_crc8(parser.buf + 1, frame_size - 2) != parser.buf[frame_size - 1]) {
+			// rescan from the byte after this sync; a real frame may start inside the bad one
+			parser_drop(parser, 1);
+			parser.bad_frames++;
+			continue;
+		}
+
+		frame.seq = parser.buf[2];
+		frame.code = parser.buf[3];
+		frame.data_size = data_size;
+		memcpy(frame.data, parser.buf + 4, data_size);
+		parser_drop(parser, frame_size);
+		return true;
+	}
+
+	return false;
+}
+
+void asdf_frame_decoder_reset(ASDFFrameDecoder& decoder) {
+	decoder.state = ASDF_DECODE_SYNC;
+	decoder.bad_frames = 0;
+	decoder.skipped_bytes = 0;
+}
+
+bool asdf_frame_decode(ASDFFrameDecoder& decoder, unsigned char b, ASDFFrame& frame) {
+	switch (decoder.state) {
+		case ASDF_DECODE_SYNC:
+			if (b == ASDF_FRAME_SYNC)
+				decoder.state = ASDF_DECODE_LEN;
+			else
+				decoder.skipped_bytes++;
+			return false;
+
+		case ASDF_DECODE_LEN:
+			if (b > ASDF_FRAME_MAX_DATA) {
+				// not a frame; a sync byte here may start the real one
+				decoder.bad_frames++;
+				decoder.state = b == ASDF_FRAME_SYNC ? ASDF_DECODE_LEN : ASDF_DECODE_SYNC;
+				return false;
+			}
+			decoder.frame.data_size = b;
+			decoder.received = 0;
+			decoder.crc = asdf_crc8_update(0, b);
+			decoder.state = ASDF_DECODE_SEQ;
+			return false;
+
+		case ASDF_DECODE_SEQ:
+			decoder.frame.seq = b;
+			decoder.crc = asdf_crc8_update(decoder.crc, b);
+			decoder.state = ASDF_DECODE_CODE;
+			return false;
+
+		case ASDF_DECODE_CODE:
+			decoder.frame.code = b;
+			decoder.crc = asdf_crc8_update(decoder.crc, b);
+			decoder.state = decoder.frame.data_size != 0 ? ASDF_DECODE_DATA : ASDF_DECODE_CRC;
+			return false;
+
+		case ASDF_DECODE_DATA:
+			decoder.frame.data[decoder.received++] = b;
+			decoder.crc = asdf_crc8_update(decoder.crc, b);
+			if (decoder.received == decoder.frame.data_size)
+				decoder.state = ASDF_DECODE_CRC;
+			return false;
+
+		case ASDF_DECODE_CRC:
+			if (b != decoder.crc) {
+				decoder.bad_frames++;
+				decoder.state = b == ASDF_FRAME_SYNC ? ASDF_DECODE_LEN : ASDF_DECODE_SYNC;
+				return false;
+			}
+			frame = decoder.frame;
+			decoder.state = ASDF_DECODE_SYNC;
+			return true;
+	}
+
+	decoder.state = ASDF_DECODE_SYNC;
+	return false;
+}
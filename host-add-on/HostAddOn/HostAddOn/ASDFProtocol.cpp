@@ -1,183 +1,443 @@
 // ASDF Protocol over Serial Communication with Arduino
 
 #include "ASDFProtocol.h"
-#include <windows.h>
+#include "SharedStruct.h"
 #include <stdio.h>
 #include <string>
-#define VERBOSE
 #include "debug.h"
 
-// Serial session handler
-static HANDLE Serial;
-static DCB dcb;
-static bool Serial_Initialized = false;
+// sequence number of the next command sent
+static unsigned char next_seq = 0;
 
-// initialize serial connection
-int asdf_init_serial(const char* PORT_NAME = NULL, unsigned long BAUD_RATE = 0) {
-	// static fields to store port name and baud rate for reset
-	static char port_name[16] = { 0 };
-	static unsigned long baud_rate = { 0 };
+// lever data format the device is in, and the one cmd_reset() and recovery put it back in
+static unsigned char lever_mode = ASDF_MODE_7BIT;
+static unsigned char wanted_mode = ASDF_MODE_7BIT;
 
-	// init static fields if params are not NULL/0
-	if (PORT_NAME != NULL)
-		if (strncmp(port_name, PORT_NAME, sizeof(port_name)) != 0)
-			strcpy_s(port_name, PORT_NAME);
-	if (BAUD_RATE != 0)
-		if (baud_rate != BAUD_RATE)
-			baud_rate = BAUD_RATE;
-
-	Serial = CreateFileA(port_name,			// port name "\\\\.\\COM24"
-		GENERIC_READ | GENERIC_WRITE,		// Read/Write
-		0,									// No Sharing
-		NULL,								// No Security
-		OPEN_EXISTING,						// Open existing port only
-		0,									// Non Overlapped I/O
-		NULL);								// Null for Comm Devices
+// # of data bytes of ASDF_POLL_OK and ASDF_STREAM_REPORT in the current mode
+static unsigned int poll_data_size() {
+	return lever_mode == ASDF_MODE_12BIT ? ASDF_POLL_DATA_SIZE_12BIT : ASDF_POLL_DATA_SIZE;
+}
 
-	if (Serial == INVALID_HANDLE_VALUE) {
-		Err("Error in opening serial port\n");
-		return -1;
+// a lever report of @data_size bytes tells the mode the device is in, e.g. after it rebooted
+// or a previous session left it in another one; follow it. false if it is no report size
+static bool follow_report_size(unsigned int data_size) {
+	unsigned char mode;
+	if (data_size == ASDF_POLL_DATA_SIZE)
+		mode = ASDF_MODE_7BIT;
+	else if (data_size == ASDF_POLL_DATA_SIZE_12BIT)
+		mode = ASDF_MODE_12BIT;
+	else
+		return false;
+
+	if (mode != lever_mode) {
+		Log("Device reports in %s mode\n", mode == ASDF_MODE_12BIT ? "12-bit" : "7-bit");
+		lever_mode = mode;
 	}
+	return true;
+}
+
+// frames received from the device; a frame read ahead of its transaction waits in @held_frame
+static ASDFFrameParser rx_parser;
+static ASDFFrame held_frame;
+static bool frame_held = false;
+
+static const char* ERROR_NAMES[] = {
+	"ok",
+	"I/O error",
+	"timed out",
+	"cancelled",
+	"protocol error",
+	"invalid"
+};
+
+const char* asdf_error_name(asdf_error_t err) {
+	return ERROR_NAMES[-err];
+}
 
-	if (!GetCommState(Serial, &dcb)) {
-		Err("Get DCB Failed.\n");
-		return -1;
+// see asdf_link_stats()
+static unsigned long long link_lost = 0;
+static unsigned long long link_stale = 0;
+static unsigned long long recoveries[ASDF_RECOVERY_TIER_NUM] = { 0 };
+static unsigned long long recovery_max_us[ASDF_RECOVERY_TIER_NUM] = { 0 };
+
+ASDFLinkStats asdf_link_stats() {
+	ASDFLinkStats stats;
+	stats.bad_frames = rx_parser.bad_frames;
+	stats.skipped_bytes = rx_parser.skipped_bytes;
+	stats.lost = link_lost;
+	stats.stale = link_stale;
+	for (unsigned int i = 0; i < ASDF_RECOVERY_TIER_NUM; i++) {
+		stats.recoveries[i] = recoveries[i];
+		stats.recovery_max_us[i] = recovery_max_us[i];
 	}
+	return stats;
+}
+
+void asdf_link_print() {
+	ASDFLinkStats stats = asdf_link_stats();
+	printf("link: %llu bad frames, %llu bytes skipped, %llu lost, %llu stale\n",
+		stats.bad_frames, stats.skipped_bytes, stats.lost, stats.stale);
+
+	printf("recovery        count   max (us)\n");
+	for (unsigned int i = 0; i < ASDF_RECOVERY_TIER_NUM; i++)
+		printf("%-10s %10llu %10llu\n", asdf_recovery_tier_name((asdf_recovery_tier_t)i),
+			stats.recoveries[i], stats.recovery_max_us[i]);
+	fflush(stdout);
+}
 
-	dcb.BaudRate = baud_rate;
+// forget frames received but not yet read, e.g. when the device is reset
+static void asdf_rx_reset() {
+	rx_parser.size = 0;
+	frame_held = false;
+}
 
-	if (!SetCommState(Serial, &dcb)) {
-		Err("Set DCB Failed.\n");
-		return -1;
+// Send an ASDF packet to the device without capturing the return packet; @seq gets its sequence number
+static asdf_error_t asdf_send_no_recv(ASDFPacket& asdf_pkt, unsigned char* seq = NULL) {
+	if (!asdf_serial_initialized()) {
+		Err("Serial Port not initialized.\n");
+		return ASDF_ERR_IO;
 	}
+	if (asdf_cancelled())
+		return ASDF_ERR_CANCELLED;
 
-	Log("Open serial port successful\n");
-	Serial_Initialized = true;
+	ASDFFrame frame;
+	frame.seq = next_seq++;
+	frame.code = asdf_pkt.code & 0xFF;
+	frame.data_size = 0;
+	for (unsigned int i = 0; i < asdf_pkt.data_size && i < sizeof(asdf_pkt.data); i++)
+		frame.data[frame.data_size++] = asdf_pkt.data[i];
 
-	// wait for serial ready
-	Sleep(200);
+	unsigned char write_buf[ASDF_FRAME_MAX_SIZE];
+	unsigned int write_size = asdf_frame_encode(frame, write_buf);
 
-	return 0;
+	// send packet
+	unsigned long size_written = 0;
+	asdf_serial_write((void*)write_buf, write_size, &size_written);
+	if (size_written != write_size) {
+		if (asdf_cancelled())
+			return ASDF_ERR_CANCELLED;
+		Err("Serial Write size mismatch.\n");
+		return ASDF_ERR_IO;
+	}
+
+	if (seq != NULL)
+		*seq = frame.seq;
+	return ASDF_OK;
 }
 
-// close the serial port
-void asdf_close_serial() {
-	CloseHandle(Serial);		//Closing the Serial Port
-	Serial_Initialized = false;
-	Log("Close serial port successful\n");
+// deadline @timeout_ms from now, for asdf_read_frame()
+static unsigned long long deadline_after_ms(unsigned long timeout_ms) {
+	return shared_clock_us() + timeout_ms * 1000ULL;
 }
 
-// flush serial receive buffer
-int asdf_flush_receive_buffer() {
-	return PurgeComm(Serial, PURGE_RXCLEAR);
+// why asdf_read_frame() came back without a frame
+static asdf_error_t read_failed() {
+	return asdf_cancelled() ? ASDF_ERR_CANCELLED : ASDF_ERR_TIMEOUT;
 }
 
-// return # of bytes in the receive buffer
-unsigned int asdf_available() {
-	// Device Errors
-	DWORD commErrors;
-	// Device status
-	COMSTAT commStatus;
-	// Read status
-	ClearCommError(Serial, &commErrors, &commStatus);
-	// Return the number of pending bytes
-	return commStatus.cbInQue;
+// read the next valid frame from the device before shared_clock_us() reaches @deadline_us, or until cancelled;
+// reads go no further than the frame being received, SYNC and LEN first, so a frame shorter than the one
+// expected (e.g. ASDF_ERROR) is taken as soon as its last byte is in
+static bool asdf_read_any_frame(ASDFFrame& frame, unsigned long long deadline_us) {
+	if (frame_held) {
+		frame = held_frame;
+		frame_held = false;
+		return true;
+	}
+
+	while (!asdf_frame_next(rx_parser, frame)) {
+		unsigned long long now_us = shared_clock_us();
+		if (now_us >= deadline_us || asdf_cancelled())
+			return false;
+
+		// the parser holds nothing, a lone SYNC, or the start of the frame whose LEN it has
+		unsigned char read_buf[ASDF_FRAME_MAX_SIZE];
+		unsigned int read_size = rx_parser.size < 2 ? 2 - rx_parser.size : ASDF_FRAME_SIZE(rx_parser.buf[1]) - rx_parser.size;
+
+		unsigned long size_read = 0;
+		bool complete = asdf_serial_read(read_buf, read_size, &size_read, (unsigned long)((deadline_us - now_us + 999) / 1000)) != 0;
+		asdf_frame_push(rx_parser, read_buf, size_read);
+		if (!complete)
+			return asdf_frame_next(rx_parser, frame);	// timed out
+	}
+
+	return true;
 }
 
-// write to serial port
-int asdf_serial_write(void* buffer, unsigned int size, unsigned long* size_written) {
-	return WriteFile(Serial, buffer, size, size_written, NULL);
+// see asdf_pilot_override()
+static unsigned char pilot_levers = 0;
+static bool pilot_reported = false;
+
+// take an ASDF_LVR_RELS_PILOT notification in @frame; false if @frame is something else
+static bool take_pilot_override(const ASDFFrame& frame) {
+	if (frame.code != ASDF_LVR_RELS_PILOT || frame.data_size != 1)
+		return false;
+	if (!pilot_reported)
+		Log("Device reports pilot override: levers 0x%02X\n", frame.data[0]);
+	pilot_levers |= frame.data[0];
+	pilot_reported = true;
+	return true;
 }
 
-// read from serial port; block until get @size bytes; @size must be >0!!!
-int asdf_serial_read(void* buffer, unsigned int size, unsigned long* size_read) {
-	while (asdf_available() < size) {}	// hang over until have enough bytes to read
-	return ReadFile(Serial, buffer, size, size_read, NULL);
+// as asdf_read_any_frame(); pilot override notifications answer nothing and are taken on the way
+static bool asdf_read_frame(ASDFFrame& frame, unsigned long long deadline_us) {
+	while (asdf_read_any_frame(frame, deadline_us)) {
+		if (!take_pilot_override(frame))
+			return true;
+	}
+	return false;
 }
 
-// read all bytes remaining in the receive buffer
-int asdf_serial_read_remaining(void* buffer, unsigned int size, unsigned long* size_read) {
-	unsigned int truncated_size = asdf_available() >= size ? size: asdf_available();
-	return ReadFile(Serial, buffer, truncated_size, size_read, NULL);
+bool asdf_pilot_override(unsigned char* levers) {
+	if (!pilot_reported)
+		return false;
+	*levers = pilot_levers;
+	pilot_levers = 0;
+	pilot_reported = false;
+	return true;
 }
 
-// Send an ASDF packet to the device without capturing the return packet
-static int asdf_send_no_recv(ASDFPacket& asdf_pkt) {
-	if (!Serial_Initialized) {
-		Err("Serial Port not initialized.\n");
-		return -1;
+// read the response to the command sent as @seq before @deadline_us; @pkt_recvd holds the expected code and data size
+static asdf_error_t asdf_recv_response(unsigned char seq, ASDFPacket& pkt_recvd, unsigned long long deadline_us) {
+	// input sanity check
+	if (pkt_recvd.data_size > sizeof(pkt_recvd.data)) {
+		Err("expected receive size overflow: %d\n", pkt_recvd.data_size);
+		return ASDF_ERR_INVALID;
 	}
 
-	char write_buf[16];
-	unsigned int write_size = 0;
-
-	// set command code
-	write_buf[write_size++] = asdf_pkt.code & 0xFF;
+	ASDFFrame frame;
+	while (true) {
+		if (!asdf_read_frame(frame, deadline_us)) {
+			asdf_error_t err = read_failed();
+			if (err == ASDF_ERR_CANCELLED)
+				return err;
+			Err("No response to seq %u before its deadline\n", seq);
+			link_lost++;
+			return err;
+		}
+		if (frame.code == ASDF_STREAM_REPORT) {
+			link_stale++;	// left over from streaming
+			continue;
+		}
+		if (frame.seq == seq)
+			break;
 
-	// set data
-	for (unsigned int i = write_size; i < asdf_pkt.data_size && i < 16; i++)
-		write_buf[i] = asdf_pkt.data[i - write_size];
-	write_size += asdf_pkt.data_size;
+		if ((unsigned char)(frame.seq - seq) < 0x80) {
+			// answers a later command, so ours was lost; keep it for that one
+			Err("Response to seq %u lost: Received seq %u\n", seq, frame.seq);
+			held_frame = frame;
+			frame_held = true;
+			link_lost++;
+			return ASDF_ERR_TIMEOUT;
+		}
+
+		// answers a command given up on already
+		LogV("Dropping stale response: seq %u, code %u\n", frame.seq, frame.code);
+		link_stale++;
+	}
 
-	// send packet
-	unsigned long size_written = 0;
-	asdf_serial_write((void*)write_buf, write_size, &size_written);
-	if (size_written != write_size) {
-		Err("Serial Write size mismatch.\n");
-		return -1;
+	if (frame.code != pkt_recvd.code) {
+		Err("Received wrong response code: Expected: %u, Received: %u\n", pkt_recvd.code, frame.code);
+		return ASDF_ERR_PROTOCOL;
+	}
+	if (frame.data_size != pkt_recvd.data_size &&
+		!(frame.code == ASDF_POLL_OK && follow_report_size(frame.data_size))) {
+		Err("Response size mismatch: Expected: %u; Received: %u\n", pkt_recvd.data_size, frame.data_size);
+		return ASDF_ERR_PROTOCOL;
 	}
+	pkt_recvd.data_size = frame.data_size;
+
+	// parse packet
+	for (unsigned int i = 0; i < frame.data_size; i++)
+		pkt_recvd.data[i] = frame.data[i];
 
-	return 0;
+	return ASDF_OK;
 }
 
+// see asdf_last_sent_us()
+static unsigned long long last_sent_us = 0;
 
 // Send an ASDF packet to the device. Will return only when it gets a response from the device.
-int asdf_send(ASDFPacket& asdf_pkt, ASDFPacket& pkt_recvd) {
-	if (!Serial_Initialized) {
+asdf_error_t asdf_send(ASDFPacket& asdf_pkt, ASDFPacket& pkt_recvd, unsigned long timeout_ms) {
+	if (!asdf_serial_initialized()) {
 		Err("Serial Port not initialized.\n");
-		return -1;
+		return ASDF_ERR_IO;
 	}
-	
-	// input sanity check
-	if (pkt_recvd.data_size > 15) {
-		Err("expected receive size overflow: %d\n", pkt_recvd.data_size);
-		return -1;
+
+	// the response would be mixed up with stream reports
+	if (asdf_streaming()) {
+		Err("asdf_send while streaming\n");
+		return ASDF_ERR_INVALID;
+	}
+
+	// the response would be taken for the oldest pipelined one
+	if (asdf_outstanding() != 0) {
+		Err("asdf_send with %u pipelined transactions outstanding\n", asdf_outstanding());
+		return ASDF_ERR_INVALID;
 	}
 
 	// send packet
-	if (asdf_send_no_recv(asdf_pkt) != 0)
-		return -1;
+	unsigned char seq;
+	asdf_error_t err = asdf_send_no_recv(asdf_pkt, &seq);
+	if (err != ASDF_OK)
+		return err;
+	last_sent_us = shared_clock_us();
 
 	// read packet
-	unsigned char read_buf[16];
-	unsigned long size_read = 0;
-	asdf_serial_read((void*)read_buf, pkt_recvd.data_size + 1, &size_read);
-	if (size_read == 0) {
-		Err("Serial read size is 0.\n");
-		return -1;
+	return asdf_recv_response(seq, pkt_recvd, last_sent_us + timeout_ms * 1000ULL);
+}
+
+
+// ASDF Pipelined Transactions
+// Responses come back in command order, so outstanding transactions are kept in a FIFO ring.
+
+struct ASDFTransaction {
+	unsigned char cmd;		// command code sent
+	unsigned char seq;		// sequence number sent
+	ASDFPacket expected;	// expected response code and data size
+	unsigned long long sent_us;	// shared_clock_us() when the command was written
+	unsigned long long deadline_us;	// asdf_recv() gives up on the response after this
+};
+
+static ASDFTransaction pipeline[ASDF_MAX_PIPELINE_DEPTH];
+static unsigned int pipeline_head = 0;		// oldest outstanding transaction
+static unsigned int pipeline_count = 0;		// # of outstanding transactions
+static unsigned int pipeline_depth = 1;		// max # of transactions in flight
+
+void asdf_set_pipeline_depth(unsigned int depth) {
+	if (depth < 1)
+		depth = 1;
+	if (depth > ASDF_MAX_PIPELINE_DEPTH)
+		depth = ASDF_MAX_PIPELINE_DEPTH;
+	pipeline_depth = depth;
+}
+
+unsigned int asdf_pipeline_depth() {
+	return pipeline_depth;
+}
+
+unsigned int asdf_outstanding() {
+	return pipeline_count;
+}
+
+void asdf_pipeline_reset() {
+	pipeline_head = 0;
+	pipeline_count = 0;
+	frame_held = false;
+}
+
+// Send an ASDF packet without waiting; its response is matched in order by asdf_recv()
+asdf_error_t asdf_submit(ASDFPacket& asdf_pkt, const ASDFPacket& expected, unsigned long timeout_ms) {
+	if (asdf_streaming()) {
+		Err("asdf_submit while streaming\n");
+		return ASDF_ERR_INVALID;
 	}
-	if (size_read - 1 != pkt_recvd.data_size) {
-		Err("Serial read size mismatch: Expected: %u; Received: %u\n", pkt_recvd.data_size, size_read - 1);
+
+	if (pipeline_count >= pipeline_depth) {
+		Err("ASDF pipeline full: %u transactions outstanding\n", pipeline_count);
+		return ASDF_ERR_INVALID;
 	}
-	if (read_buf[0] != pkt_recvd.code) {
-		Err("Received wrong response code: Expected: %u, Received: %u\n", pkt_recvd.code, read_buf[0]);
-		return -1;
+
+	ASDFTransaction& t = pipeline[(pipeline_head + pipeline_count) % ASDF_MAX_PIPELINE_DEPTH];
+	asdf_error_t err = asdf_send_no_recv(asdf_pkt, &t.seq);
+	if (err != ASDF_OK)
+		return err;
+
+	t.cmd = asdf_pkt.code;
+	t.expected = expected;
+	t.sent_us = shared_clock_us();
+	t.deadline_us = t.sent_us + timeout_ms * 1000ULL;
+	pipeline_count++;
+
+	return ASDF_OK;
+}
+
+// Receive the response to the oldest outstanding transaction
+asdf_error_t asdf_recv(unsigned char* cmd, ASDFPacket& pkt_recvd) {
+	if (pipeline_count == 0) {
+		Err("asdf_recv with no outstanding transaction\n");
+		return ASDF_ERR_INVALID;
 	}
 
-	// parse packet
-	pkt_recvd.code = read_buf[0];
-	for (unsigned int i = 0; i < pkt_recvd.data_size && i < size_read - 1; i++)
-		pkt_recvd.data[i] = read_buf[i + 1];
-	pkt_recvd.data_size = size_read - 1;
+	ASDFTransaction& t = pipeline[pipeline_head];
+	pipeline_head = (pipeline_head + 1) % ASDF_MAX_PIPELINE_DEPTH;
+	pipeline_count--;
+
+	*cmd = t.cmd;
+	pkt_recvd = t.expected;
+	last_sent_us = t.sent_us;
+	return asdf_recv_response(t.seq, pkt_recvd, t.deadline_us);
+}
 
-	return 0;
+unsigned long long asdf_last_sent_us() {
+	return last_sent_us;
 }
 
 
+// true while the device pushes ASDF_STREAM_REPORT packets
+static bool stream_active = false;
+static unsigned char stream_next_seq = 0;	// sequence number of the next report
+static bool stream_seq_known = false;		// false until the first report
+
+
+// append host lever position @value to @pkt in the current mode's format
+static void put_lever(ASDFPacket& pkt, unsigned short value) {
+	if (value > ASDF_LEVER_MAX)
+		value = ASDF_LEVER_MAX;
+
+	if (lever_mode == ASDF_MODE_12BIT) {
+		pkt.data[pkt.data_size++] = value & 0xFF;
+		pkt.data[pkt.data_size++] = value >> 8;
+	} else {
+		pkt.data[pkt.data_size++] = (unsigned char)ASDF_LEVER_TO_7BIT(value);
+	}
+}
+
+// send CMD_MODE; the device answers in the old format up to its ASDF_ACK and in the new one after it
+static asdf_error_t send_mode(unsigned char mode) {
+	ASDFPacket pkt = {
+		CMD_MODE,
+		{ mode },
+		1
+	};
+
+	ASDFPacket recv_pkt = {
+		ASDF_ACK,
+		{ 0 },
+		0
+	};
+
+	asdf_error_t err = asdf_send(pkt, recv_pkt);
+	if (err == ASDF_OK)
+		lever_mode = mode;
+	return err;
+}
+
+asdf_error_t cmd_mode(unsigned char mode) {
+	Log("Sending CMD_MODE: %s\n", mode == ASDF_MODE_12BIT ? "12-bit" : "7-bit");
+
+	if (mode != ASDF_MODE_7BIT && mode != ASDF_MODE_12BIT) {
+		Err("Unknown lever mode: %u\n", mode);
+		return ASDF_ERR_INVALID;
+	}
+
+	asdf_error_t err = send_mode(mode);
+	if (err != ASDF_OK) {
+		Err("ASDFPacket send Error: CMD_MODE: %s\n", asdf_error_name(err));
+		return err;
+	}
+
+	wanted_mode = mode;
+	return ASDF_OK;
+}
+
+unsigned char asdf_lever_mode() {
+	return lever_mode;
+}
 
 // ASDF Command Sender and Response Handler
 
-int cmd_reset() {
+asdf_error_t cmd_reset() {
 	Log("Sending CMD_RESET\n");
 	
 	// craft ASDFPacket
@@ -189,91 +449,386 @@ int cmd_reset() {
 
 	Log("Resetting Serial Connection...\n");
 
+	// responses to anything still in flight are lost with the reset, and the device boots polled
+	asdf_pipeline_reset();
+	stream_active = false;
+
 	// send ASDFPacket
-	if (asdf_send_no_recv(pkt) != 0)
-		return -1;
+	asdf_error_t err = asdf_send_no_recv(pkt);
+	if (err != ASDF_OK)
+		return err;
 
 	asdf_close_serial();
-	Sleep(MAX_DEVICE_RESET_MS);
-	asdf_init_serial();
+	asdf_sleep_ms(MAX_DEVICE_RESET_MS);
+	if (asdf_init_serial() != 0)
+		return ASDF_ERR_IO;
+	asdf_rx_reset();
+
+	// read ASDF_RESET packet; the device may still be booting
+	ASDFFrame frame;
+	unsigned long long deadline_us = deadline_after_ms(MAX_DEVICE_RESET_MS);
+	do {
+		if (!asdf_read_frame(frame, deadline_us)) {
+			err = read_failed();
+			if (err != ASDF_ERR_CANCELLED)
+				Err("No ASDF_RESET upon reset.\n");
+			return err;
+		}
+		if (frame.code != ASDF_RESET)
+			Err("ASDF_RESET mismatch upon reset. Received: %d\n", frame.code);
+	} while (frame.code != ASDF_RESET);
+	lever_mode = ASDF_MODE_7BIT;
 
-	// read ASDF_RESET packet
-	unsigned char code;
-	unsigned long size_read;
-	asdf_serial_read(&code, 1, &size_read);
-	if (code != ASDF_RESET) {
-		Err("ASDF_RESET mismatch upon reset. Received: %d\n", code);
-		return -1;
+	Log("Device Reset Complete.\n");
+
+	if (wanted_mode != ASDF_MODE_7BIT) {
+		err = send_mode(wanted_mode);
+		if (err != ASDF_OK) {
+			Err("CMD_MODE after reset: %s\n", asdf_error_name(err));
+			return err;
+		}
 	}
 
-	Log("Device Reset Complete.\n");
+	return ASDF_OK;
+}
+
+// CMD_POLL request and its expected ASDF_POLL_OK response
+static const ASDFPacket POLL_PKT = {
+	CMD_POLL,
+	{ 0 },
+	0
+};
 
-	return 0;
+static ASDFPacket poll_resp() {
+	ASDFPacket pkt = {
+		ASDF_POLL_OK,
+		{ 0 },
+		poll_data_size()
+	};
+	return pkt;
+}
+
+void cmd_poll_parse(const ASDFPacket& recv_pkt, unsigned short* lever_pos, unsigned char* btn_status) {
+	*btn_status = recv_pkt.data[0];		// button status
+
+	// [0,1,2] = [speed brake, throttle 1, throttle 2]; the size tells the mode it was sent in
+	for (unsigned int i = 0; i < 3; i++) {
+		if (recv_pkt.data_size == ASDF_POLL_DATA_SIZE_12BIT)
+			lever_pos[i] = recv_pkt.data[1 + 2 * i] | (recv_pkt.data[2 + 2 * i] << 8);
+		else
+			lever_pos[i] = ASDF_LEVER_FROM_7BIT(recv_pkt.data[1 + i]);
+	}
+
+	LogV("%u %u %u %u\n", *btn_status, lever_pos[0], lever_pos[1], lever_pos[2]);
 }
 
-int cmd_poll(unsigned char* lever_pos, unsigned char* btn_status) {
+asdf_error_t cmd_poll(unsigned short* lever_pos, unsigned char* btn_status) {
 	LogV("Sending CMD_POLL: ");
 
 	// craft ASDFPackets
+	ASDFPacket pkt = POLL_PKT;
+	ASDFPacket recv_pkt = poll_resp();
+
+	// send ASDFPacket
+	asdf_error_t err = asdf_send(pkt, recv_pkt);
+	if (err != ASDF_OK) {
+		Err("ASDFPacket send Error: CMD_POLL: %s\n", asdf_error_name(err));
+		return err;
+	}
+
+	cmd_poll_parse(recv_pkt, lever_pos, btn_status);
+
+	return ASDF_OK;
+}
+
+asdf_error_t cmd_poll_submit() {
+	LogV("Submitting CMD_POLL\n");
+
+	ASDFPacket pkt = POLL_PKT;
+	asdf_error_t err = asdf_submit(pkt, poll_resp());
+	if (err != ASDF_OK) {
+		Err("ASDFPacket submit Error: CMD_POLL: %s\n", asdf_error_name(err));
+		return err;
+	}
+
+	return ASDF_OK;
+}
+
+asdf_error_t cmd_poll_recv(unsigned short* lever_pos, unsigned char* btn_status) {
+	unsigned char cmd;
+	ASDFPacket recv_pkt;
+
+	asdf_error_t err = asdf_recv(&cmd, recv_pkt);
+	if (err != ASDF_OK) {
+		Err("ASDFPacket recv Error: CMD_POLL: %s\n", asdf_error_name(err));
+		return err;
+	}
+	if (cmd != CMD_POLL) {
+		Err("Oldest outstanding transaction is not CMD_POLL: %u\n", cmd);
+		return ASDF_ERR_INVALID;
+	}
+
+	cmd_poll_parse(recv_pkt, lever_pos, btn_status);
+
+	return ASDF_OK;
+}
+
+// craft a CMD_POLL_SET packet for throttle targets @values
+static ASDFPacket craft_poll_set(unsigned short* values) {
 	ASDFPacket pkt = {
-		CMD_POLL,
+		CMD_POLL_SET,
 		{ 0 },
 		0
 	};
+	put_lever(pkt, values[0]);
+	put_lever(pkt, values[1]);
+	return pkt;
+}
 
-	ASDFPacket recv_pkt = {
-		ASDF_POLL_OK,
+asdf_error_t cmd_poll_set(unsigned short* values, unsigned short* lever_pos, unsigned char* btn_status) {
+	LogV("Sending CMD_POLL_SET: %u %u: ", values[0], values[1]);
+
+	// craft ASDFPackets
+	ASDFPacket pkt = craft_poll_set(values);
+	ASDFPacket recv_pkt = poll_resp();
+
+	// send ASDFPacket
+	asdf_error_t err = asdf_send(pkt, recv_pkt);
+	if (err != ASDF_OK) {
+		Err("ASDFPacket send Error: CMD_POLL_SET: %s\n", asdf_error_name(err));
+		return err;
+	}
+
+	cmd_poll_parse(recv_pkt, lever_pos, btn_status);
+
+	return ASDF_OK;
+}
+
+asdf_error_t cmd_poll_set_submit(unsigned short* values) {
+	LogV("Submitting CMD_POLL_SET: %u %u\n", values[0], values[1]);
+
+	ASDFPacket pkt = craft_poll_set(values);
+	asdf_error_t err = asdf_submit(pkt, poll_resp());
+	if (err != ASDF_OK) {
+		Err("ASDFPacket submit Error: CMD_POLL_SET: %s\n", asdf_error_name(err));
+		return err;
+	}
+
+	return ASDF_OK;
+}
+
+// craft a CMD_LVR_MOVE packet for a segment to throttle positions @values
+static ASDFPacket craft_lvr_move(unsigned short* values, unsigned short duration_ms) {
+	ASDFPacket pkt = {
+		CMD_LVR_MOVE,
 		{ 0 },
-		4
+		0
 	};
+	put_lever(pkt, values[0]);
+	put_lever(pkt, values[1]);
+	pkt.data[pkt.data_size++] = duration_ms & 0xFF;
+	pkt.data[pkt.data_size++] = duration_ms >> 8;
+	return pkt;
+}
 
-	// send ASDFPacket
-	if (asdf_send(pkt, recv_pkt) != 0) {
-		Err("ASDFPacket send Error: CMD_POLL\n");
-		return -1;
+asdf_error_t cmd_lvr_move(unsigned short* values, unsigned short duration_ms,
+	unsigned short* lever_pos, unsigned char* btn_status) {
+	LogV("Sending CMD_LVR_MOVE: %u %u in %u ms: ", values[0], values[1], duration_ms);
+
+	ASDFPacket pkt = craft_lvr_move(values, duration_ms);
+	ASDFPacket recv_pkt = poll_resp();
+
+	asdf_error_t err = asdf_send(pkt, recv_pkt);
+	if (err != ASDF_OK) {
+		Err("ASDFPacket send Error: CMD_LVR_MOVE: %s\n", asdf_error_name(err));
+		return err;
 	}
 
-	*btn_status = recv_pkt.data[0];		// button status
-	lever_pos[0] = recv_pkt.data[1];	// speed brake
-	lever_pos[1] = recv_pkt.data[2];	// throttle 1
-	lever_pos[2] = recv_pkt.data[3];	// throttle 2
+	cmd_poll_parse(recv_pkt, lever_pos, btn_status);
 
-	LogV("%u %u %u %u\n", *btn_status, lever_pos[0], lever_pos[1], lever_pos[2]);
-	
-	//for (int i = 0; i < 8; i++)
-	//	LogV("%u ", recv_pkt.data[i]);
-	//LogV("\n");
+	return ASDF_OK;
+}
 
-	return 0;
+asdf_error_t cmd_lvr_move_submit(unsigned short* values, unsigned short duration_ms) {
+	LogV("Submitting CMD_LVR_MOVE: %u %u in %u ms\n", values[0], values[1], duration_ms);
+
+	ASDFPacket pkt = craft_lvr_move(values, duration_ms);
+	asdf_error_t err = asdf_submit(pkt, poll_resp());
+	if (err != ASDF_OK) {
+		Err("ASDFPacket submit Error: CMD_LVR_MOVE: %s\n", asdf_error_name(err));
+		return err;
+	}
+
+	return ASDF_OK;
 }
 
-int cmd_lvr_rels() {
-	LogV("Sending CMD_LVR_RELS\n");
+asdf_error_t cmd_stream_start(unsigned char period_ms, unsigned short deadband) {
+	Log("Sending CMD_STREAM: period %u ms, deadband %u\n", period_ms, deadband);
+
+	if (period_ms == 0) {
+		Err("CMD_STREAM period must be nonzero; use cmd_stream_stop()\n");
+		return ASDF_ERR_INVALID;
+	}
+
+	// deadband in the device's units, rounded up so a nonzero one stays nonzero
+	unsigned int mode_deadband = lever_mode == ASDF_MODE_12BIT ? deadband :
+		((unsigned int)deadband * ASDF_LEVER_MAX_7BIT + ASDF_LEVER_MAX - 1) / ASDF_LEVER_MAX;
+	if (mode_deadband > 0x7F)
+		mode_deadband = 0x7F;
 
 	// craft ASDFPackets
 	ASDFPacket pkt = {
-		CMD_LVR_RELS,
-		{ 0 },
-		0
+		CMD_STREAM,
+		{ (unsigned char)(period_ms & 0x7F), (unsigned char)mode_deadband },
+		2
 	};
 
 	ASDFPacket recv_pkt = {
-		ASDF_LVR_RELS_RESP,
+		ASDF_ACK,
 		{ 0 },
 		0
 	};
 
+	// send ASDFPacket; reports start right after the ACK
+	asdf_error_t err = asdf_send(pkt, recv_pkt);
+	if (err != ASDF_OK) {
+		Err("ASDFPacket send Error: CMD_STREAM: %s\n", asdf_error_name(err));
+		return err;
+	}
+
+	stream_active = true;
+	stream_seq_known = false;
+	return ASDF_OK;
+}
+
+asdf_error_t cmd_stream_stop() {
+	Log("Sending CMD_STREAM: stop\n");
+
+	// craft ASDFPacket
+	ASDFPacket pkt = {
+		CMD_STREAM,
+		{ 0, 0 },
+		2
+	};
+
+	unsigned char seq;
+	asdf_error_t err = asdf_send_no_recv(pkt, &seq);
+	if (err != ASDF_OK) {
+		Err("ASDFPacket send Error: CMD_STREAM: %s\n", asdf_error_name(err));
+		return err;
+	}
+
+	// skip reports sent before the device saw the command, up to its ASDF_ACK
+	unsigned long long deadline_us = deadline_after_ms(ASDF_RESPONSE_TIMEOUT_MS);
+	while (true) {
+		ASDFFrame frame;
+		if (!asdf_read_frame(frame, deadline_us)) {
+			err = read_failed();
+			if (err == ASDF_ERR_CANCELLED)
+				return err;
+			Err("Serial read timed out waiting for CMD_STREAM ACK\n");
+			link_lost++;
+			return err;
+		}
+
+		if (frame.code == ASDF_ACK && frame.seq == seq)
+			break;
+		if (frame.code != ASDF_STREAM_REPORT) {
+			Err("Received wrong response code while stopping stream: %u\n", frame.code);
+			link_stale++;
+		}
+	}
+
+	stream_active = false;
+	return ASDF_OK;
+}
+
+bool asdf_streaming() {
+	return stream_active;
+}
+
+asdf_error_t asdf_stream_read(unsigned short* lever_pos, unsigned char* btn_status, unsigned long timeout_ms) {
+	if (!stream_active) {
+		Err("asdf_stream_read while not streaming\n");
+		return ASDF_ERR_INVALID;
+	}
+
+	ASDFFrame frame;
+	unsigned long long deadline_us = deadline_after_ms(timeout_ms);
+	do {
+		if (!asdf_read_frame(frame, deadline_us)) {
+			asdf_error_t err = read_failed();
+			if (err != ASDF_ERR_CANCELLED)
+				Err("Stream read timed out after %lu ms\n", timeout_ms);
+			return err;
+		}
+		if (frame.code != ASDF_STREAM_REPORT || !follow_report_size(frame.data_size)) {
+			Err("Received wrong stream report: code %u, %u bytes\n", frame.code, frame.data_size);
+			link_stale++;
+		}
+	} while (frame.code != ASDF_STREAM_REPORT || !follow_report_size(frame.data_size));
+	last_sent_us = shared_clock_us();	// pushed by the device; arrival is the best we know
+
+	// reports are numbered by the device; a gap counts the ones lost
+	if (stream_seq_known)
+		link_lost += (unsigned char)(frame.seq - stream_next_seq);
+	stream_next_seq = frame.seq + 1;
+	stream_seq_known = true;
+
+	// same layout as ASDF_POLL_OK
+	ASDFPacket report = { frame.code, { 0 }, frame.data_size };
+	for (unsigned int i = 0; i < report.data_size; i++)
+		report.data[i] = frame.data[i];
+	cmd_poll_parse(report, lever_pos, btn_status);
+
+	return ASDF_OK;
+}
+
+// CMD_LVR_RELS request and its expected ASDF_LVR_RELS_RESP response
+static const ASDFPacket LVR_RELS_PKT = {
+	CMD_LVR_RELS,
+	{ 0 },
+	0
+};
+
+static const ASDFPacket LVR_RELS_RESP = {
+	ASDF_LVR_RELS_RESP,
+	{ 0 },
+	0
+};
+
+asdf_error_t cmd_lvr_rels() {
+	LogV("Sending CMD_LVR_RELS\n");
+
+	// craft ASDFPackets
+	ASDFPacket pkt = LVR_RELS_PKT;
+	ASDFPacket recv_pkt = LVR_RELS_RESP;
+
 	// send ASDFPacket
-	if (asdf_send(pkt, recv_pkt) != 0) {
-		Err("ASDFPacket send Error: CMD_LVR_RELS\n");
-		return -1;
+	asdf_error_t err = asdf_send(pkt, recv_pkt);
+	if (err != ASDF_OK) {
+		Err("ASDFPacket send Error: CMD_LVR_RELS: %s\n", asdf_error_name(err));
+		return err;
 	}
 
-	return 0;
+	return ASDF_OK;
+}
+
+asdf_error_t cmd_lvr_rels_submit() {
+	LogV("Submitting CMD_LVR_RELS\n");
+
+	ASDFPacket pkt = LVR_RELS_PKT;
+	asdf_error_t err = asdf_submit(pkt, LVR_RELS_RESP);
+	if (err != ASDF_OK) {
+		Err("ASDFPacket submit Error: CMD_LVR_RELS: %s\n", asdf_error_name(err));
+		return err;
+	}
+
+	return ASDF_OK;
 }
 
 // reserved for debug
-int cmd_asdf() {
+asdf_error_t cmd_asdf() {
 	LogV("Sending CMD_ASDF\n");
 
 	// craft ASDFPackets
@@ -290,19 +845,25 @@ int cmd_asdf() {
 	};
 
 	// send ASDFPacket
-	if (asdf_send(pkt, recv_pkt) != 0) {
-		Err("ASDFPacket send Error: CMD_ASDF\n");
-		return -1;
+	asdf_error_t err = asdf_send(pkt, recv_pkt);
+	if (err != ASDF_OK) {
+		Err("ASDFPacket send Error: CMD_ASDF: %s\n", asdf_error_name(err));
+		return err;
 	}
 
-	return 0;
+	return ASDF_OK;
 }
 
-// @bitmask to set levers = (speed brake, throttle 1, throttle 2)
-int cmd_lvr_set(unsigned char bitmask, unsigned char* values) {
-	static constexpr unsigned char LVR_MASK = CMD_LVR_SET_SPDBR | CMD_LVR_SET_TR1 | CMD_LVR_SET_TR2;
+// CMD_LVR_SET response
+static const ASDFPacket LVR_SET_RESP = {
+	ASDF_ACK,
+	{ 0 },
+	0
+};
 
-	LogV("Sending CMD_LVR_SET: %u %u %u %u\n", bitmask, values[0], values[1], values[2]);
+// craft a CMD_LVR_SET packet; @bitmask to set levers = (speed brake, throttle 1, throttle 2)
+static ASDFPacket craft_lvr_set(unsigned char bitmask, unsigned short* values) {
+	static constexpr unsigned char LVR_MASK = CMD_LVR_SET_SPDBR | CMD_LVR_SET_TR1 | CMD_LVR_SET_TR2;
 
 	// set command lever bitmask
 	unsigned char cmd = CMD_LVR_SET_EMPTY | ((bitmask << 4) & LVR_MASK);
@@ -321,23 +882,20 @@ int cmd_lvr_set(unsigned char bitmask, unsigned char* values) {
 		case 0b001:
 		case 0b010:
 		case 0b100:
-			pkt.data_size = 1;
-			pkt.data[0] = values[0] & 0x7F;
+			put_lever(pkt, values[0]);
 			break;
 		
 		case 0b011:
 		case 0b101:
 		case 0b110:
-			pkt.data[0] = values[0] & 0x7F;
-			pkt.data[1] = values[1] & 0x7F;
-			pkt.data_size = 2;
+			put_lever(pkt, values[0]);
+			put_lever(pkt, values[1]);
 			break;
 
 		case 0b111:
-			pkt.data[0] = values[0] & 0x7F;
-			pkt.data[1] = values[1] & 0x7F;
-			pkt.data[2] = values[2] & 0x7F;
-			pkt.data_size = 3;
+			put_lever(pkt, values[0]);
+			put_lever(pkt, values[1]);
+			put_lever(pkt, values[2]);
 			break;
 
 		default:
@@ -345,17 +903,151 @@ int cmd_lvr_set(unsigned char bitmask, unsigned char* values) {
 			break;
 	}
 
-	ASDFPacket recv_pkt = {
-		ASDF_ACK,
+	return pkt;
+}
+
+// @bitmask to set levers = (speed brake, throttle 1, throttle 2)
+asdf_error_t cmd_lvr_set(unsigned char bitmask, unsigned short* values) {
+	LogV("Sending CMD_LVR_SET: %u %u %u %u\n", bitmask, values[0], values[1], values[2]);
+
+	ASDFPacket pkt = craft_lvr_set(bitmask, values);
+	ASDFPacket recv_pkt = LVR_SET_RESP;
+
+	// send ASDFPacket
+	asdf_error_t err = asdf_send(pkt, recv_pkt);
+	if (err != ASDF_OK) {
+		Err("ASDFPacket send Error: CMD_LVR_SET: %s\n", asdf_error_name(err));
+		return err;
+	}
+
+	return ASDF_OK;
+}
+
+asdf_error_t cmd_lvr_set_submit(unsigned char bitmask, unsigned short* values) {
+	LogV("Submitting CMD_LVR_SET: %u\n", bitmask);
+
+	ASDFPacket pkt = craft_lvr_set(bitmask, values);
+	asdf_error_t err = asdf_submit(pkt, LVR_SET_RESP);
+	if (err != ASDF_OK) {
+		Err("ASDFPacket submit Error: CMD_LVR_SET: %s\n", asdf_error_name(err));
+		return err;
+	}
+
+	return ASDF_OK;
+}
+
+
+// ASDF Error Recovery
+
+static const char* RECOVERY_TIER_NAMES[] = {
+	"resync",
+	"retry",
+	"handshake",
+	"reset",
+	"failed"
+};
+
+const char* asdf_recovery_tier_name(asdf_recovery_tier_t tier) {
+	return RECOVERY_TIER_NAMES[tier];
+}
+
+// drop the responses still in flight: read until the line stays quiet for ASDF_RESYNC_QUIET_MS,
+// or for ASDF_RESPONSE_TIMEOUT_MS if it does not (a streaming device never does)
+static void asdf_resync() {
+	asdf_pipeline_reset();
+	asdf_rx_reset();
+
+	unsigned long long deadline_us = shared_clock_us() + ASDF_RESPONSE_TIMEOUT_MS * 1000ULL;
+	unsigned char garbage[64];
+	unsigned long size_read = 0;
+	while (shared_clock_us() < deadline_us && asdf_serial_read(garbage, 1, &size_read, ASDF_RESYNC_QUIET_MS))
+		asdf_serial_read_remaining(garbage, sizeof(garbage), &size_read);
+	asdf_flush_receive_buffer();
+}
+
+// CMD_ASDF with a @timeout_ms deadline; stream reports in between are skipped.
+// in ASDF_MODE_12BIT it is CMD_MODE instead, which also restores the mode of a device that rebooted
+static bool asdf_ping(unsigned long timeout_ms) {
+	ASDFPacket pkt = {
+		CMD_ASDF,
 		{ 0 },
 		0
 	};
+	if (lever_mode != ASDF_MODE_7BIT) {
+		pkt.code = CMD_MODE;
+		pkt.data[0] = lever_mode;
+		pkt.data_size = 1;
+	}
 
-	// send ASDFPacket
-	if (asdf_send(pkt, recv_pkt) != 0) {
-		Err("ASDFPacket send Error: CMD_LVR_SET\n");
-		return -1;
+	unsigned char seq;
+	if (asdf_send_no_recv(pkt, &seq) != ASDF_OK)
+		return false;
+
+	ASDFFrame frame;
+	unsigned long long deadline_us = deadline_after_ms(timeout_ms);
+	while (asdf_read_frame(frame, deadline_us)) {
+		if (frame.seq == seq && frame.code == ASDF_ACK)
+			return true;
+	}
+	return false;
+}
+
+// leave streaming mode whether the device is in it or not; CMD_STREAM(0) is answered with ASDF_ACK either way
+static bool asdf_handshake() {
+	if (asdf_serial_initialized())
+		asdf_close_serial();
+	if (asdf_init_serial() != 0)
+		return false;
+	asdf_resync();
+
+	if (cmd_stream_stop() != ASDF_OK)
+		return false;
+	if (!asdf_ping(ASDF_RESPONSE_TIMEOUT_MS))
+		return false;
+
+	// the device may have rebooted into ASDF_MODE_7BIT, or have been left in another mode
+	if (lever_mode != wanted_mode && send_mode(wanted_mode) != ASDF_OK)
+		return false;
+	return true;
+}
+
+// every tier fails at once when cancelled, so a cancelled attempt ends up ASDF_RECOVERY_FAILED quickly
+static asdf_recovery_tier_t asdf_try_recover() {
+	if (asdf_serial_initialized()) {
+		asdf_resync();
+		if (asdf_ping(ASDF_RESPONSE_TIMEOUT_MS))
+			return ASDF_RECOVERY_RESYNC;
+
+		for (unsigned int i = 1; i <= ASDF_RECOVERY_RETRIES && !asdf_cancelled(); i++) {
+			if (asdf_ping((i + 1) * ASDF_RESPONSE_TIMEOUT_MS))
+				return ASDF_RECOVERY_RETRY;
+		}
 	}
 
-	return 0;
-}
\ No newline at end of file
+	if (!asdf_cancelled() && asdf_handshake())
+		return ASDF_RECOVERY_HANDSHAKE;
+
+	if (!asdf_cancelled() && cmd_reset() == ASDF_OK)
+		return ASDF_RECOVERY_RESET;
+	return ASDF_RECOVERY_FAILED;
+}
+
+asdf_recovery_tier_t asdf_recover() {
+	unsigned long long start_us = shared_clock_us();
+	asdf_recovery_tier_t tier = asdf_try_recover();
+	if (asdf_cancelled()) {
+		Log("Device recovery cancelled\n");
+		return ASDF_RECOVERY_FAILED;
+	}
+
+	unsigned long long took_us = shared_clock_us() - start_us;
+	recoveries[tier]++;
+	if (took_us > recovery_max_us[tier])
+		recovery_max_us[tier] = took_us;
+
+	if (tier == ASDF_RECOVERY_FAILED)
+		Err("Device recovery failed after %llu us\n", took_us);
+	else
+		Log("Device recovered by %s in %llu us\n", asdf_recovery_tier_name(tier), took_us);
+	return tier;
+}
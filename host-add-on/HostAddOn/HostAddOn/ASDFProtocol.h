@@ -2,12 +2,17 @@
 
 // ASDF Protocol over Serial Communication with Arduino
 
-#include <Windows.h>
+#include "ASDFSerial.h"
+#include "ASDFFrame.h"
 
 // command codes
 #define CMD_RESET	 (0x80)
 #define CMD_POLL	 (0x81)
 #define CMD_LVR_RELS (0x83)
+#define CMD_STREAM	 (0x84)
+#define CMD_POLL_SET (0x85)	// set both throttles and poll in one transaction
+#define CMD_MODE	 (0x86)	// select the lever data format; see ASDF_MODE_*
+#define CMD_LVR_MOVE (0x87)	// move both throttles along a linear segment and poll; see cmd_lvr_move()
 #define CMD_ASDF	 (0xFF)
 
 // CMD_LVR_SET command list
@@ -28,62 +33,240 @@ constexpr unsigned int CMD_LVR_SET_LIST[] = {0x82, 0x92, 0xA2, 0xB2, 0xC2, 0xD2,
 #define	ASDF_POLL_OK	(0x02)
 
 // ASDF_LVR_RELS responses
-#define ASDF_LVR_RELS_PILOT	(0x03)
+#define ASDF_LVR_RELS_PILOT	(0x03)	// unsolicited: the pilot overrode the motors; see asdf_pilot_override()
 #define ASDF_LVR_RELS_RESP	(0x83)
 
+// unsolicited lever/button report while streaming (see CMD_STREAM); same payload as ASDF_POLL_OK
+#define ASDF_STREAM_REPORT	(0x04)
+
+// max time between two stream reports even if nothing moved (ms); must match the firmware
+#define ASDF_STREAM_KEEPALIVE_MS	(500)
+
 // max time to wait for device reset until reconnecting Serial (ms)
 #define MAX_DEVICE_RESET_MS	(3000)
 
+// lever data formats (CMD_MODE data[0]); the device boots in ASDF_MODE_7BIT
+#define ASDF_MODE_7BIT		(0)		// one byte per lever [0,127]
+#define ASDF_MODE_12BIT		(1)		// two bytes per lever, little-endian [0,4095]; 10-bit ADCs scaled up
+
+// lever positions on the host are [0,ASDF_LEVER_MAX] whatever the device's mode
+#define ASDF_LEVER_MAX		(4095)
+#define ASDF_LEVER_MAX_7BIT	(127)
+
+// convert between ASDF_MODE_7BIT and host lever positions, rounding to nearest
+#define ASDF_LEVER_FROM_7BIT(v)	(((unsigned int)(v) * ASDF_LEVER_MAX + ASDF_LEVER_MAX_7BIT / 2) / ASDF_LEVER_MAX_7BIT)
+#define ASDF_LEVER_TO_7BIT(v)	(((unsigned int)(v) * ASDF_LEVER_MAX_7BIT + ASDF_LEVER_MAX / 2) / ASDF_LEVER_MAX)
+
+// # of data bytes in a CMD_POLL response: button status + 3 lever positions
+#define ASDF_POLL_DATA_SIZE	(4)
+#define ASDF_POLL_DATA_SIZE_12BIT	(7)
+
+// max # of pipelined transactions in flight; bounded by the device's 64-byte serial buffers
+#define ASDF_MAX_PIPELINE_DEPTH	(8)
+
 // return status of button @i, given bitmap @btmp
 #define getButtonStatus(btmp, i)	((btmp) & (0x1 << i))
 
 
-// ASDF packet struct
+// ASDF packet struct; goes on the wire in an ASDFFrame with a sequence number assigned on sending
 struct ASDFPacket {
 	unsigned char code;		// command/response code; or expected response code
 	unsigned char data[8];	// use maximum 8 bytes of data for now should be sufficient
 	unsigned int data_size;		// size of data array to be sent; or expected size of received data array
 };
 
+// result of an ASDF transaction; failures are negative, so "!= 0" checks still work
+enum asdf_error_t {
+	ASDF_OK = 0,
+	ASDF_ERR_IO = -1,			// port not open, or the driver failed the write
+	ASDF_ERR_TIMEOUT = -2,		// no response before the deadline, or a later one came first
+	ASDF_ERR_CANCELLED = -3,	// the cancel flag was set; see asdf_set_cancel()
+	ASDF_ERR_PROTOCOL = -4,		// response with the wrong code or size
+	ASDF_ERR_INVALID = -5		// bad argument, or not allowed now (streaming, pipeline full or empty)
+};
+
+/* printable name of @err */
+const char* asdf_error_name(asdf_error_t err);
+
+
+/**	
+ *	@asdf_pkt: packet to be sent
+ *	@pkt_recvd: the received asdf packet
+ *	@timeout_ms: max time from sending to the response
+ *
+ *	Send an ASDF packet to the device. Will return only when it gets a response from the device,
+ *	the deadline passes or the call is cancelled.
+ **/ 
+asdf_error_t asdf_send(ASDFPacket& asdf_pkt, ASDFPacket& pkt_recvd,
+	unsigned long timeout_ms = ASDF_RESPONSE_TIMEOUT_MS);
+
+
+// ASDF Error Recovery
+// Cheapest first; each tier is tried only if the ones before it did not get the device answering.
+
+enum asdf_recovery_tier_t {
+	ASDF_RECOVERY_RESYNC = 0,		// drop everything in flight and ping the device once
+	ASDF_RECOVERY_RETRY = 1,		// ping again, ASDF_RECOVERY_RETRIES times, waiting longer each time
+	ASDF_RECOVERY_HANDSHAKE = 2,	// reopen the port, take the device out of streaming and ping it
+	ASDF_RECOVERY_RESET = 3,		// reboot the device (cmd_reset(), MAX_DEVICE_RESET_MS and more)
+	ASDF_RECOVERY_FAILED = 4,		// still not answering; try again later
+	ASDF_RECOVERY_TIER_NUM = 5
+};
+
+// # of pings of ASDF_RECOVERY_RETRY; the n-th waits n + 1 times ASDF_RESPONSE_TIMEOUT_MS
+#define ASDF_RECOVERY_RETRIES	(3)
 
-// ASDF Serial Functions
+// quiet time that ends draining the receive buffer when resynchronizing (ms)
+#define ASDF_RESYNC_QUIET_MS	(5)
 
-/* initialize serial connection */
-int asdf_init_serial(const char* PORT_NAME, unsigned long BAUD_RATE);
+/**
+ *	Get a device that stopped answering back to a known state: no transactions outstanding,
+ *	polled mode from ASDF_RECOVERY_HANDSHAKE on. Returns the tier that worked, or
+ *	ASDF_RECOVERY_FAILED at once if cancelled; cancelled attempts are not counted.
+ **/
+asdf_recovery_tier_t asdf_recover();
 
-/* close the serial port */
-void asdf_close_serial();
+/* printable name of @tier */
+const char* asdf_recovery_tier_name(asdf_recovery_tier_t tier);
 
-/* write to serial port */
-int asdf_serial_write(void* buffer, unsigned int size, unsigned long* size_written);
+// ASDF link statistics since start
+struct ASDFLinkStats {
+	unsigned long long bad_frames;		// frames dropped by the length or CRC check
+	unsigned long long skipped_bytes;	// bytes dropped while resynchronizing
+	unsigned long long lost;			// responses and stream reports that never arrived
+	unsigned long long stale;			// responses that arrived after their transaction was given up
+	unsigned long long recoveries[ASDF_RECOVERY_TIER_NUM];	// asdf_recover() calls by the tier that worked
+	unsigned long long recovery_max_us[ASDF_RECOVERY_TIER_NUM];	// longest of them
+};
 
-/* read from serial port */
-int asdf_serial_read(void* buffer, unsigned int size, unsigned long* size_read);
+/* return the link statistics; TQThread only */
+ASDFLinkStats asdf_link_stats();
 
-/* read all bytes remaining in the receive buffer */
-int asdf_serial_read_remaining(void* buffer, unsigned int size, unsigned long* size_read);
+/* print the link statistics to stdout; TQThread only, or once it is joined */
+void asdf_link_print();
 
-/* flush serial receive buffer; return 0 if failed, nonzero if success */
-int asdf_flush_receive_buffer();
 
-/* return # of bytes in the receive buffer */
-unsigned int asdf_available();
+// ASDF Pipelined Transactions
 
-/**	
+/* set the max # of transactions kept in flight [1, ASDF_MAX_PIPELINE_DEPTH]; 1 means stop-and-wait */
+void asdf_set_pipeline_depth(unsigned int depth);
+
+/* return the max # of transactions kept in flight */
+unsigned int asdf_pipeline_depth();
+
+/* return the # of transactions sent but not yet answered */
+unsigned int asdf_outstanding();
+
+/* forget all outstanding transactions (their responses are lost, e.g. on device reset) */
+void asdf_pipeline_reset();
+
+/**
  *	@asdf_pkt: packet to be sent
+ *	@expected: expected response code and data size
+ *	@timeout_ms: max time from sending to the response; asdf_recv() gives up on it after that
+ *
+ *	Send an ASDF packet to the device without waiting for its response.
+ *	Fails if asdf_pipeline_depth() transactions are already outstanding.
+ **/
+asdf_error_t asdf_submit(ASDFPacket& asdf_pkt, const ASDFPacket& expected,
+	unsigned long timeout_ms = ASDF_RESPONSE_TIMEOUT_MS);
+
+/**
+ *	@cmd: command code of the transaction answered
  *	@pkt_recvd: the received asdf packet
  *
- *	Send an ASDF packet to the device. Will return only when it gets a response from the device.
- **/ 
-int asdf_send(ASDFPacket& asdf_pkt, ASDFPacket& pkt_recvd);
+ *	Receive the response to the oldest outstanding transaction. Responses are matched by sequence
+ *	number: if the device answers a later transaction first, this one's response was lost and it
+ *	fails, while the later response is kept for the asdf_recv() that asks for it.
+ **/
+asdf_error_t asdf_recv(unsigned char* cmd, ASDFPacket& pkt_recvd);
+
+/* shared_clock_us() when the request answered by the last asdf_send()/asdf_recv() was sent,
+ * or when the last stream report arrived; the device sampled its levers after that */
+unsigned long long asdf_last_sent_us();
 
 
 // ASDF Command Sender and Response Handler
 
-int cmd_reset();
-int cmd_poll(unsigned char* lever_pos, unsigned char* btn_status);
-int cmd_lvr_rels();
-int cmd_asdf();		// reserved for debug
+/* reboot the device; it comes back in the mode last set with cmd_mode() */
+asdf_error_t cmd_reset();
+
+/**
+ *	@mode: ASDF_MODE_7BIT or ASDF_MODE_12BIT
+ *
+ *	Select the format lever positions travel in. Lever positions in and out of the cmd_*()
+ *	functions are [0,ASDF_LEVER_MAX] either way. A device that does not know CMD_MODE
+ *	fails it and stays in ASDF_MODE_7BIT.
+ **/
+asdf_error_t cmd_mode(unsigned char mode);
+
+/* return the mode the device is in, as last set or as its lever reports tell */
+unsigned char asdf_lever_mode();
+
+asdf_error_t cmd_poll(unsigned short* lever_pos, unsigned char* btn_status);
+
+// let go of the levers; also tells a device that reported a pilot override that the host knows
+asdf_error_t cmd_lvr_rels();
+asdf_error_t cmd_asdf();		// reserved for debug
 
 // @bitmask to set levers = (speed brake, throttle 1, throttle 2)
-int cmd_lvr_set(unsigned char bitmask, unsigned char* values);
\ No newline at end of file
+asdf_error_t cmd_lvr_set(unsigned char bitmask, unsigned short* values);
+
+// set both throttles (@values = throttle 1, throttle 2) and read back measured levers and buttons;
+// the A/T-engaged equivalent of cmd_lvr_set(0b011, values) followed by cmd_poll()
+asdf_error_t cmd_poll_set(unsigned short* values, unsigned short* lever_pos, unsigned char* btn_status);
+
+/**
+ *	@values: throttle 1, throttle 2 positions at the end of the segment
+ *	@duration_ms: time to get there from the device receiving it
+ *
+ *	Move both throttles in a straight line from where the device is driving them now (where
+ *	they are, if A/T did not have them) to @values, and hold them there; a new segment replaces
+ *	the one running. Reads back measured levers and buttons like cmd_poll_set().
+ *	A device that does not know CMD_LVR_MOVE fails it.
+ **/
+asdf_error_t cmd_lvr_move(unsigned short* values, unsigned short duration_ms,
+	unsigned short* lever_pos, unsigned char* btn_status);
+
+// pipelined variants; see asdf_submit() and asdf_recv()
+asdf_error_t cmd_poll_submit();
+asdf_error_t cmd_poll_set_submit(unsigned short* values);
+asdf_error_t cmd_lvr_move_submit(unsigned short* values, unsigned short duration_ms);
+asdf_error_t cmd_poll_recv(unsigned short* lever_pos, unsigned char* btn_status);
+asdf_error_t cmd_lvr_rels_submit();
+asdf_error_t cmd_lvr_set_submit(unsigned char bitmask, unsigned short* values);
+
+/**
+ *	@period_ms: report period [1,127] ms
+ *	@deadband: min lever change [0,ASDF_LEVER_MAX] that triggers a report; 0 reports every period.
+ *	           The device counts it in its mode's units, at most 127 of them.
+ *
+ *	Switch the device into streaming mode: it pushes ASDF_STREAM_REPORT packets instead of
+ *	waiting for CMD_POLL. A keepalive report is sent every ASDF_STREAM_KEEPALIVE_MS regardless.
+ *	No other command may be sent until cmd_stream_stop().
+ **/
+asdf_error_t cmd_stream_start(unsigned char period_ms, unsigned short deadband);
+
+/* leave streaming mode; reports still in flight are discarded */
+asdf_error_t cmd_stream_stop();
+
+/* return true if the device is in streaming mode */
+bool asdf_streaming();
+
+/* wait for the next ASDF_STREAM_REPORT; same output as cmd_poll() */
+asdf_error_t asdf_stream_read(unsigned short* lever_pos, unsigned char* btn_status,
+	unsigned long timeout_ms = 2 * ASDF_STREAM_KEEPALIVE_MS);
+
+/**
+ *	@levers: levers the pilot took, bit i = lever i of cmd_poll()'s @lever_pos
+ *
+ *	Return true, once, if the device reported a pilot override (ASDF_LVR_RELS_PILOT) since the
+ *	last call. The notification may arrive ahead of any response or stream report and is taken
+ *	out of the way when it does. The device has let go of the levers already and keeps
+ *	answering A/T commands without moving them, reporting the override again after each one,
+ *	until cmd_lvr_rels(). TQThread only.
+ **/
+bool asdf_pilot_override(unsigned char* levers);
+
+/* parse an ASDF_POLL_OK response (to CMD_POLL, CMD_POLL_SET or CMD_LVR_MOVE) from asdf_recv(), in either mode */
+void cmd_poll_parse(const ASDFPacket& recv_pkt, unsigned short* lever_pos, unsigned char* btn_status);
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+// ASDF Serial Transport
+// One backend is linked in per platform: ASDFSerialWin32.cpp (COM port) or ASDFSerialPosix.cpp (termios/pty).
+
+#include <stddef.h>
+#include <atomic>
+
+// max time to wait for a response packet from the device (ms)
+#define ASDF_RESPONSE_TIMEOUT_MS	(100)
+
+// max time to wait for the driver to take bytes written (ms); a device that stopped reading fills it up
+#define ASDF_WRITE_TIMEOUT_MS	(100)
+
+// max time a blocking call goes without looking at the cancel flag (ms); see asdf_set_cancel()
+#define ASDF_CANCEL_CHECK_MS	(10)
+
+
+// ASDF Serial Functions
+
+/* initialize serial connection; NULL/0 reuses the port name and baud rate of the previous call */
+int asdf_init_serial(const char* PORT_NAME = NULL, unsigned long BAUD_RATE = 0);
+
+/* close the serial port */
+void asdf_close_serial();
+
+/* return true if the serial port is open */
+bool asdf_serial_initialized();
+
+/* write to serial port, waiting up to ASDF_WRITE_TIMEOUT_MS for the driver to take it all; return 0 if it did not */
+int asdf_serial_write(void* buffer, unsigned int size, unsigned long* size_written);
+
+/* read @size bytes from serial port, sleeping until they arrive or @timeout_ms passes; return 0 on timeout
+ * or cancellation */
+int asdf_serial_read(void* buffer, unsigned int size, unsigned long* size_read,
+	unsigned long timeout_ms = ASDF_RESPONSE_TIMEOUT_MS);
+
+/* read all bytes remaining in the receive buffer */
+int asdf_serial_read_remaining(void* buffer, unsigned int size, unsigned long* size_read);
+
+/* flush serial receive buffer; return 0 if failed, nonzero if success */
+int asdf_flush_receive_buffer();
+
+/* return # of bytes in the receive buffer */
+unsigned int asdf_available();
+
+/* sleep for @ms milliseconds, or until cancelled */
+void asdf_sleep_ms(unsigned long ms);
+
+/* make asdf_serial_write(), asdf_serial_read() and asdf_sleep_ms() return early once *@cancel
+ * turns true, e.g. &SharedStruct::quit; NULL for none */
+void asdf_set_cancel(const volatile std::atomic<bool>* cancel);
+
+/* true once the cancel flag is set */
+bool asdf_cancelled();
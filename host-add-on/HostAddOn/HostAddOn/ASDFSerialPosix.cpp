@@ -0,0 +1,262 @@
+// ASDF Serial Transport: POSIX termios backend (USB serial or pseudo-terminal)
+
+#ifndef _WIN32
+
+#include "ASDFSerial.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+#include "debug.h"
+
+// Serial session handler
+static int Serial = -1;
+static bool Serial_Initialized = false;
+
+// milliseconds on the monotonic clock
+static unsigned long long now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// see asdf_set_cancel()
+static const volatile std::atomic<bool>* cancel_flag = NULL;
+
+void asdf_set_cancel(const volatile std::atomic<bool>* cancel) {
+	cancel_flag = cancel;
+}
+
+bool asdf_cancelled() {
+	return cancel_flag != NULL && cancel_flag->load();
+}
+
+// poll() timeout for a wait ending at @deadline_ms; short enough to notice cancellation
+static int poll_timeout(unsigned long long deadline_ms) {
+	unsigned long long now = now_ms();
+	if (now >= deadline_ms)
+		return 0;
+	return deadline_ms - now < ASDF_CANCEL_CHECK_MS ? (int)(deadline_ms - now) : ASDF_CANCEL_CHECK_MS;
+}
+
+// map a numeric baud rate to its termios constant; 0 if unsupported
+static speed_t baud2speed(unsigned long baud) {
+	switch (baud) {
+		case 9600:		return B9600;
+		case 19200:		return B19200;
+		case 38400:		return B38400;
+		case 57600:		return B57600;
+		case 115200:	return B115200;
+		case 230400:	return B230400;
+		default:		return 0;
+	}
+}
+
+// initialize serial connection
+int asdf_init_serial(const char* PORT_NAME, unsigned long BAUD_RATE) {
+	// static fields to store port name and baud rate for reset
+	static char port_name[64] = { 0 };
+	static unsigned long baud_rate = { 0 };
+
+	// init static fields if params are not NULL/0
+	if (PORT_NAME != NULL)
+		if (strncmp(port_name, PORT_NAME, sizeof(port_name)) != 0)
+			snprintf(port_name, sizeof(port_name), "%s", PORT_NAME);
+	if (BAUD_RATE != 0)
+		if (baud_rate != BAUD_RATE)
+			baud_rate = BAUD_RATE;
+
+	Serial = open(port_name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (Serial < 0) {
+		Err("Error in opening serial port %s: %s\n", port_name, strerror(errno));
+		return -1;
+	}
+
+	struct termios tio;
+	if (tcgetattr(Serial, &tio) != 0) {
+		Err("Get termios Failed.\n");
+		return -1;
+	}
+
+	// raw 8N1, no echo, no flow control
+	cfmakeraw(&tio);
+	tio.c_cflag |= CLOCAL | CREAD;
+#ifdef CRTSCTS
+	tio.c_cflag &= ~CRTSCTS;
+#endif
+
+	// read() never sleeps and returns whatever is pending; poll() does all the waiting, in slices
+	// short enough to notice cancellation
+	tio.c_cc[VMIN] = 0;
+	tio.c_cc[VTIME] = 0;
+
+	speed_t speed = baud2speed(baud_rate);
+	if (speed == 0) {
+		Err("Unsupported baud rate: %lu\n", baud_rate);
+		return -1;
+	}
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+
+	if (tcsetattr(Serial, TCSANOW, &tio) != 0) {
+		Err("Set termios Failed.\n");
+		return -1;
+	}
+
+#ifdef ASYNC_LOW_LATENCY
+	// ask USB serial drivers to hand bytes over immediately; ptys do not support this
+	struct serial_struct ss;
+	if (ioctl(Serial, TIOCGSERIAL, &ss) == 0) {
+		ss.flags |= ASYNC_LOW_LATENCY;
+		ioctl(Serial, TIOCSSERIAL, &ss);
+	}
+#endif
+
+	// a fresh Win32 handle starts with empty buffers; drop whatever the tty kept across the last close
+	tcflush(Serial, TCIOFLUSH);
+
+	Log("Open serial port successful\n");
+	Serial_Initialized = true;
+
+	// wait for serial ready
+	asdf_sleep_ms(200);
+
+	return 0;
+}
+
+// close the serial port
+void asdf_close_serial() {
+	close(Serial);		//Closing the Serial Port
+	Serial = -1;
+	Serial_Initialized = false;
+	Log("Close serial port successful\n");
+}
+
+// return true if the serial port is open
+bool asdf_serial_initialized() {
+	return Serial_Initialized;
+}
+
+// flush serial receive buffer
+int asdf_flush_receive_buffer() {
+	return tcflush(Serial, TCIFLUSH) == 0;
+}
+
+// return # of bytes in the receive buffer
+unsigned int asdf_available() {
+	int pending = 0;
+	if (ioctl(Serial, FIONREAD, &pending) != 0)
+		return 0;
+	return (unsigned int)pending;
+}
+
+// write to serial port
+int asdf_serial_write(void* buffer, unsigned int size, unsigned long* size_written) {
+	const unsigned char* src = (const unsigned char*)buffer;
+	unsigned long long deadline = now_ms() + ASDF_WRITE_TIMEOUT_MS;
+
+	*size_written = 0;
+	while (*size_written < size) {
+		if (asdf_cancelled())
+			return 0;
+
+		// write() would block on a full output buffer; wait for room here instead
+		struct pollfd pfd = { Serial, POLLOUT, 0 };
+		int ready = poll(&pfd, 1, poll_timeout(deadline));
+		if (ready < 0) {
+			if (errno == EINTR)
+				continue;
+			return 0;
+		}
+		if (ready == 0) {
+			if (now_ms() >= deadline)
+				return 0;	// the device stopped reading
+			continue;
+		}
+
+		ssize_t n = write(Serial, src + *size_written, size - *size_written);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return 0;
+		}
+		*size_written += n;
+	}
+
+	return 1;
+}
+
+// read from serial port; block until get @size bytes or @timeout_ms passes; @size must be >0!!!
+int asdf_serial_read(void* buffer, unsigned int size, unsigned long* size_read, unsigned long timeout_ms) {
+	unsigned char* dst = (unsigned char*)buffer;
+	unsigned long long deadline = now_ms() + timeout_ms;
+
+	*size_read = 0;
+	while (*size_read < size) {
+		if (asdf_cancelled())
+			return 0;
+
+		struct pollfd pfd = { Serial, POLLIN, 0 };
+		int ready = poll(&pfd, 1, poll_timeout(deadline));
+		if (ready < 0) {
+			if (errno == EINTR)
+				continue;
+			return 0;
+		}
+		if (ready == 0) {
+			if (now_ms() >= deadline)
+				return 0;	// timed out; @size_read holds the partial count
+			continue;
+		}
+
+		ssize_t n = read(Serial, dst + *size_read, size - *size_read);
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return 0;
+		}
+		if (n == 0 && (pfd.revents & (POLLHUP | POLLERR)))
+			return 0;	// device went away
+		*size_read += n;
+	}
+
+	return 1;
+}
+
+// read all bytes remaining in the receive buffer
+int asdf_serial_read_remaining(void* buffer, unsigned int size, unsigned long* size_read) {
+	unsigned int truncated_size = asdf_available() >= size ? size : asdf_available();
+
+	*size_read = 0;
+	if (truncated_size == 0)
+		return 1;
+
+	ssize_t n = read(Serial, buffer, truncated_size);
+	if (n < 0)
+		return 0;
+	*size_read = n;
+	return 1;
+}
+
+// sleep for @ms milliseconds, in slices short enough to notice cancellation
+void asdf_sleep_ms(unsigned long ms) {
+	unsigned long long deadline = now_ms() + ms;
+	while (!asdf_cancelled()) {
+		int slice = poll_timeout(deadline);
+		if (slice == 0)
+			return;
+
+		struct timespec ts = { 0, (long)slice * 1000000 };
+		while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+	}
+}
+
+#endif	// !_WIN32
@@ -0,0 +1,256 @@
+// ASDF Serial Transport: Win32 COM port backend
+
+#ifdef _WIN32
+
+#include "ASDFSerial.h"
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include "debug.h"
+
+// Serial session handler
+static HANDLE Serial;
+static DCB dcb;
+static bool Serial_Initialized = false;
+
+// overlapped I/O contexts; each owns a manual-reset event
+static OVERLAPPED ov_read = { 0 };
+static OVERLAPPED ov_write = { 0 };
+static OVERLAPPED ov_wait = { 0 };		// WaitCommEvent(EV_RXCHAR)
+static DWORD wait_evt_mask = 0;			// written by a pending WaitCommEvent
+static bool wait_pending = false;		// WaitCommEvent still outstanding from a previous read
+
+// see asdf_set_cancel()
+static const volatile std::atomic<bool>* cancel_flag = NULL;
+
+void asdf_set_cancel(const volatile std::atomic<bool>* cancel) {
+	cancel_flag = cancel;
+}
+
+bool asdf_cancelled() {
+	return cancel_flag != NULL && cancel_flag->load();
+}
+
+// WaitForSingleObject() timeout for a wait ending at tick count @deadline; short enough to notice cancellation
+static DWORD wait_timeout(ULONGLONG deadline) {
+	ULONGLONG now = GetTickCount64();
+	if (now >= deadline)
+		return 0;
+	return deadline - now < ASDF_CANCEL_CHECK_MS ? (DWORD)(deadline - now) : ASDF_CANCEL_CHECK_MS;
+}
+
+// initialize serial connection
+int asdf_init_serial(const char* PORT_NAME, unsigned long BAUD_RATE) {
+	// static fields to store port name and baud rate for reset
+	static char port_name[16] = { 0 };
+	static unsigned long baud_rate = { 0 };
+
+	// init static fields if params are not NULL/0
+	if (PORT_NAME != NULL)
+		if (strncmp(port_name, PORT_NAME, sizeof(port_name)) != 0)
+			strcpy_s(port_name, PORT_NAME);
+	if (BAUD_RATE != 0)
+		if (baud_rate != BAUD_RATE)
+			baud_rate = BAUD_RATE;
+
+	Serial = CreateFileA(port_name,			// port name "\\\\.\\COM24"
+		GENERIC_READ | GENERIC_WRITE,		// Read/Write
+		0,									// No Sharing
+		NULL,								// No Security
+		OPEN_EXISTING,						// Open existing port only
+		FILE_FLAG_OVERLAPPED,				// Overlapped I/O; reads wait in the kernel
+		NULL);								// Null for Comm Devices
+
+	if (Serial == INVALID_HANDLE_VALUE) {
+		Err("Error in opening serial port\n");
+		return -1;
+	}
+
+	if (!GetCommState(Serial, &dcb)) {
+		Err("Get DCB Failed.\n");
+		return -1;
+	}
+
+	dcb.BaudRate = baud_rate;
+
+	if (!SetCommState(Serial, &dcb)) {
+		Err("Set DCB Failed.\n");
+		return -1;
+	}
+
+	// ReadFile returns immediately with whatever is queued; waiting is done by WaitCommEvent
+	COMMTIMEOUTS timeouts = { 0 };
+	timeouts.ReadIntervalTimeout = MAXDWORD;
+	if (!SetCommTimeouts(Serial, &timeouts)) {
+		Err("Set CommTimeouts Failed.\n");
+		return -1;
+	}
+
+	// wake up on every received character
+	if (!SetCommMask(Serial, EV_RXCHAR)) {
+		Err("Set CommMask Failed.\n");
+		return -1;
+	}
+
+	ov_read.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	ov_write.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	ov_wait.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	wait_pending = false;
+	if (ov_read.hEvent == NULL || ov_write.hEvent == NULL || ov_wait.hEvent == NULL) {
+		Err("Create overlapped events Failed.\n");
+		return -1;
+	}
+
+	Log("Open serial port successful\n");
+	Serial_Initialized = true;
+
+	// wait for serial ready
+	asdf_sleep_ms(200);
+
+	return 0;
+}
+
+// close the serial port
+void asdf_close_serial() {
+	CancelIo(Serial);			// abort a pending WaitCommEvent
+	CloseHandle(Serial);		//Closing the Serial Port
+	CloseHandle(ov_read.hEvent);
+	CloseHandle(ov_write.hEvent);
+	CloseHandle(ov_wait.hEvent);
+	ov_read.hEvent = ov_write.hEvent = ov_wait.hEvent = NULL;
+	wait_pending = false;
+	Serial_Initialized = false;
+	Log("Close serial port successful\n");
+}
+
+// flush serial receive buffer
+int asdf_flush_receive_buffer() {
+	return PurgeComm(Serial, PURGE_RXCLEAR);
+}
+
+// return # of bytes in the receive buffer
+unsigned int asdf_available() {
+	// Device Errors
+	DWORD commErrors;
+	// Device status
+	COMSTAT commStatus;
+	// Read status
+	ClearCommError(Serial, &commErrors, &commStatus);
+	// Return the number of pending bytes
+	return commStatus.cbInQue;
+}
+
+// issue an overlapped ReadFile/WriteFile and wait for it to complete; a write still pending
+// after ASDF_WRITE_TIMEOUT_MS or cancellation is cancelled
+static BOOL serial_overlapped_io(bool is_write, void* buffer, DWORD size, DWORD* size_done) {
+	OVERLAPPED& ov = is_write ? ov_write : ov_read;
+	ResetEvent(ov.hEvent);
+
+	BOOL ok = is_write ? WriteFile(Serial, buffer, size, NULL, &ov)
+		: ReadFile(Serial, buffer, size, NULL, &ov);
+	if (!ok && GetLastError() != ERROR_IO_PENDING) {
+		*size_done = 0;
+		return FALSE;
+	}
+
+	// reads never block here (ReadIntervalTimeout = MAXDWORD); writes finish once the driver takes the bytes
+	if (is_write) {
+		ULONGLONG deadline = GetTickCount64() + ASDF_WRITE_TIMEOUT_MS;
+		while (WaitForSingleObject(ov.hEvent, wait_timeout(deadline)) == WAIT_TIMEOUT) {
+			if (asdf_cancelled() || GetTickCount64() >= deadline) {
+				CancelIo(Serial);
+				GetOverlappedResult(Serial, &ov, size_done, TRUE);
+				return FALSE;
+			}
+		}
+	}
+	return GetOverlappedResult(Serial, &ov, size_done, TRUE);
+}
+
+// sleep in the kernel until a character is received or @timeout_ms elapses; return true on EV_RXCHAR
+static bool serial_wait_rx(DWORD timeout_ms) {
+	if (!wait_pending) {
+		ResetEvent(ov_wait.hEvent);
+		if (WaitCommEvent(Serial, &wait_evt_mask, &ov_wait))
+			return true;	// a character arrived since the last wait
+		if (GetLastError() != ERROR_IO_PENDING)
+			return false;
+		wait_pending = true;
+	}
+
+	switch (WaitForSingleObject(ov_wait.hEvent, timeout_ms)) {
+		case WAIT_OBJECT_0:
+		{
+			DWORD unused;
+			wait_pending = false;
+			return GetOverlappedResult(Serial, &ov_wait, &unused, FALSE) != 0;
+		}
+
+		case WAIT_TIMEOUT:	// keep the WaitCommEvent pending for the next read
+			return false;
+
+		default:
+			wait_pending = false;
+			return false;
+	}
+}
+
+// write to serial port
+int asdf_serial_write(void* buffer, unsigned int size, unsigned long* size_written) {
+	DWORD written = 0;
+	BOOL ok = serial_overlapped_io(true, buffer, size, &written);
+	*size_written = written;
+	return ok;
+}
+
+// read from serial port; block until get @size bytes or @timeout_ms passes; @size must be >0!!!
+int asdf_serial_read(void* buffer, unsigned int size, unsigned long* size_read, unsigned long timeout_ms) {
+	unsigned char* dst = (unsigned char*)buffer;
+	ULONGLONG deadline = GetTickCount64() + timeout_ms;
+
+	*size_read = 0;
+	while (!asdf_cancelled()) {
+		// take whatever the driver has queued
+		DWORD n = 0;
+		if (!serial_overlapped_io(false, dst + *size_read, size - *size_read, &n))
+			return 0;
+		*size_read += n;
+		if (*size_read >= size)
+			return 1;
+
+		ULONGLONG now = GetTickCount64();
+		if (now >= deadline)
+			return 0;	// timed out; @size_read holds the partial count
+
+		serial_wait_rx(wait_timeout(deadline));
+	}
+
+	return 0;	// cancelled
+}
+
+// read all bytes remaining in the receive buffer
+int asdf_serial_read_remaining(void* buffer, unsigned int size, unsigned long* size_read) {
+	unsigned int truncated_size = asdf_available() >= size ? size: asdf_available();
+	DWORD n = 0;
+	BOOL ok = serial_overlapped_io(false, buffer, truncated_size, &n);
+	*size_read = n;
+	return ok;
+}
+
+// return true if the serial port is open
+bool asdf_serial_initialized() {
+	return Serial_Initialized;
+}
+
+// sleep for @ms milliseconds, in slices short enough to notice cancellation
+void asdf_sleep_ms(unsigned long ms) {
+	ULONGLONG deadline = GetTickCount64() + ms;
+	while (!asdf_cancelled()) {
+		DWORD slice = wait_timeout(deadline);
+		if (slice == 0)
+			return;
+		Sleep(slice);
+	}
+}
+
+#endif	// _WIN32
\ No newline at end of file
@@ -0,0 +1,315 @@
+// Asynchronous logger: per-thread single-producer rings drained by one background thread
+
+#include "AsyncLog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// messages a thread can queue before the drain thread catches up; must be a power of two
+#define LOG_RING_SIZE	(1024)
+
+// max # of threads logging at once; a thread's ring is recycled when it exits
+#define LOG_MAX_THREADS	(16)
+
+// max time the idle drain thread sleeps without being woken; a backstop, producers wake it
+static const std::chrono::milliseconds LOG_DRAIN_BACKSTOP(100);
+
+/* one thread's queue; only the owning thread writes @head, only the drain side writes @tail */
+struct LogRing {
+	LogRecord rec[LOG_RING_SIZE];
+	std::atomic<unsigned int> head{ 0 };	// next record to fill
+	std::atomic<unsigned int> tail{ 0 };	// next record to print
+	std::atomic<unsigned long long> dropped{ 0 };	// messages lost to a full ring
+	unsigned long long dropped_reported = 0;		// drain side
+	std::atomic<bool> in_use{ false };
+};
+
+static LogRing* rings[LOG_MAX_THREADS];
+static std::atomic<unsigned int> ring_count{ 0 };
+static std::atomic<unsigned long long> log_seq{ 0 };
+static std::atomic<unsigned long long> unregistered_dropped{ 0 };	// threads beyond LOG_MAX_THREADS
+
+static std::mutex register_lock;	// taken once per thread, on its first message
+static std::mutex drain_lock;		// one drainer at a time: the drain thread or log_flush()
+
+static std::thread drain_thread;
+static std::atomic<bool> drain_stop{ false };
+
+// the drain thread sleeps on drain_wake once every ring is empty
+static std::mutex wake_lock;
+static std::condition_variable drain_wake;
+static bool wake_pending = false;	// under wake_lock
+
+static void drain_loop();
+
+static void wake_drain() {
+	{
+		std::lock_guard<std::mutex> guard(wake_lock);
+		wake_pending = true;
+	}
+	drain_wake.notify_one();
+}
+
+/* stops the drain thread and prints what is left at exit */
+struct LogDrainShutdown {
+	~LogDrainShutdown() {
+		if (drain_thread.joinable()) {
+			drain_stop = true;
+			wake_drain();
+			drain_thread.join();
+		}
+		log_flush();
+	}
+};
+static LogDrainShutdown drain_shutdown;
+
+/* gives the ring back when its thread exits */
+struct LogRingOwner {
+	LogRing* ring = nullptr;
+	~LogRingOwner() {
+		if (ring != nullptr)
+			ring->in_use.store(false, std::memory_order_release);
+	}
+};
+static thread_local LogRingOwner ring_owner;
+
+// claim a free ring for the calling thread, starting the drain thread with the first one
+static LogRing* register_thread() {
+	std::lock_guard<std::mutex> guard(register_lock);
+
+	for (unsigned int i = 0; i < ring_count; i++) {
+		bool expected = false;
+		if (rings[i]->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire))
+			return rings[i];
+	}
+
+	if (ring_count == LOG_MAX_THREADS)
+		return nullptr;
+
+	LogRing* ring = new LogRing;
+	ring->in_use = true;
+	rings[ring_count] = ring;
+	ring_count.store(ring_count + 1, std::memory_order_release);
+
+	if (!drain_thread.joinable())
+		drain_thread = std::thread(drain_loop);
+	return ring;
+}
+
+LogRecord* log_begin(unsigned char level, const char* fmt) {
+	if (ring_owner.ring == nullptr) {
+		ring_owner.ring = register_thread();
+		if (ring_owner.ring == nullptr) {
+			unregistered_dropped.fetch_add(1, std::memory_order_relaxed);
+			return nullptr;
+		}
+	}
+
+	LogRing& ring = *ring_owner.ring;
+	unsigned int head = ring.head.load(std::memory_order_relaxed);
+	if (head - ring.tail.load(std::memory_order_acquire) >= LOG_RING_SIZE) {
+		ring.dropped.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	LogRecord* rec = &ring.rec[head % LOG_RING_SIZE];
+	rec->fmt = fmt;
+	rec->seq = log_seq.fetch_add(1, std::memory_order_relaxed);
+	rec->level = level;
+	rec->nargs = 0;
+	rec->str_used = 0;
+	return rec;
+}
+
+void log_commit(LogRecord* rec) {
+	LogRing& ring = *ring_owner.ring;
+	unsigned int head = ring.head.load(std::memory_order_relaxed);
+	ring.head.store(head + 1, std::memory_order_release);
+
+	// only the first message into an empty ring takes the lock to wake the drain thread; it keeps
+	// draining without sleeping while it finds anything. The fence pairs with the one in
+	// drain_once(), so either this sees the ring emptied or the drain thread sees this message
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (ring.tail.load(std::memory_order_relaxed) == head)
+		wake_drain();
+}
+
+void log_arg(LogRecord& rec, LogArg& arg, const char* v) {
+	arg.type = LogArg::STR;
+	arg.str = rec.str_used;
+
+	if (v == nullptr)
+		v = "(null)";
+
+	// truncated to what is left of the record's string space
+	unsigned int room = LOG_STR_BYTES - rec.str_used;
+	if (room == 0) {
+		arg.str = LOG_STR_BYTES - 1;	// the terminator of the last copy
+		return;
+	}
+	size_t len = strlen(v);
+	if (len > room - 1)
+		len = room - 1;
+	memcpy(rec.str + rec.str_used, v, len);
+	rec.str[rec.str_used + len] = '\0';
+	rec.str_used += (unsigned char)(len + 1);
+}
+
+// format one conversion @spec (e.g. "%5.1f", length modifiers stripped) of @conv with @arg
+static void format_arg(std::string& out, std::string spec, char conv, const LogRecord& rec, const LogArg& arg) {
+	char buf[128];
+	int n = 0;
+
+	switch (conv) {
+	case 'd': case 'i':
+		spec += "ll";
+		spec += conv;
+		n = snprintf(buf, sizeof(buf), spec.c_str(),
+			arg.type == LogArg::DOUBLE ? (long long)arg.d : arg.i);
+		break;
+	case 'u': case 'o': case 'x': case 'X':
+		spec += "ll";
+		spec += conv;
+		n = snprintf(buf, sizeof(buf), spec.c_str(),
+			arg.type == LogArg::DOUBLE ? (unsigned long long)arg.d : arg.u);
+		break;
+	case 'c':
+		spec += conv;
+		n = snprintf(buf, sizeof(buf), spec.c_str(), (int)arg.i);
+		break;
+	case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+		spec += conv;
+		n = snprintf(buf, sizeof(buf), spec.c_str(),
+			arg.type == LogArg::DOUBLE ? arg.d : arg.type == LogArg::INT ? (double)arg.i : (double)arg.u);
+		break;
+	case 's':
+		spec += conv;
+		n = snprintf(buf, sizeof(buf), spec.c_str(), arg.type == LogArg::STR ? rec.str + arg.str : "(?)");
+		break;
+	case 'p':
+		spec += conv;
+		n = snprintf(buf, sizeof(buf), spec.c_str(), arg.p);
+		break;
+	default:
+		out += spec;
+		out += conv;
+		return;
+	}
+
+	if (n > 0)
+		out.append(buf, std::min((size_t)n, sizeof(buf) - 1));
+}
+
+// printf-style formatting of a queued message
+static void format_record(std::string& out, const LogRecord& rec) {
+	unsigned int next_arg = 0;
+
+	for (const char* p = rec.fmt; *p != '\0'; p++) {
+		if (*p != '%') {
+			out += *p;
+			continue;
+		}
+		if (p[1] == '%') {
+			out += '%';
+			p++;
+			continue;
+		}
+
+		// flags, width and precision are kept; length modifiers are replaced by the captured type
+		std::string spec = "%";
+		for (p++; *p != '\0' && strchr("-+ #0123456789.", *p) != nullptr; p++)
+			spec += *p;
+		while (*p != '\0' && strchr("hlLqjzt", *p) != nullptr)
+			p++;
+		if (*p == '\0')
+			break;
+
+		if (next_arg >= rec.nargs) {
+			out += "%?";
+			continue;
+		}
+		format_arg(out, spec, *p, rec, rec.args[next_arg++]);
+	}
+}
+
+// print everything queued so far, in the order it was logged; caller holds drain_lock
+static bool drain_once() {
+	struct Pending {
+		unsigned long long seq;
+		const LogRecord* rec;
+	};
+	std::vector<Pending> pending;
+	unsigned int taken[LOG_MAX_THREADS];
+
+	// between the tails handed back last time and the heads read now; see log_commit()
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	unsigned int count = ring_count.load(std::memory_order_acquire);
+	for (unsigned int r = 0; r < count; r++) {
+		LogRing& ring = *rings[r];
+		unsigned int tail = ring.tail.load(std::memory_order_relaxed);
+		unsigned int head = ring.head.load(std::memory_order_acquire);
+		for (unsigned int i = tail; i != head; i++)
+			pending.push_back({ ring.rec[i % LOG_RING_SIZE].seq, &ring.rec[i % LOG_RING_SIZE] });
+		taken[r] = head;
+	}
+
+	std::sort(pending.begin(), pending.end(),
+		[](const Pending& a, const Pending& b) { return a.seq < b.seq; });
+
+	std::string line;
+	for (const Pending& msg : pending) {
+		line.clear();
+		format_record(line, *msg.rec);
+		fputs(line.c_str(), msg.rec->level == LOG_LEVEL_ERR ? stderr : stdout);
+	}
+
+	// hand the records back to their threads only once printed
+	for (unsigned int r = 0; r < count; r++)
+		rings[r]->tail.store(taken[r], std::memory_order_release);
+
+	for (unsigned int r = 0; r < count; r++) {
+		unsigned long long dropped = rings[r]->dropped.load(std::memory_order_relaxed);
+		if (dropped != rings[r]->dropped_reported) {
+			fprintf(stderr, "log: %llu messages dropped\n", dropped - rings[r]->dropped_reported);
+			rings[r]->dropped_reported = dropped;
+		}
+	}
+	unsigned long long unregistered = unregistered_dropped.exchange(0);
+	if (unregistered != 0)
+		fprintf(stderr, "log: %llu messages dropped (more than %u threads logging)\n", unregistered, LOG_MAX_THREADS);
+
+	if (!pending.empty()) {
+		fflush(stdout);
+		fflush(stderr);
+	}
+	return !pending.empty();
+}
+
+static void drain_loop() {
+	while (!drain_stop) {
+		bool printed;
+		{
+			std::lock_guard<std::mutex> guard(drain_lock);
+			printed = drain_once();
+		}
+		if (!printed) {
+			std::unique_lock<std::mutex> lock(wake_lock);
+			drain_wake.wait_for(lock, LOG_DRAIN_BACKSTOP, [] { return wake_pending || drain_stop; });
+			wake_pending = false;
+		}
+	}
+}
+
+void log_flush() {
+	std::lock_guard<std::mutex> guard(drain_lock);
+	drain_once();
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+// Asynchronous logger behind Log/Err/LogV (see debug.h)
+// A log call copies its format pointer and arguments into a per-thread ring and returns;
+// a background thread formats and prints them. The logging thread never blocks on the
+// console, and never takes a lock after its first log call: if its ring is full, the
+// message is dropped and counted instead.
+
+#include <type_traits>
+
+// message levels; Err goes to stderr, the others to stdout
+#define LOG_LEVEL_ERR		(0)
+#define LOG_LEVEL_INFO		(1)
+#define LOG_LEVEL_VERBOSE	(2)
+
+// max arguments per message; further ones print as "%?"
+#define LOG_MAX_ARGS	(8)
+
+// bytes per message for copies of string arguments, incl. terminators
+#define LOG_STR_BYTES	(64)
+
+/* one argument, captured by value */
+struct LogArg {
+	enum { INT, UINT, DOUBLE, STR, PTR } type;
+	union {
+		long long i;
+		unsigned long long u;
+		double d;
+		unsigned int str;	// offset into LogRecord::str
+		const void* p;
+	};
+};
+
+/* one message as queued; @fmt must be a string literal, it is read when the message is printed */
+struct LogRecord {
+	const char* fmt;
+	unsigned long long seq;		// global order of messages across threads
+	unsigned char level;
+	unsigned char nargs;
+	unsigned char str_used;
+	LogArg args[LOG_MAX_ARGS];
+	char str[LOG_STR_BYTES];
+};
+
+/* reserve a record in the calling thread's ring; NULL if it is full (the message is dropped) */
+LogRecord* log_begin(unsigned char level, const char* fmt);
+
+/* queue the record reserved by log_begin() */
+void log_commit(LogRecord* rec);
+
+/* print everything queued so far by any thread; returns once it is on the console */
+void log_flush();
+
+// argument capture
+
+template<typename T>
+static inline void log_arg(LogRecord& rec, LogArg& arg, T v) {
+	static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+		"log arguments must be numbers, enums, strings or pointers");
+	if (std::is_floating_point<T>::value) {
+		arg.type = LogArg::DOUBLE;
+		arg.d = (double)v;
+	} else if (std::is_signed<T>::value) {
+		arg.type = LogArg::INT;
+		arg.i = (long long)v;
+	} else {
+		arg.type = LogArg::UINT;
+		arg.u = (unsigned long long)v;
+	}
+}
+
+template<typename T>
+static inline void log_arg(LogRecord& rec, LogArg& arg, T* v) {
+	arg.type = LogArg::PTR;
+	arg.p = (const void*)v;
+}
+
+// strings are copied, since the caller's buffer may be gone by the time the message is printed
+void log_arg(LogRecord& rec, LogArg& arg, const char* v);
+
+static inline void log_arg(LogRecord& rec, LogArg& arg, char* v) {
+	log_arg(rec, arg, (const char*)v);
+}
+
+static inline void log_args(LogRecord& rec) {
+}
+
+template<typename T, typename... Rest>
+static inline void log_args(LogRecord& rec, T v, Rest... rest) {
+	if (rec.nargs < LOG_MAX_ARGS)
+		log_arg(rec, rec.args[rec.nargs++], v);
+	log_args(rec, rest...);
+}
+
+/* queue a message of @level; formatted later like printf(@fmt, @args...) */
+template<typename... Args>
+static inline void log_write(unsigned char level, const char* fmt, Args... args) {
+	LogRecord* rec = log_begin(level, fmt);
+	if (rec == nullptr)
+		return;
+	log_args(*rec, args...);
+	log_commit(rec);
+}
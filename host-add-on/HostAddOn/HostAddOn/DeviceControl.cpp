@@ -3,48 +3,142 @@
 #include "DeviceControl.h"
 #include "ASDFProtocol.h"
 #include "SharedStruct.h"
+#include "LatencyStats.h"
+#include "PollScheduler.h"
+#include "TrajectoryPlanner.h"
+#include "PeriodicTask.h"
 #include "debug.h"
 
 #include <atomic>
 #include <chrono>
 #include <iostream>
 #include <stdio.h>
+#include <stdlib.h>
 
 
 using namespace std;
 
+#ifdef _WIN32
 static const char* PORT_NAME = "\\\\.\\COM6";
-static const unsigned long BAUD_RATE = CBR_115200;
+#else
+static const char* PORT_NAME = "/dev/ttyACM0";	// overridden by $ASDF_PORT, e.g. a pty from the device emulator
+#endif
+static const unsigned long BAUD_RATE = 115200;
 
-// reset device when an unexpected device-side error happens
-static void reset_device() {
-	asdf_close_serial();
-	Sleep(MAX_DEVICE_RESET_MS);
-	asdf_init_serial(PORT_NAME, BAUD_RATE);
-	cmd_reset();
+// # of ASDF transactions kept in flight; 1 = stop-and-wait (see asdf_set_pipeline_depth())
+static const unsigned int PIPELINE_DEPTH = 1;
+
+// device-push streaming while the pilot drives the levers (A/T disengaged); see cmd_stream_start()
+static const unsigned char STREAM_PERIOD_MS = 2;	// max report rate; 0 disables streaming
+static const unsigned short STREAM_DEADBAND = 8;	// min lever change (ASDF units) reported; 2 LSB of a 10-bit ADC
+static const unsigned char STREAM_SIM_IDLE_PERIOD_MS = 100;	// report period while the sim is not running
+
+// # of transactions lost in a row (no or corrupted response) before the device is recovered;
+// fewer cost just those transactions, the next cycle polls again
+static const unsigned int MAX_LOST_TRANSACTIONS = 3;
+
+// wait before trying again when even a device reset did not help (ms)
+static const unsigned long RECOVERY_BACKOFF_MS = 1000;
+
+// publish a device sample (lever positions, button status and pilot override) to the shared structure,
+// and wake up SCThread if anything changed
+static void update_shared_struct(volatile SharedStruct& sharedst, unsigned short* throttle_level, unsigned char button_status,
+	bool pilot_override) {
+	static unsigned short last_throttle_level[3] = { 0 };
+	static unsigned char last_button_status = 0;
+	static bool last_pilot_override = false;
+
+	bool changed = button_status != last_button_status || pilot_override != last_pilot_override;
+	for (unsigned int i = 0; i < 3; i++)
+		changed = changed || throttle_level[i] != last_throttle_level[i];
+
+	DeviceSample sample;
+	sample.speed_brake = asdf2sc(throttle_level[0]);
+	sample.throttle_level[THROTTLE_LEFT] = asdf2sc(throttle_level[1]);
+	sample.throttle_level[THROTTLE_RIGHT] = asdf2sc(throttle_level[2]);
+	sample.button_status[BUTTON_TOGA] = getButtonStatus(button_status, BUTTON_TOGA);
+	sample.button_status[BUTTON_AT_DISENGAGE] = getButtonStatus(button_status, BUTTON_AT_DISENGAGE);
+	sample.pilot_override = pilot_override;
+	sample.sampled_us = asdf_last_sent_us();
+	sample.timestamp_us = shared_clock_us();
+	sharedst.device.store(sample);
+	poll_sched_sample(throttle_level, sample.sampled_us, sample.timestamp_us);
+
+	// a streamed report has no request to measure from
+	if (!asdf_streaming())
+		latency_record(LATENCY_POLL, sample.timestamp_us - sample.sampled_us);
+
+	if (changed) {
+		for (unsigned int i = 0; i < 3; i++)
+			last_throttle_level[i] = throttle_level[i];
+		last_button_status = button_status;
+		last_pilot_override = pilot_override;
+		notifier_signal(sharedst.device_updated);
+	}
+}
+
+// get the device answering again after an unexpected device-side error; see asdf_recover()
+// true if the device answers again, in the lever mode it was switched to
+static bool recover_device() {
+	if (asdf_cancelled())
+		return false;		// the error was the quit cancelling the transaction
+	traj_resend();		// the device may have lost its A/T segment
+	if (asdf_recover() == ASDF_RECOVERY_FAILED) {
+		asdf_sleep_ms(RECOVERY_BACKOFF_MS);	// unplugged or powered off; do not spin on it
+		return false;
+	}
+	return true;
 }
 
 unsigned int __stdcall TQThread(void* data) {
 	volatile SharedStruct& sharedst = *((SharedStruct*) data);
 	
-	if (asdf_init_serial(PORT_NAME, BAUD_RATE)) {
+	const char* port_name = PORT_NAME;
+#ifndef _WIN32
+	if (getenv("ASDF_PORT") != NULL)
+		port_name = getenv("ASDF_PORT");
+#endif
+
+	// every blocking ASDF call returns within ASDF_CANCEL_CHECK_MS of quit
+	asdf_set_cancel(&sharedst.quit);
+
+	if (asdf_init_serial(port_name, BAUD_RATE)) {
 		Err("TQThread: Serial Init Failed. Quit.\n");
+		asdf_set_cancel(NULL);
 		return -1;
 	}
 
 	bool is_lever_released = true;
 	bool init_done = false;
+	poll_mode_t last_mode = POLL_MODE_FULL;
+	unsigned char active_stream_period = 0;		// period the device streams at, once streaming
+	PeriodicTask cycle;		// paced polling; see poll_sched_period_us()
+	poll_mode_t cycle_mode = POLL_MODE_FULL;	// mode whose period @cycle runs at
+	unsigned int lost_transactions = 0;		// lost in a row; see MAX_LOST_TRANSACTIONS
+	bool use_segments = true;	// A/T drives the levers with CMD_LVR_MOVE; set-points if the device lacks it
+	bool use_stream = STREAM_PERIOD_MS != 0;	// free levers are streamed; paced polling if the device lacks CMD_STREAM
+	// a command refused, then the device recovered: refused once more, the device does not have it.
+	// One refusal is not enough; a device that rebooted into 7-bit levers refuses 12-bit lengths too
+	bool segments_refused = false;
+	bool stream_refused = false;
+	unsigned short throttle_level[3] = { 0 };	// [0,1,2] = [speed brake, throttle 1, throttle 2], last read
+	bool pilot_override = false;	// the pilot took the levers; A/T counts as off until the sim disengages it
 
 	if (asdf_flush_receive_buffer()) {
 		Log("TQThread: Init Flush Serial Receive Buffer.\n");
 	} else {
 		Err("TQThread: Fail to flush serial receive buffer. Quit.\n");
+		asdf_set_cancel(NULL);
 		return -1;
 	}
 
 	// reset device and read initial ASDF_RESET
 	{
 		cmd_reset();
+
+		// full ADC resolution if the firmware has it; reset and recovery keep the mode from now on
+		if (cmd_mode(ASDF_MODE_12BIT) != ASDF_OK)
+			Log("TQThread: Device has 7-bit levers only.\n");
 		//unsigned char code;
 		//unsigned long size_read;
 		//asdf_serial_read(&code, 1, &size_read);
@@ -59,60 +153,177 @@ unsigned int __stdcall TQThread(void* data) {
 
 	Log("TQThread: Done DeviceControl Thread Initialization!\n");
 
+	asdf_set_pipeline_depth(PIPELINE_DEPTH);
+
 	while (sharedst.quit == false) {
-		unsigned char throttle_level[3];	// [0,1,2] = [speed brake, throttle 1, throttle 2]
 		unsigned char button_status;
 
-		// read throttle levels and button status from device
-		if (cmd_poll(throttle_level, &button_status) != 0) {
-			LogV("TQThread: Poll Result: Throttle = %u %u %u; Button = %u",	\
-				throttle_level[0], throttle_level[1], throttle_level[2], button_status);
-			reset_device();	// try to reset device upon error
-			continue;		// goto next iteration and repoll
+		// A/T status and throttle targets from SCThread
+		SimSample sim;
+		sharedst.sim.load(sim);
+
+		if (pilot_override && !sim.is_AT_engaged) {
+			pilot_override = false;
+			Log("TQThread: A/T disengaged after pilot override.\n");
+		}
+		bool at_engaged = sim.is_AT_engaged && !pilot_override;
+
+		unsigned long long now_us = shared_clock_us();
+		poll_sched_sim(sim.is_sim_running, at_engaged, now_us);
+		poll_mode_t mode = poll_sched_mode(now_us);
+		if (mode != last_mode) {
+			Log("TQThread: Poll mode %s (%llu us).\n", poll_sched_mode_name(mode), poll_sched_period_us(now_us));
+			last_mode = mode;
 		}
 
-		// update button status in shared structure
-		sharedst.button_status[BUTTON_TOGA] = getButtonStatus(button_status, BUTTON_TOGA);
-		sharedst.button_status[BUTTON_AT_DISENGAGE] = getButtonStatus(button_status, BUTTON_AT_DISENGAGE);
-
-		// update speed brake lever position in shared structure
-		sharedst.speed_brake = asdf2sc(throttle_level[0]);
-
-		if (sharedst.is_AT_engaged) {
-		// A/T engaged; get throttle levels from sharedst and send to device
-			//throttle_level[0] = (unsigned char)(sharedst.speed_brake * 128 / 100);
-			throttle_level[1] = sc2asdf(sharedst.throttle_level[THROTTLE_LEFT]);
-			throttle_level[2] = sc2asdf(sharedst.throttle_level[THROTTLE_RIGHT]);
-			if (cmd_lvr_set(0b011, throttle_level + 1) != 0) {
-				reset_device();	// try to reset device upon error
-				continue;		// goto next iteration and repoll
+		// stream while the levers are free; poll (and set) them while A/T drives them
+		bool want_stream = use_stream && !at_engaged && is_lever_released;
+		unsigned char stream_period = mode == POLL_MODE_SIM_IDLE ? STREAM_SIM_IDLE_PERIOD_MS : STREAM_PERIOD_MS;
+
+		if (asdf_streaming()) {
+			// restart with the new period when the sim starts or stops
+			if (!want_stream || stream_period != active_stream_period) {
+				if (cmd_stream_stop() != 0)
+					recover_device();	// try to recover device upon error
+				continue;
 			}
 
-			// set lever release flag
-			if (is_lever_released) {
-				is_lever_released = false;
-				Log("TQThread: Lever Locked.\n");
+			// wait for the next report pushed by the device
+			if (asdf_stream_read(throttle_level, &button_status) != 0) {
+				recover_device();	// try to recover device upon error
+				continue;
 			}
-		} else {
-		// A/T not engaged; update throttle levels in shared structure
-			if (is_lever_released == false) {
-				// send lever release command if not released
-				if (cmd_lvr_rels() != 0) {
-					reset_device();	// try to reset device upon error
-					continue;		// goto next iteration and repoll
+
+			update_shared_struct(sharedst, throttle_level, button_status, pilot_override);
+			continue;
+		}
+
+		if (want_stream && asdf_outstanding() == 0) {
+			asdf_error_t err = cmd_stream_start(stream_period, STREAM_DEADBAND);
+			if (err == ASDF_ERR_PROTOCOL && stream_refused) {
+				use_stream = false;
+				Log("TQThread: Device has no CMD_STREAM; polling.\n");
+			} else if (err != ASDF_OK) {
+				bool recovered = recover_device();	// try to recover device upon error
+				if (err == ASDF_ERR_PROTOCOL)
+					stream_refused = recovered;
+			} else {
+				stream_refused = false;
+				active_stream_period = stream_period;
+			}
+			continue;
+		}
+
+		// paced polling runs one transaction per cycle on the scheduler's period; a new mode
+		// starts a new grid. full rate free-runs with the pipeline full.
+		unsigned long long period_us = want_stream ? 0 : poll_sched_period_us(now_us);
+		if (period_us == 0) {
+			if (cycle.period_us != 0)
+				periodic_stop(cycle);
+		} else if (cycle.period_us == 0 || mode != cycle_mode) {
+			periodic_start(cycle, period_us, LATENCY_SERVO_WAKEUP);
+			cycle_mode = mode;
+		}
+		bool release_now = !at_engaged && !is_lever_released;	// a lever release does not wait its turn
+		if (period_us != 0 && asdf_outstanding() == 0 && !release_now)
+			periodic_wait(cycle);
+
+		// keep the pipeline full; responses come back in submission order.
+		// stop submitting while draining it to switch to streaming.
+		bool submit_failed = false;
+		unsigned int max_outstanding = period_us != 0 ? 1 : asdf_pipeline_depth();
+		while (!want_stream && !submit_failed && asdf_outstanding() < max_outstanding) {
+			if (at_engaged) {
+			// A/T engaged; send throttle targets from sharedst and read the device in one round trip
+				unsigned short throttle_target[2] = {
+					sc2asdf(sim.throttle_level[THROTTLE_LEFT]),
+					sc2asdf(sim.throttle_level[THROTTLE_RIGHT])
+				};
+				if (use_segments) {
+					// planned segments; the cycles in between just poll
+					unsigned long long plan_us = shared_clock_us();
+					if (is_lever_released)
+						traj_reset(throttle_level + 1, plan_us);
+					traj_target(throttle_target, sim.timestamp_us);
+
+					TrajSegment seg;
+					if (traj_plan(plan_us, plan_us + period_us, seg))
+						submit_failed = cmd_lvr_move_submit(seg.end, seg.duration_ms) != 0;
+					else
+						submit_failed = cmd_poll_submit() != 0;
+				} else {
+					submit_failed = cmd_poll_set_submit(throttle_target) != 0;
+				}
+
+				// set lever release flag
+				if (is_lever_released) {
+					is_lever_released = false;
+					Log("TQThread: Lever Locked.\n");
 				}
+			} else if (!at_engaged && is_lever_released == false) {
+				// send lever release command if not released
+				submit_failed = cmd_lvr_rels_submit() != 0;
 
 				is_lever_released = true;
 				Log("TQThread: Lever Released.\n");
+			} else {
+				// read throttle levels and button status from device
+				submit_failed = cmd_poll_submit() != 0;
 			}
-		
-			// update throttle levels in shared structure
-			sharedst.throttle_level[THROTTLE_LEFT] = asdf2sc(throttle_level[1]);
-			sharedst.throttle_level[THROTTLE_RIGHT] = asdf2sc(throttle_level[2]);
 		}
+		if (!submit_failed && asdf_outstanding() == 0)
+			continue;	// draining to switch to streaming is done
+
+		// complete the oldest transaction
+		unsigned char cmd = 0;
+		ASDFPacket recv_pkt;
+		if (submit_failed) {
+			recover_device();	// try to recover device upon error
+			continue;		// goto next iteration and repoll
+		}
+		asdf_error_t err = asdf_recv(&cmd, recv_pkt);
+
+		// the device let go of the levers already; release them for good and have SCThread disengage A/T
+		unsigned char override_levers;
+		if (asdf_pilot_override(&override_levers) && !pilot_override && !is_lever_released) {
+			pilot_override = true;
+			Log("TQThread: Pilot override (levers 0x%02X); releasing.\n", override_levers);
+		}
+
+		if (err != ASDF_OK) {
+			if (cmd == CMD_LVR_RELS)
+				is_lever_released = false;	// not known to be released; send it again
+			if (cmd == CMD_LVR_MOVE && err == ASDF_ERR_PROTOCOL && use_segments) {
+				if (segments_refused) {
+					use_segments = false;
+					Log("TQThread: Device has no CMD_LVR_MOVE; sending set-points.\n");
+				} else
+					segments_refused = recover_device();	// resends the segment
+				continue;
+			}
+			if (cmd == CMD_LVR_MOVE)
+				traj_resend();
+			if (++lost_transactions >= MAX_LOST_TRANSACTIONS) {
+				lost_transactions = 0;
+		if (cmd == CMD_LVR_MOVE)
+			segments_refused = false;
+				recover_device();	// the device stopped answering
+			}
+			continue;		// goto next iteration and repoll
+		}
+		lost_transactions = 0;
+
+		if (cmd != CMD_POLL && cmd != CMD_POLL_SET && cmd != CMD_LVR_MOVE)
+			continue;		// ASDF_LVR_RELS_RESP; nothing to update
+
+		cmd_poll_parse(recv_pkt, throttle_level, &button_status);
+		update_shared_struct(sharedst, throttle_level, button_status, pilot_override);
 	}
 
+	periodic_stop(cycle);
 	asdf_close_serial();
+	Log("TQThread: %llu A/T segments planned.\n", traj_segments());
+	asdf_set_cancel(NULL);
 
 	Log("TQThread: Quit.\n");
 	return 0;
@@ -1,6 +1,10 @@
 #pragma once
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#define __stdcall
+#endif
 
 // device control thread
 unsigned int __stdcall TQThread(void* data);
\ No newline at end of file
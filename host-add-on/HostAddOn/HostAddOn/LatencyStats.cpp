@@ -0,0 +1,135 @@
+#include "LatencyStats.h"
+
+#include <atomic>
+#include <stdio.h>
+
+// values below 2^LINEAR_BITS get a bucket each; above, 2^(LINEAR_BITS - 1) buckets per power of two
+#define LINEAR_BITS		(6)
+#define LINEAR_NUM		(1 << LINEAR_BITS)
+#define SUB_NUM			(LINEAR_NUM / 2)
+#define MAX_SHIFT		(34)		// (2^40 - 1) >> 34 < LINEAR_NUM
+#define BUCKET_NUM		(LINEAR_NUM + MAX_SHIFT * SUB_NUM)
+#define MAX_LATENCY_US	((1ULL << 40) - 1)
+
+static const char* STAGE_NAMES[LATENCY_STAGE_NUM] = {
+	"poll",
+	"handoff",
+	"send",
+	"end-to-end",
+	"servo wakeup"
+};
+
+struct LatencyHistogram {
+	std::atomic<unsigned long long> bucket[BUCKET_NUM];
+	std::atomic<unsigned long long> count;
+	std::atomic<unsigned long long> max;
+	std::atomic<unsigned long long> overruns;
+};
+
+// zero-initialized as a static
+static LatencyHistogram histograms[LATENCY_STAGE_NUM];
+
+// bucket holding @v
+static unsigned int bucket_index(unsigned long long v) {
+	if (v < LINEAR_NUM)
+		return (unsigned int)v;
+
+	// keep the top LINEAR_BITS - 1 significant bits
+	unsigned int shift = 1;
+	while ((v >> shift) >= LINEAR_NUM)
+		shift++;
+	return LINEAR_NUM + (shift - 1) * SUB_NUM + (unsigned int)((v >> shift) - SUB_NUM);
+}
+
+// largest value that falls into bucket @i
+static unsigned long long bucket_upper_bound(unsigned int i) {
+	if (i < LINEAR_NUM)
+		return i;
+
+	unsigned int shift = (i - LINEAR_NUM) / SUB_NUM + 1;
+	unsigned long long sub = (i - LINEAR_NUM) % SUB_NUM + SUB_NUM;
+	return ((sub + 1) << shift) - 1;
+}
+
+void latency_record(latency_stage_t stage, unsigned long long latency_us) {
+	LatencyHistogram& h = histograms[stage];
+
+	if (latency_us > MAX_LATENCY_US)
+		latency_us = MAX_LATENCY_US;
+
+	h.bucket[bucket_index(latency_us)].fetch_add(1, std::memory_order_relaxed);
+	h.count.fetch_add(1, std::memory_order_relaxed);
+
+	unsigned long long max = h.max.load(std::memory_order_relaxed);
+	while (latency_us > max && !h.max.compare_exchange_weak(max, latency_us, std::memory_order_relaxed))
+		;
+}
+
+unsigned long long latency_count(latency_stage_t stage) {
+	return histograms[stage].count.load(std::memory_order_relaxed);
+}
+
+unsigned long long latency_percentile_us(latency_stage_t stage, double percentile) {
+	LatencyHistogram& h = histograms[stage];
+
+	// count is bumped after the bucket, so concurrent recording can only make the buckets run ahead
+	unsigned long long count = h.count.load(std::memory_order_relaxed);
+	if (count == 0)
+		return 0;
+
+	unsigned long long rank = (unsigned long long)(percentile / 100 * count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	if (rank > count)
+		rank = count;
+
+	unsigned long long seen = 0;
+	for (unsigned int i = 0; i < BUCKET_NUM; i++) {
+		seen += h.bucket[i].load(std::memory_order_relaxed);
+		if (seen >= rank) {
+			unsigned long long upper = bucket_upper_bound(i);
+			unsigned long long max = h.max.load(std::memory_order_relaxed);
+			return upper < max ? upper : max;
+		}
+	}
+
+	return h.max.load(std::memory_order_relaxed);
+}
+
+unsigned long long latency_max_us(latency_stage_t stage) {
+	return histograms[stage].max.load(std::memory_order_relaxed);
+}
+
+void latency_record_overrun(latency_stage_t stage) {
+	histograms[stage].overruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+unsigned long long latency_overruns(latency_stage_t stage) {
+	return histograms[stage].overruns.load(std::memory_order_relaxed);
+}
+
+void latency_reset() {
+	for (unsigned int s = 0; s < LATENCY_STAGE_NUM; s++) {
+		LatencyHistogram& h = histograms[s];
+		h.count.store(0, std::memory_order_relaxed);
+		for (unsigned int i = 0; i < BUCKET_NUM; i++)
+			h.bucket[i].store(0, std::memory_order_relaxed);
+		h.max.store(0, std::memory_order_relaxed);
+		h.overruns.store(0, std::memory_order_relaxed);
+	}
+}
+
+void latency_print() {
+	printf("\nlatency (us)      count      p50      p90      p99    p99.9      max  overruns\n");
+	for (unsigned int s = 0; s < LATENCY_STAGE_NUM; s++) {
+		latency_stage_t stage = (latency_stage_t)s;
+		printf("%-12s %10llu %8llu %8llu %8llu %8llu %8llu  %8llu\n", STAGE_NAMES[s],
+			latency_count(stage),
+			latency_percentile_us(stage, 50),
+			latency_percentile_us(stage, 90),
+			latency_percentile_us(stage, 99),
+			latency_percentile_us(stage, 99.9),
+			latency_max_us(stage),
+			latency_overruns(stage));
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// Per-stage latency histograms of the lever -> sim path
+// Any thread may record or read at any time; counters are relaxed atomics, nothing blocks.
+
+/*
+ * Stages a device sample goes through, timestamped with shared_clock_us():
+ *     sampled (poll sent) -> published (SharedStruct) -> picked up (SCThread) -> sent (SimConnect)
+ */
+enum latency_stage_t {
+	LATENCY_POLL = 0,		// CMD_POLL sent -> response received and published by TQThread
+	LATENCY_HANDOFF = 1,	// published -> loaded by SCThread
+	LATENCY_SEND = 2,		// loaded by SCThread -> SimConnect_SetDataOnSimObject(), incl. rate limiting
+	LATENCY_END_TO_END = 3,	// CMD_POLL sent -> SimConnect_SetDataOnSimObject()
+	LATENCY_SERVO_WAKEUP = 4,	// TQThread cycle deadline -> woken up (jitter); see PeriodicTask.h
+	LATENCY_STAGE_NUM = 5
+};
+
+/*
+ * Histograms are log-linear like HdrHistogram: exact below 64 us, then 32 buckets
+ * per power of two, i.e. within ~3% of the recorded value, up to 2^40 us.
+ */
+
+/* add one @latency_us sample to @stage */
+void latency_record(latency_stage_t stage, unsigned long long latency_us);
+
+/* # of samples recorded for @stage */
+unsigned long long latency_count(latency_stage_t stage);
+
+/* latency under which @percentile [0,100] of the samples of @stage fall (bucket upper bound); 0 if none */
+unsigned long long latency_percentile_us(latency_stage_t stage, double percentile);
+
+/* largest sample recorded for @stage */
+unsigned long long latency_max_us(latency_stage_t stage);
+
+/* count one deadline of @stage missed altogether, e.g. a cycle that ran longer than its period */
+void latency_record_overrun(latency_stage_t stage);
+
+/* # of overruns counted for @stage */
+unsigned long long latency_overruns(latency_stage_t stage);
+
+/* forget all samples, e.g. to measure one phase of a run */
+void latency_reset();
+
+/* prints count, p50/p90/p99/p99.9, max and overruns of every stage to stdout */
+void latency_print();
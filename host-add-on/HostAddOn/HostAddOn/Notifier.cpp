@@ -0,0 +1,79 @@
+// Cross-thread wake-up notifications
+
+#include "Notifier.h"
+
+#ifdef _WIN32
+
+notifier_t notifier_create() {
+	return CreateEvent(NULL, FALSE, FALSE, NULL);	// auto-reset, initially clear
+}
+
+void notifier_close(notifier_t n) {
+	CloseHandle(n);
+}
+
+void notifier_signal(notifier_t n) {
+	SetEvent(n);
+}
+
+int notifier_wait_any(const notifier_t* notifiers, unsigned int count, unsigned long timeout_ms) {
+	DWORD ret = WaitForMultipleObjects(count, notifiers, FALSE, timeout_ms);
+	if (ret >= WAIT_OBJECT_0 && ret < WAIT_OBJECT_0 + count)
+		return (int)(ret - WAIT_OBJECT_0);
+	return NOTIFIER_TIMEOUT;
+}
+
+#else
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// max # of notifiers waited on at once
+#define NOTIFIER_MAX_WAIT	(8)
+
+notifier_t notifier_create() {
+	return eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+void notifier_close(notifier_t n) {
+	close(n);
+}
+
+void notifier_signal(notifier_t n) {
+	uint64_t one = 1;
+	ssize_t ret = write(n, &one, sizeof(one));
+	(void)ret;	// only fails if the counter would overflow, i.e. it is signaled already
+}
+
+int notifier_wait_any(const notifier_t* notifiers, unsigned int count, unsigned long timeout_ms) {
+	struct pollfd pfd[NOTIFIER_MAX_WAIT];
+	if (count > NOTIFIER_MAX_WAIT)
+		count = NOTIFIER_MAX_WAIT;
+
+	for (unsigned int i = 0; i < count; i++) {
+		pfd[i].fd = notifiers[i];
+		pfd[i].events = POLLIN;
+		pfd[i].revents = 0;
+	}
+
+	int ready;
+	do {
+		ready = poll(pfd, count, (int)timeout_ms);
+	} while (ready < 0 && errno == EINTR);
+
+	for (unsigned int i = 0; ready > 0 && i < count; i++) {
+		if (pfd[i].revents & POLLIN) {
+			uint64_t value;
+			ssize_t ret = read(notifiers[i], &value, sizeof(value));	// clear (auto-reset)
+			(void)ret;
+			return (int)i;
+		}
+	}
+
+	return NOTIFIER_TIMEOUT;
+}
+
+#endif	// _WIN32
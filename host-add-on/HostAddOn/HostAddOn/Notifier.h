@@ -0,0 +1,28 @@
+#pragma once
+
+// Cross-thread wake-up notifications
+// A notifier is an auto-reset event: signaling it wakes one notifier_wait_any() and then clears.
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE notifier_t;		// auto-reset event; can also be handed to SimConnect_Open()
+#define NOTIFIER_INVALID	(NULL)
+#else
+typedef int notifier_t;			// eventfd
+#define NOTIFIER_INVALID	(-1)
+#endif
+
+#define NOTIFIER_TIMEOUT	(-1)
+
+/* create a notifier; NOTIFIER_INVALID if failed */
+notifier_t notifier_create();
+
+/* close a notifier */
+void notifier_close(notifier_t n);
+
+/* wake up a thread waiting on @n, or the next one to wait on it */
+void notifier_signal(notifier_t n);
+
+/* sleep until one of @count notifiers is signaled or @timeout_ms passes;
+ * return the index of the signaled notifier (and clear it), or NOTIFIER_TIMEOUT */
+int notifier_wait_any(const notifier_t* notifiers, unsigned int count, unsigned long timeout_ms);
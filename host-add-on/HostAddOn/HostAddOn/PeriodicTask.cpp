@@ -0,0 +1,108 @@
+// Fixed-cadence loops on absolute deadlines
+
+#include "PeriodicTask.h"
+#include "SharedStruct.h"
+
+#ifdef _WIN32
+
+// Windows 10 1803+; older versions fail CreateWaitableTimerExW() with it and fall back to ~1 ms timers
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION	(0x00000002)
+#endif
+
+static int timer_open(PeriodicTask& task) {
+	if (task.timer != NULL)
+		return 0;
+
+	task.timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (task.timer == NULL)
+		task.timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+	return task.timer == NULL ? -1 : 0;
+}
+
+static void timer_close(PeriodicTask& task) {
+	if (task.timer != NULL)
+		CloseHandle(task.timer);
+	task.timer = NULL;
+}
+
+// sleep until shared_clock_us() reaches @deadline_us; the timer can fire a little early against
+// QPC, so it is rearmed for whatever is left
+static void timer_sleep_until(PeriodicTask& task, unsigned long long deadline_us) {
+	unsigned long long now_us;
+	while ((now_us = shared_clock_us()) < deadline_us) {
+		// the timer's absolute time is wall clock, which may step; a relative due time on the
+		// monotonic clock is taken right before arming, so it is off by microseconds at most
+		LARGE_INTEGER due;
+		due.QuadPart = -(LONGLONG)((deadline_us - now_us) * 10);	// 100 ns units, negative = relative
+		if (SetWaitableTimer(task.timer, &due, 0, NULL, NULL, FALSE))
+			WaitForSingleObject(task.timer, INFINITE);
+		else
+			Sleep((DWORD)((deadline_us - now_us + 999) / 1000));	// rounded up, never short
+	}
+}
+
+#else
+
+#include <errno.h>
+#include <time.h>
+
+static int timer_open(PeriodicTask& task) {
+	return 0;
+}
+
+static void timer_close(PeriodicTask& task) {
+}
+
+// sleep until shared_clock_us() reaches @deadline_us
+static void timer_sleep_until(PeriodicTask& task, unsigned long long deadline_us) {
+	unsigned long long now_us;
+	while ((now_us = shared_clock_us()) < deadline_us) {
+		// shared_clock_us() is steady_clock; translate the deadline onto CLOCK_MONOTONIC, again if
+		// the two disagree by a little and it woke early
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		unsigned long long ns = (unsigned long long)ts.tv_nsec + (deadline_us - now_us) * 1000;
+		ts.tv_sec += (time_t)(ns / 1000000000);
+		ts.tv_nsec = (long)(ns % 1000000000);
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+	}
+}
+
+#endif	// _WIN32
+
+int periodic_start(PeriodicTask& task, unsigned long long period_us, latency_stage_t stage) {
+	if (period_us == 0 || timer_open(task) != 0)
+		return -1;
+
+	task.period_us = period_us;
+	task.deadline_us = shared_clock_us() + period_us;
+	task.stage = stage;
+	return 0;
+}
+
+void periodic_stop(PeriodicTask& task) {
+	timer_close(task);
+	task.period_us = 0;
+}
+
+unsigned int periodic_wait(PeriodicTask& task) {
+	if (task.period_us == 0)
+		return 0;
+
+	unsigned long long now_us = shared_clock_us();
+	if (now_us > task.deadline_us) {
+		// the cycle ran past its deadline; stay on the grid and go again at once
+		unsigned int missed = (unsigned int)((now_us - task.deadline_us) / task.period_us) + 1;
+		task.deadline_us += missed * task.period_us;
+		for (unsigned int i = 0; i < missed; i++)
+			latency_record_overrun(task.stage);
+		return missed;
+	}
+
+	timer_sleep_until(task, task.deadline_us);	// returns at or past the deadline, never before
+	latency_record(task.stage, shared_clock_us() - task.deadline_us);
+	task.deadline_us += task.period_us;
+	return 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+// Fixed-cadence loops on absolute deadlines
+// Deadlines are kept on a grid (start + n * period), so a late wakeup or a long cycle does
+// not shift the cycles after it. Sleeping uses a high-resolution waitable timer on Windows
+// and clock_nanosleep(TIMER_ABSTIME) on Linux instead of millisecond Sleep().
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "LatencyStats.h"
+
+struct PeriodicTask {
+	unsigned long long period_us = 0;		// 0 = not started
+	unsigned long long deadline_us = 0;		// next deadline, shared_clock_us()
+	latency_stage_t stage = LATENCY_SERVO_WAKEUP;	// wakeup jitter and overruns are recorded here
+#ifdef _WIN32
+	HANDLE timer = NULL;
+#endif
+};
+
+/* start cycles of @period_us, the first one due a period from now; restarts a running task */
+int periodic_start(PeriodicTask& task, unsigned long long period_us, latency_stage_t stage);
+
+/* release the timer of @task */
+void periodic_stop(PeriodicTask& task);
+
+/* sleep until the next deadline of @task, recording how late the wakeup was.
+ * If the deadline has passed already, return at once and skip to the next one
+ * still ahead; returns the # of deadlines missed that way (overruns). */
+unsigned int periodic_wait(PeriodicTask& task);
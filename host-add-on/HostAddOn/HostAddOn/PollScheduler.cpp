@@ -0,0 +1,85 @@
+#include "PollScheduler.h"
+
+static const char* MODE_NAMES[] = {
+	"full",
+	"A/T",
+	"idle",
+	"sim idle"
+};
+
+static const unsigned long long MODE_PERIOD_US[] = {
+	POLL_PERIOD_FULL_US,
+	POLL_PERIOD_AT_US,
+	POLL_PERIOD_IDLE_US,
+	POLL_PERIOD_SIM_IDLE_US
+};
+
+static bool sim_running = false;
+static bool AT_engaged = false;
+static bool sim_known = false;		// false until the first poll_sched_sim()
+
+// lever speed is measured from an anchor sample to the first one POLL_MOVING_DELTA away from it,
+// so ADC jitter and streamed one-step reports are judged over enough time; two steps in ASDF_MODE_7BIT
+#define POLL_MOVING_DELTA	(48)
+static unsigned short anchor_lever_pos[3] = { 0 };
+static unsigned long long anchor_us = 0;		// 0 = no sample yet
+static unsigned long long last_round_trip_us = 0;
+
+static unsigned long long full_rate_until_us = 0;	// levers moved or A/T changed hands recently
+
+void poll_sched_sim(bool is_sim_running, bool is_AT_engaged, unsigned long long now_us) {
+	if (sim_known && is_AT_engaged != AT_engaged && full_rate_until_us < now_us + POLL_AT_TRANSITION_HOLD_US)
+		full_rate_until_us = now_us + POLL_AT_TRANSITION_HOLD_US;
+
+	sim_running = is_sim_running;
+	AT_engaged = is_AT_engaged;
+	sim_known = true;
+}
+
+void poll_sched_sample(const unsigned short* lever_pos, unsigned long long sampled_us, unsigned long long now_us) {
+	if (now_us >= sampled_us)
+		last_round_trip_us = now_us - sampled_us;
+
+	unsigned int max_delta = 0;
+	for (unsigned int i = 0; i < 3 && anchor_us != 0; i++) {
+		unsigned int delta = lever_pos[i] > anchor_lever_pos[i] ?
+			lever_pos[i] - anchor_lever_pos[i] : anchor_lever_pos[i] - lever_pos[i];
+		if (delta > max_delta)
+			max_delta = delta;
+	}
+
+	if (max_delta >= POLL_MOVING_DELTA && sampled_us > anchor_us) {
+		// fastest lever, in ASDF units per second
+		if (max_delta * 1000000ULL / (sampled_us - anchor_us) >= POLL_MOVING_VELOCITY &&
+			full_rate_until_us < now_us + POLL_MOVING_HOLD_US)
+			full_rate_until_us = now_us + POLL_MOVING_HOLD_US;
+	} else if (anchor_us != 0 && sampled_us - anchor_us < POLL_MOVING_HOLD_US) {
+		return;		// not far enough yet to tell
+	}
+
+	// start over from this sample; also forgets a slow drift
+	for (unsigned int i = 0; i < 3; i++)
+		anchor_lever_pos[i] = lever_pos[i];
+	anchor_us = sampled_us;
+}
+
+poll_mode_t poll_sched_mode(unsigned long long now_us) {
+	if (!sim_running)
+		return POLL_MODE_SIM_IDLE;
+	if (now_us < full_rate_until_us)
+		return POLL_MODE_FULL;
+	return AT_engaged ? POLL_MODE_AT : POLL_MODE_IDLE;
+}
+
+unsigned long long poll_sched_period_us(unsigned long long now_us) {
+	unsigned long long period = MODE_PERIOD_US[poll_sched_mode(now_us)];
+
+	// the sample a poll returns is a round trip old by the time it is published
+	unsigned long long max_period = POLL_MAX_SAMPLE_AGE_US > last_round_trip_us ?
+		POLL_MAX_SAMPLE_AGE_US - last_round_trip_us : 0;
+	return period < max_period ? period : max_period;
+}
+
+const char* poll_sched_mode_name(poll_mode_t mode) {
+	return MODE_NAMES[mode];
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// Adaptive poll rate for TQThread
+// The poll period follows what the levers and the sim are doing: full rate while the levers
+// move or the A/T changes hands, slower while nothing happens, slowest while the sim is not
+// running. Times are shared_clock_us() values.
+
+enum poll_mode_t {
+	POLL_MODE_FULL = 0,		// levers moving or A/T transition; as fast as the link allows
+	POLL_MODE_AT = 1,		// A/T holding the levers
+	POLL_MODE_IDLE = 2,		// pilot's levers at rest
+	POLL_MODE_SIM_IDLE = 3	// sim paused, stopped or no aircraft loaded
+};
+
+// poll period of each mode (us)
+#define POLL_PERIOD_FULL_US		(0)
+#define POLL_PERIOD_AT_US		(10000)		// A/T servo rate; above the sim frame rate the targets come in at
+#define POLL_PERIOD_IDLE_US		(20000)
+#define POLL_PERIOD_SIM_IDLE_US	(100000)
+
+// hard bound on the age of the newest sample; periods shrink by the last round trip to keep it
+#define POLL_MAX_SAMPLE_AGE_US	(100000)
+
+// lever speed (ASDF units/s, [0,ASDF_LEVER_MAX] full scale) above which the levers count as
+// moving, and how long full rate is kept after they or the A/T last changed
+#define POLL_MOVING_VELOCITY	(640)	// ~15% of full travel per second
+#define POLL_MOVING_HOLD_US		(1000000)
+#define POLL_AT_TRANSITION_HOLD_US	(2000000)
+
+/* sim state as last published by SCThread */
+void poll_sched_sim(bool is_sim_running, bool is_AT_engaged, unsigned long long now_us);
+
+/* a lever sample (3 ASDF lever positions) read at @sampled_us and received at @now_us */
+void poll_sched_sample(const unsigned short* lever_pos, unsigned long long sampled_us, unsigned long long now_us);
+
+/* the mode in effect at @now_us */
+poll_mode_t poll_sched_mode(unsigned long long now_us);
+
+/* time from one poll to the next at @now_us; TQThread runs its cycles on it (see PeriodicTask.h) */
+unsigned long long poll_sched_period_us(unsigned long long now_us);
+
+/* printable name of @mode */
+const char* poll_sched_mode_name(poll_mode_t mode);
@@ -0,0 +1,60 @@
+#pragma once
+
+// single-writer sequence lock: lock-free, torn-free snapshots of a small record
+
+#include <atomic>
+#include <string.h>
+#include <type_traits>
+
+/*
+ * SeqLock<T> publishes whole values of @T from one writer thread to any number of readers.
+ * The writer never blocks; a reader that overlaps a write retries its copy.
+ * The sequence counter is odd while a write is in progress; @version is sequence / 2,
+ * so a reader can tell whether anything was published since its last read.
+ * @T is copied word by word through relaxed atomics, so it must be trivially copyable.
+ */
+template <typename T>
+class SeqLock {
+	static_assert(std::is_trivially_copyable<T>::value, "SeqLock<T> needs a trivially copyable T");
+
+	static const size_t WORDS = (sizeof(T) + sizeof(unsigned long long) - 1) / sizeof(unsigned long long);
+
+	std::atomic<unsigned long long> seq{ 0 };
+	std::atomic<unsigned long long> data[WORDS] = {};
+
+public:
+	/* publish @value; must only be called by the owning writer thread */
+	void store(const T& value) volatile {
+		unsigned long long buf[WORDS] = { 0 };
+		memcpy(buf, &value, sizeof(T));
+
+		unsigned long long s = seq.load(std::memory_order_relaxed);
+		seq.store(s + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < WORDS; i++)
+			data[i].store(buf[i], std::memory_order_relaxed);
+		seq.store(s + 2, std::memory_order_release);
+	}
+
+	/* copy the last published value into @value; return its version (0 = nothing published yet) */
+	unsigned long long load(T& value) const volatile {
+		unsigned long long buf[WORDS];
+		unsigned long long s1, s2;
+
+		do {
+			s1 = seq.load(std::memory_order_acquire);
+			for (size_t i = 0; i < WORDS; i++)
+				buf[i] = data[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			s2 = seq.load(std::memory_order_relaxed);
+		} while ((s1 & 1) || s1 != s2);
+
+		memcpy(&value, buf, sizeof(T));
+		return s1 / 2;
+	}
+
+	/* version of the last published value, without copying it */
+	unsigned long long version() const volatile {
+		return seq.load(std::memory_order_acquire) / 2;
+	}
+};
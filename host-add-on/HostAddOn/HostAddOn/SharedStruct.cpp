@@ -1,36 +1,62 @@
 #include "SharedStruct.h"
+#include "ASDFProtocol.h"
 
+#include <chrono>
 #include <iostream>
 
 using namespace std;
 
-/* map from ASDF byte range to SimConnect throttle level [0,127] -> [0,100] */
-double asdf2sc(unsigned char val) {
-	return ((double)val) * 100 / 127;
+/* map from ASDF lever position to SimConnect throttle level [0,ASDF_LEVER_MAX] -> [0,100] */
+double asdf2sc(unsigned short val) {
+	return ((double)val) * 100 / ASDF_LEVER_MAX;
 }
 
-/* map from SimConnect throttle level to ASDF byte range [0,100] -> [0,127] */
-unsigned char sc2asdf(double val) {
-	return (unsigned char)(val * 127 / 100);
+/* map from SimConnect throttle level to ASDF lever position [0,100] -> [0,ASDF_LEVER_MAX] */
+unsigned short sc2asdf(double val) {
+	if (val <= 0)
+		return 0;
+	if (val >= 100)
+		return ASDF_LEVER_MAX;
+	return (unsigned short)(val * ASDF_LEVER_MAX / 100 + 0.5);
+}
+
+/* monotonic clock in microseconds, for sample timestamps */
+unsigned long long shared_clock_us() {
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
 }
 
 /* prints out @st to stdout */
 void printSharedStruct(volatile SharedStruct& st) {
+	DeviceSample device;
+	SimSample sim;
+	unsigned long long device_version = st.device.load(device);
+	unsigned long long sim_version = st.sim.load(sim);
+
 	cout << endl;
 
-	cout << "speed_brake: " << st.speed_brake << endl;
+	cout << "device sample #" << device_version << " @ " << device.timestamp_us << " us" << endl;
+
+	cout << "speed_brake: " << device.speed_brake << endl;
 
 	cout << "throttle_level: ";
 	for (unsigned int i = 0; i < THROTTLE_NUM; i++)
-		cout << st.throttle_level[i] << " ";
+		cout << device.throttle_level[i] << " ";
 	cout << endl;
 
 	cout << "button_status: ";
 	for (unsigned int i = 0; i < BUTTON_NUM; i++)
-		cout << st.button_status[i] << " ";
+		cout << device.button_status[i] << " ";
+	cout << endl;
+
+	cout << "sim sample #" << sim_version << " @ " << sim.timestamp_us << " us" << endl;
+
+	cout << "throttle_target: ";
+	for (unsigned int i = 0; i < THROTTLE_NUM; i++)
+		cout << sim.throttle_level[i] << " ";
 	cout << endl;
 
-	cout << "is_AT_engaged: " << st.is_AT_engaged << endl;
+	cout << "is_AT_engaged: " << sim.is_AT_engaged << endl;
+	cout << "is_sim_running: " << sim.is_sim_running << endl;
 
 	cout << "quit: " << st.quit << endl;
 }
\ No newline at end of file
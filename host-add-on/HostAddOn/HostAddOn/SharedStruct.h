@@ -3,26 +3,50 @@
 // shared data structure between SCThread and TQThread
 
 #include <atomic>
+#include "Notifier.h"
+#include "SeqLock.h"
 
 #define THROTTLE_NUM 2
 #define BUTTON_NUM 2
 
+// cache line size on x86/x64; blocks written by different threads are kept this far apart
+#define CACHE_LINE_SIZE 64
+
+/* one device sample, published by TQThread as a whole */
+struct DeviceSample {
+	double speed_brake = 0;		// speed brake level (0-100, percent)
+	double throttle_level[THROTTLE_NUM] = { 0 };	// measured throttle levels; see throttle_idx_t
+	bool button_status[BUTTON_NUM] = { false };		// button status; see button_idx_t
+	bool pilot_override = false;	// the pilot took the levers from A/T; SCThread disengages it
+	unsigned long long sampled_us = 0;		// shared_clock_us() when the poll that read it was sent
+	unsigned long long timestamp_us = 0;	// shared_clock_us() when the sample was received
+};
+
+/* sim state the device follows, published by SCThread as a whole */
+struct SimSample {
+	double throttle_level[THROTTLE_NUM] = { 0 };	// A/T throttle targets; see throttle_idx_t
+	bool is_AT_engaged = false;		// true => A/T engaged; false => A/T disengaged
+	bool is_sim_running = false;	// sim started, not paused, aircraft loaded
+	unsigned long long timestamp_us = 0;	// shared_clock_us() when the sample was published
+};
+
 /* 
  * This structure is shared between TQThread and SCThread.
- * @speed_brake can only be set by TQThread.
- * @throttle_level can only be set by:
- *		SCThread,	if @is_AT_engaged == true;
- *		TQThread,	if @is_AT_engaged == false.
- * @button_status can only be set by TQThread.
- * @is_AT_engaged can only be set by SCThread.
+ * @device can only be set by TQThread.
+ * @sim can only be set by SCThread.
  * @quit can only be set by SCThread.
+ * @device_updated is signaled by TQThread whenever it publishes a changed @device sample.
+ * Samples are read with load(), which returns a version number that only grows on store().
+ * Each writer owns its own cache line(s), so a store by one thread does not invalidate
+ * the line the other thread is writing (false sharing); see SharedBench in TQThreadTest.
  */
 struct SharedStruct {
-	std::atomic<double> speed_brake = 0;	// speed brake level (0-100, percent)
-	std::atomic<double> throttle_level[THROTTLE_NUM] = { 0 };	// throttle levels; see throttle_idx_t
-	std::atomic<bool> button_status[BUTTON_NUM] = { false };	// button status; see button_idx_t
-	std::atomic<bool> is_AT_engaged = false;		// true => A/T engaged; false => A/T disengaged
+	alignas(CACHE_LINE_SIZE) SeqLock<DeviceSample> device;	// device -> sim; TQThread-owned
+
+	alignas(CACHE_LINE_SIZE) SeqLock<SimSample> sim;		// sim -> device; SCThread-owned
 	std::atomic<bool> quit = false;		// quit add-on
+
+	alignas(CACHE_LINE_SIZE) notifier_t device_updated = notifier_create();	// read-only after construction
 };
 
 enum throttle_idx_t {
@@ -35,11 +59,14 @@ enum button_idx_t {
 	BUTTON_AT_DISENGAGE = 1
 };
 
-/* map from ASDF byte range to SimConnect throttle level [0,127] -> [0,100] */
-double asdf2sc(unsigned char val);
+/* map from ASDF lever position to SimConnect throttle level [0,ASDF_LEVER_MAX] -> [0,100] */
+double asdf2sc(unsigned short val);
+
+/* map from SimConnect throttle level to ASDF lever position [0,100] -> [0,ASDF_LEVER_MAX] */
+unsigned short sc2asdf(double val);
 
-/* map from SimConnect throttle level to ASDF byte range [0,100] -> [0,127] */
-unsigned char sc2asdf(double val);
+/* monotonic clock in microseconds, for sample timestamps */
+unsigned long long shared_clock_us();
 
 /* prints out @st to stdout */
 void printSharedStruct(volatile SharedStruct& st);
\ No newline at end of file
@@ -13,16 +13,24 @@ to enable the data sending from the 777X.
 #include "ThrottleControl.h"
 #include "PMDG_777X_SDK.h"
 #include "SharedStruct.h"
+#include "LatencyStats.h"
 
 //#define VERBOSE
 #include "debug.h"
 
+#ifdef _WIN32
 #include <windows.h>
 #include <tchar.h>
+#endif
 #include <stdio.h>
-#include "SimConnect.h"
+#include <string.h>
+#include "SimConnect.h"		// FakeSimConnect/SimConnect.h on Linux
+#ifdef _WIN32
 #include <strsafe.h>
+#endif
 #include <atomic>
+#include <chrono>
+#include <math.h>
 
 static bool    quit = false;
 static HANDLE  hSimConnect = NULL;
@@ -80,14 +88,12 @@ static const char* EVENT_NAME_SET_SPEED_BRAKE = "AXIS_SPOILER_SET"; //"#70130";
 
 // client data type IDs
 enum DATA_DEFINE_ID {
-    DEFINITION_THROTTLE_1,
-	DEFINITION_THROTTLE_2
+    DEFINITION_THROTTLES	// both throttle levers; see ThrottleLevers
 };
 
 // client data request IDs
 enum DATA_REQUEST_ID {
-	REQUEST_THROTTLE_1,
-	REQUEST_THROTTLE_2,
+	REQUEST_THROTTLES,
 	REQUEST_AIR_PATH,
 	REQUEST_PMDG_777_DATA	// used for controlling speed brake
 };
@@ -100,12 +106,19 @@ static const char* SIM_VAR_ENG_THROTTLE_LEVER_POS[THROTTLE_NUM] = {
 	"GENERAL ENG THROTTLE LEVER POSITION:2"
 };
 
+// layout of DEFINITION_THROTTLES; both engines are read and written in the same message
+struct ThrottleLevers
+{
+	double throttle_level[THROTTLE_NUM];	// SIM_VAR_ENG_THROTTLE_LEVER_POS, percent
+};
+
 // all data used between SCThread and P3D
 struct ThrottleQuadrantData 
 {
 	double throttle_level[THROTTLE_NUM] = { 0 };	// 0.0 - 100.0
 	int speed_brake = -16383;		// -16383 to 16383
 	bool button_status[BUTTON_NUM] = { false };
+	bool pilot_override = false;	// see DeviceSample
 	bool is_AT_engaged = false;
 	bool reverse_thrust = false;
 };
@@ -118,29 +131,116 @@ static bool aircraft_loaded = false;	// PMDG specific flag
 
 #define sim_running ((!sim_paused) && sim_start && aircraft_loaded)
 
-// copy over data from shared struct if AT disengaged;
-// copy data to shared struct if AT engaged.
+/* SimConnect write coalescing: a lever value is only transmitted if it moved more than its
+ * epsilon since it was last sent, and at most once every MIN_SEND_INTERVAL per channel.
+ * A change held back by the rate limit goes out on a later loop iteration. */
+static const double THROTTLE_SEND_EPSILON = 0.05;		// percent; one ASDF step is ~0.025% (12-bit), ~0.8% (7-bit)
+static const double SPEED_BRAKE_SEND_EPSILON = 16;		// AXIS_SPOILER_SET units [-16383,16383]; two 12-bit ASDF steps
+static const std::chrono::milliseconds MIN_SEND_INTERVAL(16);	// about one sim frame
+
+// last values transmitted on one SimConnect write channel (one message carrying up to THROTTLE_NUM values)
+struct SentChannel {
+	double value[THROTTLE_NUM] = { 0 };
+	bool valid = false;		// false => next value is sent regardless of epsilon/interval
+	std::chrono::steady_clock::time_point time;
+};
+
+static SentChannel sent_throttles;
+static SentChannel sent_speed_brake;
+
+// SimConnect write statistics
+static unsigned long long writes_sent = 0;
+static unsigned long long writes_suppressed = 0;
+
+// true if the last setDataOnAircraft() held back a change because of the rate limit
+static bool send_deferred = false;
+
+// SCThread wakes up at least this often when nothing happens, to notice a dead SimConnect session
+static const unsigned long SC_IDLE_WAIT_MS = 1000;
+
+// return true if the @n values in @value should be transmitted on channel @ch
+static bool shouldSend(SentChannel& ch, const double* value, unsigned int n, double epsilon,
+	std::chrono::steady_clock::time_point now) {
+	bool changed = !ch.valid;
+	for (unsigned int i = 0; i < n; i++)
+		changed = changed || fabs(value[i] - ch.value[i]) > epsilon;
+
+	bool send = changed && (!ch.valid || now - ch.time >= MIN_SEND_INTERVAL);
+	if (!send)
+		writes_suppressed++;
+	if (changed && !send)
+		send_deferred = true;
+	return send;
+}
+
+// record that the @n values in @value were transmitted on channel @ch
+static void markSent(SentChannel& ch, const double* value, unsigned int n, std::chrono::steady_clock::time_point now) {
+	for (unsigned int i = 0; i < n; i++)
+		ch.value[i] = value[i];
+	ch.valid = true;
+	ch.time = now;
+	writes_sent++;
+}
+
+// timestamps of the device sample whose levers tc holds; see latency_stage_t
+static unsigned long long tc_sampled_us = 0;
+static unsigned long long tc_loaded_us = 0;
+
+// force every channel to be retransmitted, e.g. after the sim moved the levers itself
+static void invalidateSentChannels() {
+	sent_throttles.valid = false;
+	sent_speed_brake.valid = false;
+}
+
+// publish sim state, AT status and the sim throttle levels to shared struct; only changes are published
+static void publishSimSample(const ThrottleQuadrantData& tc, volatile SharedStruct& st) {
+	static SimSample sim;
+
+	bool sim_changed = sim.is_AT_engaged != tc.is_AT_engaged || sim.is_sim_running != sim_running;
+	for (unsigned int i = 0; i < THROTTLE_NUM; i++)
+		sim_changed = sim_changed || sim.throttle_level[i] != tc.throttle_level[i];
+	if (sim_changed) {
+		for (unsigned int i = 0; i < THROTTLE_NUM; i++)
+			sim.throttle_level[i] = tc.throttle_level[i];
+		sim.is_AT_engaged = tc.is_AT_engaged;
+		sim.is_sim_running = sim_running;
+		sim.timestamp_us = shared_clock_us();
+		st.sim.store(sim);
+	}
+	LogV("SCThread: AT_engaged: %u\n", tc.is_AT_engaged);
+}
+
+// copy over the device sample from shared struct if AT disengaged
 static void syncDataWithSharedStruct(ThrottleQuadrantData& tc, volatile SharedStruct& st) {
+	static unsigned long long device_version = 0;
+	static bool was_AT_engaged = false;
+
+	// nothing new from the device, and tc still holds its last sample
+	if (st.device.version() == device_version && tc.is_AT_engaged == was_AT_engaged)
+		return;
+	was_AT_engaged = tc.is_AT_engaged;
+
+	DeviceSample device;
+	device_version = st.device.load(device);
+	unsigned long long now_us = shared_clock_us();
+	if (device.timestamp_us != 0)	// TQThread has published something
+		latency_record(LATENCY_HANDOFF, now_us - device.timestamp_us);
+
 	// always forward button status from st to tc
 	for (unsigned int i = 0; i < BUTTON_NUM; i++)
-		tc.button_status[i] = st.button_status[i];
-
-	// always forward AT status from tc to st
-	st.is_AT_engaged = tc.is_AT_engaged;
-	LogV("SCThread: AT_engaged: %u\n", tc.is_AT_engaged);
+		tc.button_status[i] = device.button_status[i];
+	tc.pilot_override = device.pilot_override;
 
 	// always forward speed brake lever position from st to tc [0,100] -> [-16383,16383]
-	tc.speed_brake = -16383 + (int)st.speed_brake * (16383 * 2) / 100;
+	tc.speed_brake = -16383 + (int)(device.speed_brake * (16383 * 2) / 100);
 
 	if (tc.is_AT_engaged) {		// st <- tc
-		for (unsigned int i = 0; i < THROTTLE_NUM; i++)
-			st.throttle_level[i] = tc.throttle_level[i];
-		//st.speed_brake = tc.speed_brake * 100.0 / ((unsigned int)0x03FFF);
 		LogV("SCThread: Sync to device\n");
 	} else {	// tc <- st
 		for (unsigned int i = 0; i < THROTTLE_NUM; i++)
-			tc.throttle_level[i] = st.throttle_level[i];
-		//tc.speed_brake = (unsigned int)(st.speed_brake * ((unsigned int)0x03FFF) / 100);
+			tc.throttle_level[i] = device.throttle_level[i];
+		tc_sampled_us = device.sampled_us;
+		tc_loaded_us = now_us;
 		LogV("SCThread: Sync from device\n");
 	}
 }
@@ -149,18 +249,10 @@ static void syncDataWithSharedStruct(ThrottleQuadrantData& tc, volatile SharedSt
 static HRESULT setRequestLeverFrequency(const SIMCONNECT_PERIOD period) {
 	HRESULT hr;
 
-	// throttle 1
+	// both throttles
 	hr = SimConnect_RequestDataOnSimObject(hSimConnect,
-		REQUEST_THROTTLE_1,
-		DEFINITION_THROTTLE_1,
-		SIMCONNECT_OBJECT_ID_USER,
-		period,
-		SIMCONNECT_DATA_REQUEST_FLAG_CHANGED);
-
-	// throttle 2
-	hr = SimConnect_RequestDataOnSimObject(hSimConnect,
-		REQUEST_THROTTLE_2,
-		DEFINITION_THROTTLE_2,
+		REQUEST_THROTTLES,
+		DEFINITION_THROTTLES,
 		SIMCONNECT_OBJECT_ID_USER,
 		period,
 		SIMCONNECT_DATA_REQUEST_FLAG_CHANGED);
@@ -187,9 +279,31 @@ static HRESULT setRequestDataFromAircraft(const SIMCONNECT_PERIOD period) {
 	return hr;
 }
 
+// click the A/T disengage switch, as the pilot would
+static HRESULT clickATDisengage() {
+	HRESULT hr;
+
+	hr = SimConnect_TransmitClientEvent(hSimConnect, 
+		SIMCONNECT_OBJECT_ID_USER,
+		EVENT_AT_DISENGAGE_1,
+		MOUSE_FLAG_LEFTSINGLE,
+		SIMCONNECT_GROUP_PRIORITY_HIGHEST, 
+		SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY);
+	hr = SimConnect_TransmitClientEvent(hSimConnect,
+		SIMCONNECT_OBJECT_ID_USER,
+		EVENT_AT_DISENGAGE_1,
+		MOUSE_FLAG_LEFTRELEASE,
+		SIMCONNECT_GROUP_PRIORITY_HIGHEST,
+		SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY);
+	hr = setRequestLeverFrequency(SIMCONNECT_PERIOD_NEVER);
+
+	return hr;
+}
+
 // send data to p3d if AT disengaged
 static HRESULT setDataOnAircraft() {
-	HRESULT hr = NULL;
+	static bool override_handled = false;	// A/T disengaged for the pilot override in tc
+	HRESULT hr = S_OK;
 	
 	// toga button
 	if (tc.button_status[BUTTON_TOGA] && tc.is_AT_engaged == false) {
@@ -206,61 +320,72 @@ static HRESULT setDataOnAircraft() {
 	// A/T disengage button
 	if (tc.button_status[BUTTON_AT_DISENGAGE] && tc.is_AT_engaged == true) {
 		// trigger button input by simulating mouse click
-		hr = SimConnect_TransmitClientEvent(hSimConnect, 
-			SIMCONNECT_OBJECT_ID_USER,
-			EVENT_AT_DISENGAGE_1,
-			MOUSE_FLAG_LEFTSINGLE,
-			SIMCONNECT_GROUP_PRIORITY_HIGHEST, 
-			SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY);
+		hr = clickATDisengage();
+		Log("SCThread: A/T Disengage Button.\n");
+	}
+
+	// pilot override on the levers; the device let go already, the A/T follows once per override
+	if (tc.pilot_override && !override_handled && tc.is_AT_engaged == true) {
+		hr = clickATDisengage();
+		Log("SCThread: A/T Disengaged by Pilot Override.\n");
+	}
+	override_handled = tc.pilot_override;
+	
+	auto now = std::chrono::steady_clock::now();
+
+	// speed brake
+	double speed_brake = tc.speed_brake;
+	if (shouldSend(sent_speed_brake, &speed_brake, 1, SPEED_BRAKE_SEND_EPSILON, now)) {
 		hr = SimConnect_TransmitClientEvent(hSimConnect,
 			SIMCONNECT_OBJECT_ID_USER,
-			EVENT_AT_DISENGAGE_1,
-			MOUSE_FLAG_LEFTRELEASE,
+			EVENT_SET_SPEED_BRAKE,
+			tc.speed_brake,
 			SIMCONNECT_GROUP_PRIORITY_HIGHEST,
 			SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY);
-		hr = setRequestLeverFrequency(SIMCONNECT_PERIOD_NEVER);
-		Log("SCThread: A/T Disengage Button.\n");
+		markSent(sent_speed_brake, &speed_brake, 1, now);
+
+		LogV("SCThread: Set Spolier to: %u\n", tc.speed_brake);
 	}
-	
-	// speed brake
-	hr = SimConnect_TransmitClientEvent(hSimConnect,
-		SIMCONNECT_OBJECT_ID_USER,
-		EVENT_SET_SPEED_BRAKE,
-		tc.speed_brake,
-		SIMCONNECT_GROUP_PRIORITY_HIGHEST,
-		SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY);
 
-	LogV("SCThread: Set Spolier to: %u\n", tc.speed_brake);
+	// do not send lever data if A/T engaged; the sim moves the throttles, so resend them once A/T lets go
+	if (tc.is_AT_engaged) {
+		sent_throttles.valid = false;
 
-	// do not send lever data if A/T engaged
-	if (tc.is_AT_engaged)
-		if (hr == NULL)
+		if (hr == S_OK)
 			return S_OK;
 		else
 			return hr;
+	}
 
-	// throttle 1
-	hr = SimConnect_SetDataOnSimObject(hSimConnect,
-		DEFINITION_THROTTLE_1,
-		SIMCONNECT_OBJECT_ID_USER,
-		0,
-		0,
-		sizeof(tc.throttle_level[0]),
-		&(tc.throttle_level[0]));
-
-	LogV("SCThread: Set Throttle 0 to: %2.1f\n", tc.throttle_level[0]);
+	// both throttles in one message, so both engines change in the same sim frame
+	if (shouldSend(sent_throttles, tc.throttle_level, THROTTLE_NUM, THROTTLE_SEND_EPSILON, now)) {
+		ThrottleLevers levers;
+		for (unsigned int i = 0; i < THROTTLE_NUM; i++)
+			levers.throttle_level[i] = tc.throttle_level[i];
 
-	// throttle 2
-	hr = SimConnect_SetDataOnSimObject(hSimConnect,
-		DEFINITION_THROTTLE_2,
-		SIMCONNECT_OBJECT_ID_USER,
-		0,
-		0,
-		sizeof(tc.throttle_level[1]),
-		&(tc.throttle_level[1]));
+		hr = SimConnect_SetDataOnSimObject(hSimConnect,
+			DEFINITION_THROTTLES,
+			SIMCONNECT_OBJECT_ID_USER,
+			0,
+			0,
+			sizeof(levers),
+			&levers);
+		markSent(sent_throttles, tc.throttle_level, THROTTLE_NUM, now);
+
+		// once per device sample; a resend of the same levers says nothing about the path
+		if (tc_loaded_us != 0) {
+			unsigned long long sent_us = shared_clock_us();
+			latency_record(LATENCY_SEND, sent_us - tc_loaded_us);
+			if (tc_sampled_us != 0)
+				latency_record(LATENCY_END_TO_END, sent_us - tc_sampled_us);
+			tc_loaded_us = 0;
+		}
 
-	LogV("SCThread: Set Throttle 1 to: %2.1f\n", tc.throttle_level[1]);
+		LogV("SCThread: Set Throttles to: %2.1f %2.1f\n", tc.throttle_level[0], tc.throttle_level[1]);
+	}
 
+	if (hr == S_OK)
+		return S_OK;
 	return hr;
 }
 
@@ -300,13 +425,10 @@ static HRESULT initClientEvents() {
 static HRESULT initDataDefinitions() {
 	HRESULT hr;
 
-	// throttle control 1
-	hr = SimConnect_AddToDataDefinition(hSimConnect, DEFINITION_THROTTLE_1,
-		SIM_VAR_ENG_THROTTLE_LEVER_POS[THROTTLE_LEFT], "percent");
-
-	// throttle control 2
-	hr = SimConnect_AddToDataDefinition(hSimConnect, DEFINITION_THROTTLE_2,
-		SIM_VAR_ENG_THROTTLE_LEVER_POS[THROTTLE_RIGHT], "percent");
+	// throttle controls 1 and 2, in ThrottleLevers order
+	for (unsigned int i = 0; i < THROTTLE_NUM; i++)
+		hr = SimConnect_AddToDataDefinition(hSimConnect, DEFINITION_THROTTLES,
+			SIM_VAR_ENG_THROTTLE_LEVER_POS[i], "percent");
 
 	// PMDG 777 specific
 	hr = SimConnect_MapClientDataNameToID(hSimConnect, PMDG_777X_DATA_NAME, PMDG_777X_DATA_ID);
@@ -327,23 +449,17 @@ static void CALLBACK MyDispatchProcTC(SIMCONNECT_RECV* pData, DWORD cbData, void
             SIMCONNECT_RECV_SIMOBJECT_DATA *pObjData = (SIMCONNECT_RECV_SIMOBJECT_DATA*) pData;
             
             switch(pObjData->dwRequestID) {
-                case REQUEST_THROTTLE_1:
+                case REQUEST_THROTTLES:
                 {
 					if (tc.is_AT_engaged) {
-						tc.throttle_level[0] = *((double*)&pObjData->dwData);
-						LogV("SCThread: REQUEST_THROTTLE_1 received, throttle = %2.1f\n", *((double*)&pObjData->dwData));
+						ThrottleLevers* levers = (ThrottleLevers*)&pObjData->dwData;
+						for (unsigned int i = 0; i < THROTTLE_NUM; i++)
+							tc.throttle_level[i] = levers->throttle_level[i];
+						LogV("SCThread: REQUEST_THROTTLES received, throttle = %2.1f %2.1f\n",
+							levers->throttle_level[0], levers->throttle_level[1]);
 					}
 					break;
                 }
-				
-				case REQUEST_THROTTLE_2:
-				{
-					if (tc.is_AT_engaged) {
-						tc.throttle_level[1] = *((double*)&pObjData->dwData);
-						LogV("SCThread: REQUEST_THROTTLE_2 received, throttle = %2.1f\n", *((double*)&pObjData->dwData));
-					}
-					break;
-				}
 
                 default:
                    break;
@@ -362,6 +478,8 @@ static void CALLBACK MyDispatchProcTC(SIMCONNECT_RECV* pData, DWORD cbData, void
 					//if (tc.reverse_thrust)
 					//	tc.speed_brake = pS->FCTL_Speedbrake_Lever;
 					
+					bool was_AT_engaged = tc.is_AT_engaged;
+
 					if (pS->MCP_AT_Sw_Pushed)
 						tc.is_AT_engaged = true;
 
@@ -370,6 +488,10 @@ static void CALLBACK MyDispatchProcTC(SIMCONNECT_RECV* pData, DWORD cbData, void
 					else
 						tc.is_AT_engaged = false;
 
+					// follow the A/T lever positions while it is engaged, however it got engaged
+					if (tc.is_AT_engaged != was_AT_engaged)
+						hr = setRequestLeverFrequency(tc.is_AT_engaged ? SIMCONNECT_PERIOD_SIM_FRAME : SIMCONNECT_PERIOD_NEVER);
+
 					LogV("SCThread: AT: %d", tc.is_AT_engaged);
 
 					break;
@@ -393,6 +515,7 @@ static void CALLBACK MyDispatchProcTC(SIMCONNECT_RECV* pData, DWORD cbData, void
 						hr = setRequestLeverFrequency(SIMCONNECT_PERIOD_ONCE);
 						hr = SimConnect_RequestSystemState(hSimConnect, REQUEST_AIR_PATH, EVENT_NAME_AIRCRAFT_LOADED);
 						sim_start = true;
+						invalidateSentChannels();
 						Log("SCThread: Sim Starts.\n");
 					} else {
 						sim_start = false;
@@ -464,6 +587,7 @@ static void CALLBACK MyDispatchProcTC(SIMCONNECT_RECV* pData, DWORD cbData, void
 			{
 				if (strstr(evt->szString, "PMDG 777") != NULL) {
 					aircraft_loaded = true;
+					invalidateSentChannels();
 					Log("SCThread: Aircraft Loaded.\n");
 				} else {
 					aircraft_loaded = false;
@@ -493,10 +617,22 @@ static void CALLBACK MyDispatchProcTC(SIMCONNECT_RECV* pData, DWORD cbData, void
     }
 }
 
+// handle every SimConnect message queued so far
+static void dispatchAll() {
+	SIMCONNECT_RECV* pData;
+	DWORD cbData;
+
+	while (SUCCEEDED(SimConnect_GetNextDispatch(hSimConnect, &pData, &cbData)))
+		MyDispatchProcTC(pData, cbData, NULL);
+}
+
 static void ThrottleControl(volatile SharedStruct& sharedst) {
     HRESULT hr;
+
+	// signaled by SimConnect when a message is queued for us
+	notifier_t sim_event = notifier_create();
 	
-	if (SUCCEEDED(SimConnect_Open(&hSimConnect, "Throttle Control", NULL, 0, 0, 0)))
+	if (SUCCEEDED(SimConnect_Open(&hSimConnect, "Throttle Control", NULL, 0, sim_event, 0)))
 	{
 		Log("\nSCThread: Connected to Prepar3D!\n");
 
@@ -516,19 +652,34 @@ static void ThrottleControl(volatile SharedStruct& sharedst) {
 
 		Log("SCThread: Done SimConnect Thread Initialization!\n");
 
+		// sleep until the sim or the device has something new, or a held-back write is due
+		const notifier_t wake_up[2] = { sim_event, sharedst.device_updated };
+
         while(quit == false) {
+			send_deferred = false;
+			dispatchAll();
+			if (quit)
+				break;
+
+			// forward what just arrived from the sim before sleeping again
+			publishSimSample(tc, sharedst);
 			if (sim_running) {
 				syncDataWithSharedStruct(tc, sharedst);
 				setDataOnAircraft();
 			}
-			SimConnect_CallDispatch(hSimConnect, MyDispatchProcTC, NULL);
-            Sleep(1);
+
+			unsigned long wait_ms = send_deferred ? (unsigned long)MIN_SEND_INTERVAL.count() : SC_IDLE_WAIT_MS;
+			notifier_wait_any(wake_up, 2, wait_ms);
 		} 
 
+        Log("SCThread: SimConnect lever writes: %llu sent, %llu suppressed\n", writes_sent, writes_suppressed);
+
         hr = SimConnect_Close(hSimConnect);
 	} else {
 		Err("\nSCThread: Error on SimConnect_Open().\n");
 	}
+
+	notifier_close(sim_event);
 }
 
 unsigned int __stdcall SCThread(void* data) {
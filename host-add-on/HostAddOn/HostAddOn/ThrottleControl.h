@@ -1,6 +1,10 @@
 #pragma once
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#define __stdcall
+#endif
 
 // SimConnect Thread wrapper function
 unsigned int __stdcall SCThread(void* data);
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include "TrajectoryPlanner.h"
+#include "ASDFProtocol.h"
+
+#include <math.h>
+
+// a target the sim has not moved for this many of its publish intervals is at rest
+#define TARGET_REST_INTERVALS	(2)
+#define TARGET_REST_MIN_US		(30000)
+
+struct TrajAxis {
+	// segment the device is running: from start_pos at start_us to end_pos at end_us, then at rest
+	double start_pos;
+	double end_pos;
+	unsigned long long start_us;
+	unsigned long long end_us;
+
+	// sim target
+	double target;
+	double target_rate;				// ASDF units/s; 0 until two moves agree on it
+	double last_rate;				// rate between the last two targets
+	unsigned long long target_us;	// 0 => none yet
+	unsigned long long target_interval_us;
+};
+
+static TrajAxis axes[TRAJ_AXES];
+static unsigned long long segments = 0;
+static bool resend = false;		// see traj_resend()
+
+static double clamp(double v, double lo, double hi) {
+	return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// position the device is commanded to at @t
+static double axis_position(const TrajAxis& a, unsigned long long t) {
+	if (t >= a.end_us)
+		return a.end_pos;
+	if (t <= a.start_us)
+		return a.start_pos;
+	return a.start_pos + (a.end_pos - a.start_pos) * (double)(t - a.start_us) / (double)(a.end_us - a.start_us);
+}
+
+// commanded velocity at @t
+static double axis_velocity(const TrajAxis& a, unsigned long long t) {
+	if (t >= a.end_us || t < a.start_us)
+		return 0;
+	return (a.end_pos - a.start_pos) * 1e6 / (double)(a.end_us - a.start_us);
+}
+
+// the sim's target rate at @now_us; 0 once the sim has stopped moving it
+static double axis_target_rate(const TrajAxis& a, unsigned long long now_us) {
+	unsigned long long rest_us = TARGET_REST_INTERVALS * a.target_interval_us;
+	if (rest_us < TARGET_REST_MIN_US)
+		rest_us = TARGET_REST_MIN_US;
+	return now_us - a.target_us > rest_us ? 0 : a.target_rate;
+}
+
+void traj_reset(const unsigned short* lever_pos, unsigned long long now_us) {
+	for (unsigned int i = 0; i < TRAJ_AXES; i++) {
+		TrajAxis& a = axes[i];
+		a.start_pos = a.end_pos = lever_pos[i];
+		a.start_us = a.end_us = now_us;
+		a.target = lever_pos[i];
+		a.target_rate = a.last_rate = 0;
+		a.target_us = 0;
+		a.target_interval_us = 0;
+	}
+	resend = false;
+}
+
+void traj_target(const unsigned short* target, unsigned long long target_us) {
+	for (unsigned int i = 0; i < TRAJ_AXES; i++) {
+		TrajAxis& a = axes[i];
+		if (a.target_us != 0 && target_us <= a.target_us)
+			continue;	// seen already
+
+		if (a.target_us != 0) {
+			// a single jump is a new target, not a rate: trust the slower of the last two moves,
+			// and only if they agree in direction
+			a.target_interval_us = target_us - a.target_us;
+			double rate = (target[i] - a.target) * 1e6 / (double)a.target_interval_us;
+			if (rate * a.last_rate > 0)
+				a.target_rate = fabs(rate) < fabs(a.last_rate) ? rate : a.last_rate;
+			else
+				a.target_rate = 0;
+			a.target_rate = clamp(a.target_rate, -TRAJ_MAX_VELOCITY, TRAJ_MAX_VELOCITY);
+			a.last_rate = rate;
+		}
+		a.target = target[i];
+		a.target_us = target_us;
+	}
+}
+
+bool traj_plan(unsigned long long now_us, unsigned long long next_send_us, TrajSegment& seg) {
+	static const double T = TRAJ_SEGMENT_US / 1e6;
+	bool send = resend;
+	double pos[TRAJ_AXES];
+	double end[TRAJ_AXES];
+
+	for (unsigned int i = 0; i < TRAJ_AXES; i++) {
+		const TrajAxis& a = axes[i];
+		double p = axis_position(a, now_us);
+		double v = axis_velocity(a, now_us);
+
+		// where the target will be when the next segment ends
+		double rate = axis_target_rate(a, now_us);
+		double ahead_s = a.target_us == 0 ? 0 : (double)(now_us + TRAJ_SEGMENT_US - a.target_us) / 1e6;
+		double goal = clamp(a.target + rate * ahead_s, 0, ASDF_LEVER_MAX);
+
+		// get there in one segment if the limits allow; brake in time to stop on it otherwise.
+		// speed only changes between segments, so braking from v takes v^2/2a + vT/2
+		double v_next = (goal - p) / T;
+		double half_dv = TRAJ_MAX_ACCEL * T / 2;
+		double v_stop = sqrt(2.0 * TRAJ_MAX_ACCEL * fabs(goal - p) + half_dv * half_dv) - half_dv + fabs(rate);
+		v_next = clamp(v_next, -v_stop, v_stop);
+		v_next = clamp(v_next, v - TRAJ_MAX_ACCEL * T, v + TRAJ_MAX_ACCEL * T);
+		v_next = clamp(v_next, -TRAJ_MAX_VELOCITY, TRAJ_MAX_VELOCITY);
+		pos[i] = p;
+		end[i] = clamp(p + v_next * T, 0, ASDF_LEVER_MAX);
+
+		// the current segment runs out with the lever still to move
+		bool at_rest = rate == 0 && fabs(goal - a.end_pos) <= TRAJ_DEADBAND;
+		if (a.end_us <= next_send_us + TRAJ_SEND_AHEAD_US && !at_rest)
+			send = true;
+
+		// the current segment strays from the new plan
+		if (a.end_us > now_us) {
+			double planned = p + v_next * (double)(a.end_us - now_us) / 1e6;
+			if (fabs(planned - a.end_pos) > TRAJ_TOLERANCE)
+				send = true;
+		}
+	}
+
+	if (!send)
+		return false;
+
+	for (unsigned int i = 0; i < TRAJ_AXES; i++) {
+		TrajAxis& a = axes[i];
+		seg.end[i] = (unsigned short)lround(end[i]);
+		a.start_pos = pos[i];
+		a.end_pos = seg.end[i];
+		a.start_us = now_us;
+		a.end_us = now_us + TRAJ_SEGMENT_US;
+	}
+	seg.duration_ms = TRAJ_SEGMENT_US / 1000;
+	segments++;
+	resend = false;
+	return true;
+}
+
+void traj_resend() {
+	resend = true;
+}
+
+unsigned long long traj_segments() {
+	return segments;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+// A/T lever trajectory planner
+// Turns the throttle targets SCThread publishes into velocity- and acceleration-limited motion
+// and hands it to the device as short linear segments (CMD_LVR_MOVE) instead of a set-point every
+// cycle. Each segment aims where the target will be when it ends, extrapolated from the sim's
+// rate of change, and a new one is only planned when the current one runs out or strays from the
+// target. Positions are ASDF units [0,ASDF_LEVER_MAX]; times are shared_clock_us() values.
+
+#define TRAJ_AXES	(2)		// throttle 1, throttle 2
+
+// motion limits, ASDF units per second (squared)
+#define TRAJ_MAX_VELOCITY	(1536)	// ~40% of full travel per second
+#define TRAJ_MAX_ACCEL		(6144)	// full speed in 0.25 s
+
+// length of a segment
+#define TRAJ_SEGMENT_US		(100000)
+
+// a segment is followed on this long before it runs out, to cover the round trip
+#define TRAJ_SEND_AHEAD_US	(20000)
+
+// path error (ASDF units) that makes the planner replace a segment before it runs out
+#define TRAJ_TOLERANCE		(24)
+
+// distance to a target at rest (ASDF units) left alone; 0.1% of full travel
+#define TRAJ_DEADBAND		(4)
+
+struct TrajSegment {
+	unsigned short end[TRAJ_AXES];	// throttle positions at the end of the segment
+	unsigned short duration_ms;		// from the device receiving it
+};
+
+/* start at rest at @lever_pos (throttle 1, throttle 2), e.g. the measured levers as A/T takes them */
+void traj_reset(const unsigned short* lever_pos, unsigned long long now_us);
+
+/* the sim's latest A/T targets @target (throttle 1, throttle 2), published at @target_us */
+void traj_target(const unsigned short* target, unsigned long long target_us);
+
+/**
+ *	@now_us: current time
+ *	@next_send_us: next chance to send a segment after this one
+ *	@seg: the segment to send
+ *
+ *	Plan the motion from @now_us on. Returns true if @seg must go out now, i.e. the current
+ *	segment runs out before @next_send_us or strays from the target by TRAJ_TOLERANCE.
+ **/
+bool traj_plan(unsigned long long now_us, unsigned long long next_send_us, TrajSegment& seg);
+
+/* the last segment may not have reached the device (lost, or the device was reset); the next
+ * traj_plan() sends one whatever the path */
+void traj_resend();
+
+/* # of segments planned since start */
+unsigned long long traj_segments();
@@ -1,22 +1,40 @@
 #pragma once
 
 #include <stdio.h>
+#include "AsyncLog.h"
 
 // debug utilities
+// Log/Err/LogV queue their message and return; formatting and console I/O happen on the
+// log thread (see AsyncLog.h). Call log_flush() before output that must follow them.
+// Messages above LOG_LEVEL compile to nothing; #define VERBOSE before including this
+// header to enable LogV in one file.
 
 #define DEBUG
 //#define VERBOSE
 
+#ifndef LOG_LEVEL
+#ifdef VERBOSE
+#define LOG_LEVEL	LOG_LEVEL_VERBOSE
+#else
+#define LOG_LEVEL	LOG_LEVEL_INFO
+#endif	// VERBOSE
+#endif	// LOG_LEVEL
+
 #ifdef DEBUG
 
-#define Log(fmt, ...) fprintf(stdout, fmt, __VA_ARGS__)
-#define Err(fmt, ...) fprintf(stderr, fmt, __VA_ARGS__)
+#define Err(fmt, ...) log_write(LOG_LEVEL_ERR, fmt, ##__VA_ARGS__)
 
-#ifdef VERBOSE
-#define LogV(fmt, ...) fprintf(stdout, fmt, __VA_ARGS__)
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define Log(fmt, ...) log_write(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#else
+#define Log(fmt, ...)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_VERBOSE
+#define LogV(fmt, ...) log_write(LOG_LEVEL_VERBOSE, fmt, ##__VA_ARGS__)
 #else
 #define LogV(fmt, ...)
-#endif	// VERBOSE
+#endif
 
 #else
 
@@ -24,4 +42,4 @@
 #define Err(fmt, ...) 
 #define LogV(fmt, ...)
 
-#endif	// DEBUG
\ No newline at end of file
+#endif	// DEBUG
@@ -7,6 +7,7 @@
 #include "DeviceControl.h"
 #include "ASDFProtocol.h"
 #include "SharedStruct.h"
+#include "LatencyStats.h"
 #include "debug.h"
 
 SharedStruct sharedst;
@@ -24,6 +25,9 @@ int __cdecl _tmain(int argc, _TCHAR* argv[])
 	CloseHandle(myHandle[1]);
 
 	Log("HostAddOn Main Thread: TQThread and SCThread quit.\n");
+	log_flush();
+	latency_print();
+	asdf_link_print();
 	system("pause");
 
 	return 0;
@@ -0,0 +1,158 @@
+// SCThreadTest.cpp : Test Program to run SCThread against the fake SimConnect server, without Prepar3D.
+//
+// A device thread plays TQThread: it publishes lever samples (a slow ramp) into SharedStruct and
+// follows the A/T targets SCThread publishes back. The fake sim plays its scenario script; at the
+// end both directions are matched up to report message rates and end-to-end latencies.
+// With $ASDF_PORT set, the real TQThread talks to that port (e.g. a DeviceEmulator pty) instead;
+// only the per-stage latency histograms apply then.
+//     g++ -std=c++17 -O2 -IHostAddOn/HostAddOn -IHostAddOn/FakeSimConnect -IHostAddOn/inc/PMDG HostAddOn/SCThreadTest/SCThreadTest.cpp HostAddOn/FakeSimConnect/FakeSimConnect.cpp HostAddOn/HostAddOn/ThrottleControl.cpp HostAddOn/HostAddOn/DeviceControl.cpp HostAddOn/HostAddOn/PollScheduler.cpp HostAddOn/HostAddOn/TrajectoryPlanner.cpp HostAddOn/HostAddOn/PeriodicTask.cpp HostAddOn/HostAddOn/ASDFProtocol.cpp HostAddOn/HostAddOn/ASDFFrame.cpp HostAddOn/HostAddOn/ASDFSerialPosix.cpp HostAddOn/HostAddOn/SharedStruct.cpp HostAddOn/HostAddOn/Notifier.cpp HostAddOn/HostAddOn/LatencyStats.cpp HostAddOn/HostAddOn/AsyncLog.cpp -pthread -o SCThreadTest
+//     ./SCThreadTest [script [device_rate_hz [frame_rate]]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SharedStruct.h"
+#include "ThrottleControl.h"
+#include "DeviceControl.h"
+#include "FakeSimConnect.h"
+#include "LatencyStats.h"
+
+#include "debug.h"
+
+using namespace std;
+
+// throttle step of the device ramp per sample, percent
+static const double DEVICE_RAMP_STEP = 0.02;
+
+SharedStruct sharedst;
+
+// device samples by throttle value, and sim samples as the device saw them
+static map<double, vector<unsigned long long>> device_published;	// throttle level -> publish times (us)
+static vector<FakeThrottleRecord> device_seen;				// A/T targets -> time TQThread side read them
+
+// play TQThread: publish a ramp while the pilot has the levers, follow the targets while A/T has them
+static void DeviceThread(unsigned int rate_hz) {
+	auto period = chrono::microseconds(1000000 / rate_hz);
+	auto next = chrono::steady_clock::now();
+	unsigned long long sim_version = 0;
+	double ramp = 10;
+
+	while (sharedst.quit == false) {
+		SimSample sim;
+		unsigned long long version = sharedst.sim.load(sim);
+		unsigned long long now = shared_clock_us();
+		if (version != sim_version) {
+			sim_version = version;
+			if (sim.is_AT_engaged)
+				device_seen.push_back({ now, { sim.throttle_level[0], sim.throttle_level[1] } });
+		}
+
+		DeviceSample sample;
+		if (sim.is_AT_engaged) {
+			// the motor is instant here; report the targets as measured
+			sample.throttle_level[THROTTLE_LEFT] = sim.throttle_level[THROTTLE_LEFT];
+			sample.throttle_level[THROTTLE_RIGHT] = sim.throttle_level[THROTTLE_RIGHT];
+		} else {
+			ramp = ramp + DEVICE_RAMP_STEP < 100 ? ramp + DEVICE_RAMP_STEP : 10;
+			sample.throttle_level[THROTTLE_LEFT] = ramp;
+			sample.throttle_level[THROTTLE_RIGHT] = ramp;
+		}
+		device_published[sample.throttle_level[THROTTLE_LEFT]].push_back(now);
+		sample.sampled_us = now;
+		sample.timestamp_us = now;
+		sharedst.device.store(sample);
+		notifier_signal(sharedst.device_updated);
+
+		next += period;
+		this_thread::sleep_until(next);
+	}
+}
+
+// print count, median, 99th percentile and max of @lat_us
+static void printLatency(const char* name, vector<unsigned long long>& lat_us) {
+	if (lat_us.empty()) {
+		cout << name << ": no samples" << endl;
+		return;
+	}
+
+	sort(lat_us.begin(), lat_us.end());
+	cout << name << ": " << lat_us.size() << " samples, p50 " << lat_us[lat_us.size() / 2]
+		<< " us, p99 " << lat_us[lat_us.size() * 99 / 100] << " us, max " << lat_us.back() << " us" << endl;
+}
+
+static void SCThreadTest(const char* script, unsigned int device_rate_hz, unsigned int frame_rate) {
+	fake_sc_set_script(script);
+	fake_sc_set_frame_rate(frame_rate);
+
+	auto start = chrono::steady_clock::now();
+	thread scthread(SCThread, &sharedst);
+	thread device;
+	if (getenv("ASDF_PORT") != NULL)
+		device = thread(TQThread, &sharedst);
+	else
+		device = thread(DeviceThread, device_rate_hz);
+	scthread.join();
+	device.join();
+	chrono::duration<double> elapsed_sec = chrono::steady_clock::now() - start;
+
+	FakeSimConnectStats stats;
+	vector<FakeThrottleRecord> writes, reports;
+	fake_sc_get_stats(stats);
+	fake_sc_get_throttle_writes(writes);
+	fake_sc_get_throttle_reports(reports);
+
+	// device -> sim: last publish of a lever value to the SetDataOnSimObject() carrying it
+	vector<unsigned long long> to_sim;
+	for (const FakeThrottleRecord& w : writes) {
+		auto pub = device_published.find(w.throttle_level[0]);
+		if (pub == device_published.end())
+			continue;
+		auto after = upper_bound(pub->second.begin(), pub->second.end(), w.time_us);
+		if (after != pub->second.begin())
+			to_sim.push_back(w.time_us - *(after - 1));
+	}
+
+	// sim -> device: a throttle report queued by the sim to the device side reading it as A/T target
+	vector<unsigned long long> to_device;
+	size_t next_seen = 0;
+	for (const FakeThrottleRecord& r : reports) {
+		// reports while A/T is off never reach the device; skip them without losing our place
+		for (size_t i = next_seen; i < device_seen.size(); i++) {
+			if (device_seen[i].time_us >= r.time_us &&
+				device_seen[i].throttle_level[0] == r.throttle_level[0] &&
+				device_seen[i].throttle_level[1] == r.throttle_level[1]) {
+				to_device.push_back(device_seen[i].time_us - r.time_us);
+				next_seen = i + 1;
+				break;
+			}
+		}
+	}
+
+	log_flush();
+	cout << endl << "Ran " << elapsed_sec.count() << " s, " << stats.frames << " sim frames, device at " << device_rate_hz << " Hz" << endl;
+	cout << "Sim -> SCThread: " << stats.messages << " messages (" << stats.messages / elapsed_sec.count() << "/s), "
+		<< stats.dispatched << " dispatched, " << stats.exceptions << " exceptions" << endl;
+	cout << "SCThread -> sim: " << stats.set_data << " throttle writes (" << stats.set_data / elapsed_sec.count() << "/s), "
+		<< stats.client_events << " client events" << endl;
+	printLatency("Device -> sim latency", to_sim);
+	printLatency("Sim -> device latency", to_device);
+	latency_print();
+}
+
+// usage: SCThreadTest [script [device_rate_hz [frame_rate]]]; "-" runs the built-in script
+int main(int argc, char* argv[]) {
+	const char* script = argc > 1 && string(argv[1]) != "-" ? argv[1] : NULL;
+	unsigned int device_rate_hz = argc > 2 ? (unsigned int)atoi(argv[2]) : 500;
+	unsigned int frame_rate = argc > 3 ? (unsigned int)atoi(argv[3]) : 60;
+
+	SCThreadTest(script, device_rate_hz ? device_rate_hz : 500, frame_rate);
+	return 0;
+}
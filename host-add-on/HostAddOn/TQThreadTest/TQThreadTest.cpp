@@ -1,21 +1,27 @@
 // TQThreadTest.cpp : Test Program to launch TQThread in a standalone program.
 
-#include <windows.h>
-#include <process.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
 #include <iostream>
 #include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "SharedStruct.h"
 #include "DeviceControl.h"
 #include "ASDFProtocol.h"
+#include "LatencyStats.h"
+#include "PeriodicTask.h"
 
 #include "debug.h"
 
 using namespace std;
 
 #define TEST_HEADER	do {	\
-	Log("\nStarting Test: " __FUNCTION__ "\n");	\
+	Log("\nStarting Test: %s\n", __FUNCTION__);	\
+	log_flush();	\
 } while (0)
 
 #define TEST_PASS do {	\
@@ -26,19 +32,34 @@ using namespace std;
 	Err("Test Failed!");	\
 } while (0)
 
+#ifdef _WIN32
 static const char* PORT_NAME = "\\\\.\\COM6";
-static const unsigned long BAUD_RATE = CBR_115200;
+#else
+static const char* PORT_NAME = "/dev/ttyACM0";	// overridden by $ASDF_PORT
+#endif
+static const unsigned long BAUD_RATE = 115200;
+
+// serial port to test against; $ASDF_PORT lets Linux benches point at a pty
+static const char* port_name() {
+#ifndef _WIN32
+	if (getenv("ASDF_PORT") != NULL)
+		return getenv("ASDF_PORT");
+#endif
+	return PORT_NAME;
+}
 
 SharedStruct sharedst;
 
-static unsigned int __stdcall TQThreadSnooper(void* data) {
+static unsigned int TQThreadSnooper(void* data) {
 	Log("TQThreadSnooper Thread Starts.\n");
 
 	volatile SharedStruct& sharedst = *((SharedStruct*)data);
 
 	while (sharedst.quit == false) {
+		log_flush();
 		printSharedStruct(sharedst);
-		Sleep(2000);
+		latency_print();
+		this_thread::sleep_for(chrono::milliseconds(2000));
 	}
 
 	Log("TQThreadSnooper Thread Ends.\n");
@@ -48,16 +69,12 @@ static unsigned int __stdcall TQThreadSnooper(void* data) {
 static void TQThreadTest() {
 	TEST_HEADER;
 
-	HANDLE tqthread, debug_printer;
-	tqthread = (HANDLE)_beginthreadex(0, 0, TQThread, &sharedst, 0, 0);
-	debug_printer = (HANDLE)_beginthreadex(0, 0, TQThreadSnooper, &sharedst, 0, 0);
+	thread tqthread(TQThread, &sharedst);
+	thread debug_printer(TQThreadSnooper, &sharedst);
 
 	Log("HostAddOn Main Thread: TQThread start.\n");
-	WaitForSingleObject(tqthread, INFINITE);
-	WaitForSingleObject(debug_printer, INFINITE);
-
-	CloseHandle(tqthread);
-	CloseHandle(debug_printer);
+	tqthread.join();
+	debug_printer.join();
 
 	Log("HostAddOn Main Thread: TQThread quit.\n");
 }
@@ -77,12 +94,26 @@ static void test_CMD_RESET() {
 static void test_CMD_POLL() {
 	TEST_HEADER;
 
-	unsigned char lever_pos[3];
+	unsigned short lever_pos[3];
 	unsigned char btn_status;
 	Log("CMD_POLL Response: %d\n", cmd_poll(lever_pos, &btn_status));
 	// TODO: check poll results?
 }
 
+// poll in both lever modes; the positions should agree to within a 7-bit step
+static void test_CMD_MODE() {
+	TEST_HEADER;
+
+	unsigned short lever_pos[3];
+	unsigned char btn_status;
+	unsigned char modes[] = { ASDF_MODE_12BIT, ASDF_MODE_7BIT, ASDF_MODE_12BIT };
+	for (unsigned char mode : modes) {
+		Log("CMD_MODE Response: %d\n", cmd_mode(mode));
+		if (cmd_poll(lever_pos, &btn_status) == ASDF_OK)
+			Log("CMD_POLL in mode %u: %u %u %u\n", asdf_lever_mode(), lever_pos[0], lever_pos[1], lever_pos[2]);
+	}
+}
+
 static void test_CMD_LVR_RELS() {
 	TEST_HEADER;
 
@@ -92,7 +123,7 @@ static void test_CMD_LVR_RELS() {
 static void test_CMD_LVR_SET() {
 	TEST_HEADER;
 
-	unsigned char values[3] = {10, 20, 30};
+	unsigned short values[3] = {400, 800, 1200};
 
 	// loop through all possible bitmasks
 	for (unsigned char bitmask = 0; bitmask <= 0b111; bitmask++) {
@@ -100,11 +131,34 @@ static void test_CMD_LVR_SET() {
 	}
 }
 
+static void test_CMD_POLL_SET() {
+	TEST_HEADER;
+
+	unsigned short values[2] = {1600, 2000};
+	unsigned short lever_pos[3];
+	unsigned char btn_status;
+	Log("CMD_POLL_SET Response: %d\n", cmd_poll_set(values, lever_pos, &btn_status));
+	Log("CMD_LVR_RELS Response: %d\n", cmd_lvr_rels());
+}
+
+static void test_CMD_LVR_MOVE() {
+	TEST_HEADER;
+
+	unsigned short values[2] = {1600, 2000};
+	unsigned short lever_pos[3];
+	unsigned char btn_status;
+	Log("CMD_LVR_MOVE Response: %d\n", cmd_lvr_move(values, 500, lever_pos, &btn_status));
+	asdf_sleep_ms(3000);	// the motor may lag the segment
+	Log("CMD_POLL Response: %d\n", cmd_poll(lever_pos, &btn_status));
+	Log("Throttles after the segment: %u %u\n", lever_pos[1], lever_pos[2]);
+	Log("CMD_LVR_RELS Response: %d\n", cmd_lvr_rels());
+}
+
 // test all ASDF commands
 static void testASDFCommands() {
 	TEST_HEADER;
 
-	asdf_init_serial(PORT_NAME, BAUD_RATE);
+	asdf_init_serial(port_name(), BAUD_RATE);
 
 	unsigned char garbage;
 	unsigned long gbg_size_read;
@@ -113,34 +167,61 @@ static void testASDFCommands() {
 	test_CMD_RESET();
 	test_CMD_ASDF();
 	test_CMD_POLL();
+	test_CMD_MODE();
 	test_CMD_LVR_SET();
+	test_CMD_POLL_SET();
+	test_CMD_LVR_MOVE();
 
 	asdf_close_serial();
 }
 
 // recommand undefining DEBUG flag for perf tests
-static void PollTest(unsigned int num_tests) {
+// @depth: # of CMD_POLL kept in flight; 1 = stop-and-wait
+// @bits: lever resolution to poll at, 7 or 12 (see CMD_MODE)
+static void PollTest(unsigned int num_tests, unsigned int depth, unsigned int bits) {
 	TEST_HEADER;
 
-	unsigned char throttle_level[3];	// [0,1,2] = [speed brake, throttle 1, throttle 2]
+	unsigned short throttle_level[3];	// [0,1,2] = [speed brake, throttle 1, throttle 2]
 	unsigned char button_status;
 
-	asdf_init_serial(PORT_NAME, BAUD_RATE);
+	asdf_init_serial(port_name(), BAUD_RATE);
 	
 	unsigned char garbage;
 	unsigned long gbg_size_read;
 	asdf_serial_read_remaining(&garbage, 1, & gbg_size_read);
 
+	cmd_mode(bits == 7 ? ASDF_MODE_7BIT : ASDF_MODE_12BIT);
+	asdf_set_pipeline_depth(depth);
+
 	// start perf timer
 	auto start = chrono::steady_clock::now();
 
+	unsigned int num_sent = 0;
+	unsigned int num_failed = 0;
 	for (unsigned int i = 0; i < num_tests; i++) {
-		// read throttle levels and button status from device
-		cmd_poll(throttle_level, &button_status);
+		// keep the pipeline full
+		while (num_sent < num_tests && asdf_outstanding() < asdf_pipeline_depth()) {
+			cmd_poll_submit();
+			num_sent++;
+		}
 
-		// update button status in shared structure
-		sharedst.button_status[BUTTON_TOGA] = getButtonStatus(button_status, BUTTON_TOGA);
-		sharedst.button_status[BUTTON_AT_DISENGAGE] = getButtonStatus(button_status, BUTTON_AT_DISENGAGE);
+		// read throttle levels and button status from device
+		if (cmd_poll_recv(throttle_level, &button_status) != 0) {
+			num_failed++;
+			continue;
+		}
+
+		// publish the sample in shared structure
+		DeviceSample sample;
+		sample.speed_brake = asdf2sc(throttle_level[0]);
+		sample.throttle_level[THROTTLE_LEFT] = asdf2sc(throttle_level[1]);
+		sample.throttle_level[THROTTLE_RIGHT] = asdf2sc(throttle_level[2]);
+		sample.button_status[BUTTON_TOGA] = getButtonStatus(button_status, BUTTON_TOGA);
+		sample.button_status[BUTTON_AT_DISENGAGE] = getButtonStatus(button_status, BUTTON_AT_DISENGAGE);
+		sample.sampled_us = asdf_last_sent_us();
+		sample.timestamp_us = shared_clock_us();
+		sharedst.device.store(sample);
+		latency_record(LATENCY_POLL, sample.timestamp_us - sample.sampled_us);
 	}
 
 	// end perf timer
@@ -150,14 +231,293 @@ static void PollTest(unsigned int num_tests) {
 	asdf_close_serial();
 	
 	// print stats
+	log_flush();
+	cout << "Pipeline Depth: " << asdf_pipeline_depth() << endl;
+	cout << "Lever Mode: " << (asdf_lever_mode() == ASDF_MODE_12BIT ? "12-bit" : "7-bit") << endl;
 	cout << "Poll Rate: " << (double)num_tests / elapsed_sec.count() << " polls/sec" << endl;
+	cout << "Failed Polls: " << num_failed << endl;
+	asdf_link_print();
+	latency_print();
+}
+
+// stop-and-wait polls, recovering the device whenever one fails; run against a
+// DeviceEmulator with loss (-d) or hangs (-w) to see which recovery tiers kick in
+static void RecoverTest(unsigned int num_tests) {
+	TEST_HEADER;
+
+	unsigned short throttle_level[3];
+	unsigned char button_status;
+
+	asdf_init_serial(port_name(), BAUD_RATE);
+	asdf_set_pipeline_depth(1);
+
+	unsigned int num_failed = 0;
+	for (unsigned int i = 0; i < num_tests; i++) {
+		if (cmd_poll(throttle_level, &button_status) != 0) {
+			num_failed++;
+			asdf_recover();
+		}
+	}
+
+	asdf_close_serial();
+
+	log_flush();
+	cout << "Failed Polls: " << num_failed << " of " << num_tests << endl;
+	asdf_link_print();
+}
+
+// start TQThread, set quit at a random point up to @max_delay_ms later and time how long it takes
+// to return; run against a DeviceEmulator with hangs (-w) to catch it inside a transaction or recovery
+static void QuitTest(unsigned int num_tests, unsigned int max_delay_ms) {
+	TEST_HEADER;
+
+	unsigned long long max_us = 0;
+	unsigned long long total_us = 0;
+	for (unsigned int i = 0; i < num_tests; i++) {
+		sharedst.quit = false;
+		thread tqthread(TQThread, &sharedst);
+		this_thread::sleep_for(chrono::milliseconds(rand() % (max_delay_ms + 1)));
+
+		unsigned long long start_us = shared_clock_us();
+		sharedst.quit = true;
+		tqthread.join();
+		unsigned long long took_us = shared_clock_us() - start_us;
+
+		total_us += took_us;
+		if (took_us > max_us)
+			max_us = took_us;
+	}
+
+	log_flush();
+	cout << "Quit latency: avg " << (num_tests != 0 ? total_us / num_tests : 0) << " us, max " << max_us << " us" << endl;
+	asdf_link_print();
 }
 
-int main() {
-	//PollTest(4096);
-	TQThreadTest();
-	//testASDFCommands();
+// SharedStruct as it was before the per-direction cache line split: both directions share lines
+struct PackedSharedStruct {
+	SeqLock<DeviceSample> device;
+	SeqLock<SimSample> sim;
+	std::atomic<bool> quit = false;
+};
+
+/* one TQThread-like and one SCThread-like thread exchange samples through @st for @iterations
+ * device cycles at @rate_hz (0 = free-running); prints the mean cost of each side's shared accesses */
+template <typename S>
+static void runSharedBench(const char* layout, S& st, unsigned int iterations, unsigned int rate_hz) {
+	atomic<bool> done(false);
+	double tq_ns = 0, sc_ns = 0;
+	unsigned long long sc_cycles = 0;
+
+	auto period = chrono::nanoseconds(rate_hz ? 1000000000ULL / rate_hz : 0);
+
+	// device side: publish a sample, read the A/T targets
+	thread tq([&]() {
+		DeviceSample device;
+		SimSample sim;
+		auto next = chrono::steady_clock::now();
+		chrono::nanoseconds busy(0);
+		for (unsigned int i = 0; i < iterations; i++) {
+			auto start = chrono::steady_clock::now();
+			device.timestamp_us = i;
+			st.device.store(device);
+			st.sim.load(sim);
+			busy += chrono::steady_clock::now() - start;
+
+			if (rate_hz) {
+				next += period;
+				this_thread::sleep_until(next);
+			}
+		}
+		tq_ns = (double)busy.count() / iterations;
+		done = true;
+	});
+
+	// sim side: read the device sample, publish the targets
+	thread sc([&]() {
+		DeviceSample device;
+		SimSample sim;
+		auto next = chrono::steady_clock::now();
+		chrono::nanoseconds busy(0);
+		while (!done) {
+			auto start = chrono::steady_clock::now();
+			st.device.load(device);
+			sim.timestamp_us = sc_cycles;
+			st.sim.store(sim);
+			busy += chrono::steady_clock::now() - start;
+			sc_cycles++;
+
+			if (rate_hz) {
+				next += period;
+				this_thread::sleep_until(next);
+			}
+		}
+		sc_ns = sc_cycles ? (double)busy.count() / sc_cycles : 0;
+	});
+
+	tq.join();
+	sc.join();
+
+	cout << layout << ": device side " << tq_ns << " ns/cycle, sim side " << sc_ns << " ns/cycle ("
+		<< sc_cycles << " cycles)" << endl;
+}
+
+// compare shared struct layouts under cross-core traffic, free-running and at @rate_hz
+static void SharedBench(unsigned int iterations, unsigned int rate_hz) {
+	TEST_HEADER;
+
+	static PackedSharedStruct packed;
+	static SharedStruct aligned;
+
+	cout << "sizeof(PackedSharedStruct) = " << sizeof(PackedSharedStruct)
+		<< ", sizeof(SharedStruct) = " << sizeof(SharedStruct) << endl;
+
+	cout << "Free-running, " << iterations << " cycles:" << endl;
+	runSharedBench("  packed ", packed, iterations, 0);
+	runSharedBench("  aligned", aligned, iterations, 0);
+
+	if (rate_hz) {
+		unsigned int paced = iterations < rate_hz ? iterations : rate_hz;	// ~1 s
+		cout << "Paced at " << rate_hz << " Hz, " << paced << " cycles:" << endl;
+		runSharedBench("  packed ", packed, paced, rate_hz);
+		runSharedBench("  aligned", aligned, paced, rate_hz);
+	}
+}
+
+// print how far the intervals between the cycle starts in @start_us stray from @period_us
+static void printCycleJitter(const char* name, vector<unsigned long long>& start_us, unsigned long long period_us) {
+	vector<unsigned long long> err_us;
+	for (size_t i = 1; i < start_us.size(); i++) {
+		unsigned long long interval = start_us[i] - start_us[i - 1];
+		err_us.push_back(interval > period_us ? interval - period_us : period_us - interval);
+	}
+	if (err_us.empty())
+		return;
+
+	// drift: where the last cycle started relative to where a perfect cadence puts it
+	long long drift_us = (long long)(start_us.back() - start_us.front()) - (long long)((start_us.size() - 1) * period_us);
+	sort(err_us.begin(), err_us.end());
+	cout << name << ": period error p50 " << err_us[err_us.size() / 2] << " us, p99 " << err_us[err_us.size() * 99 / 100]
+		<< " us, max " << err_us.back() << " us; drift " << drift_us << " us over " << err_us.size() << " cycles" << endl;
+}
+
+// A/T servo loop (CMD_POLL_SET per cycle) at @rate_hz for @cycles, paced by absolute deadlines
+// (PeriodicTask) and then by a sleep after each cycle, as the loops used to be
+static void ServoTest(unsigned int rate_hz, unsigned int cycles) {
+	TEST_HEADER;
+
+	unsigned short values[2] = { 2000, 2000 };
+	unsigned short lever_pos[3];
+	unsigned char btn_status;
+	unsigned long long period_us = 1000000 / rate_hz;
+	vector<unsigned long long> start_us;
+
+	asdf_init_serial(port_name(), BAUD_RATE);
+	unsigned char garbage;
+	unsigned long gbg_size_read;
+	asdf_serial_read_remaining(&garbage, 1, &gbg_size_read);
+	latency_reset();
+
+	PeriodicTask task;
+	periodic_start(task, period_us, LATENCY_SERVO_WAKEUP);
+	for (unsigned int i = 0; i < cycles; i++) {
+		periodic_wait(task);
+		start_us.push_back(shared_clock_us());
+		cmd_poll_set(values, lever_pos, &btn_status);
+	}
+	periodic_stop(task);
+	log_flush();
+	printCycleJitter("deadline", start_us, period_us);
+
+	start_us.clear();
+	for (unsigned int i = 0; i < cycles; i++) {
+		start_us.push_back(shared_clock_us());
+		cmd_poll_set(values, lever_pos, &btn_status);
+		asdf_sleep_ms((unsigned long)(period_us / 1000));
+	}
+	log_flush();
+	printCycleJitter("sleep   ", start_us, period_us);
+
+	cmd_lvr_rels();
+	asdf_close_serial();
+	latency_print();
+}
+
+// A/T set-points drive both throttles across their travel until the pilot pushes one against the motor
+// (DeviceEmulator -o does) or @wait_ms pass; then the levers are released as TQThread does
+static void OverrideTest(unsigned int wait_ms) {
+	TEST_HEADER;
+
+	unsigned short lever_pos[3];
+	unsigned char btn_status;
+
+	asdf_init_serial(port_name(), BAUD_RATE);
+	unsigned char garbage;
+	unsigned long gbg_size_read;
+	asdf_serial_read_remaining(&garbage, 1, &gbg_size_read);
+	cmd_mode(ASDF_MODE_12BIT);
+
+	if (cmd_poll(lever_pos, &btn_status) != 0) {
+		TEST_FAIL;
+		asdf_close_serial();
+		return;
+	}
+	unsigned short values[2];
+	for (int i = 0; i < 2; i++)
+		values[i] = lever_pos[i + 1] < ASDF_LEVER_MAX / 2 ? ASDF_LEVER_MAX * 3 / 4 : ASDF_LEVER_MAX / 4;
+	Log("Driving the throttles to %u %u; push one against the motor.\n", values[0], values[1]);
+
+	auto start = chrono::steady_clock::now();
+	unsigned int setpoints = 0;
+	unsigned char levers = 0;
+	bool overridden = false;
+	while (!overridden && chrono::steady_clock::now() - start < chrono::milliseconds(wait_ms)) {
+		cmd_poll_set(values, lever_pos, &btn_status);
+		setpoints++;
+		overridden = asdf_pilot_override(&levers);
+		asdf_sleep_ms(10);
+	}
+	auto elapsed_ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+
+	if (overridden)
+		Log("Pilot override on levers 0x%02X after %lld ms, %u set-points; throttles at %u %u\n",
+			levers, (long long)elapsed_ms, setpoints, lever_pos[1], lever_pos[2]);
+	else
+		Log("No pilot override in %lld ms, %u set-points\n", (long long)elapsed_ms, setpoints);
+	Log("CMD_LVR_RELS Response: %d\n", cmd_lvr_rels());
+	asdf_close_serial();
+
+	if (overridden)
+		TEST_PASS;
+	else
+		TEST_FAIL;
+}
 
+// usage: TQThreadTest [poll [num_tests [depth [bits]]] | cmds | shared [iterations [rate_hz]] | servo [rate_hz [cycles]] | recover [num_tests] | quit [num_tests [max_delay_ms]] | override [wait_ms]];
+// runs TQThreadTest() by default
+int main(int argc, char* argv[]) {
+	string test = argc > 1 ? argv[1] : "";
+
+	if (test == "poll")
+		PollTest(argc > 2 ? (unsigned int)atoi(argv[2]) : 4096, argc > 3 ? (unsigned int)atoi(argv[3]) : 1,
+			argc > 4 ? (unsigned int)atoi(argv[4]) : 12);
+	else if (test == "cmds")
+		testASDFCommands();
+	else if (test == "shared")
+		SharedBench(argc > 2 ? (unsigned int)atoi(argv[2]) : 10000000, argc > 3 ? (unsigned int)atoi(argv[3]) : 1000);
+	else if (test == "recover")
+		RecoverTest(argc > 2 ? (unsigned int)atoi(argv[2]) : 1000);
+	else if (test == "quit")
+		QuitTest(argc > 2 ? (unsigned int)atoi(argv[2]) : 20, argc > 3 ? (unsigned int)atoi(argv[3]) : 5000);
+	else if (test == "servo")
+		ServoTest(argc > 2 ? (unsigned int)atoi(argv[2]) : 100, argc > 3 ? (unsigned int)atoi(argv[3]) : 1000);
+	else if (test == "override")
+		OverrideTest(argc > 2 ? (unsigned int)atoi(argv[2]) : 10000);
+	else
+		TQThreadTest();
+
+	log_flush();
+#ifdef _WIN32
 	system("pause");
+#endif
 	return 0;
 }
\ No newline at end of file
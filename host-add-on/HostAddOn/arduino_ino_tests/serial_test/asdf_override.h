@@ -0,0 +1,39 @@
+#pragma once
+
+// Pilot override detection
+// While the motors drive the levers, a pilot pushing against one shows up as its measured position
+// leaving the one the drive put it at. asdf_override_update() compares the two for each lever;
+// an error that reaches the trip threshold and stays above the clear threshold for trip_ms trips
+// the lever. The gap between the thresholds is the hysteresis: pot noise around the trip threshold
+// does not restart the debounce, and a short bump that falls back below clear is forgotten.
+// A tripped lever stays tripped until asdf_override_reset(), i.e. until the host releases the levers.
+// Plain C++ with no Arduino dependency, so it also builds natively (see asdf_parse_test_native.cpp).
+// Copy of firmware/asdf_parse/asdf_override.h, where it is tested; change both together.
+
+#define ASDF_OVERRIDE_MAX_LEVERS  (3)
+
+struct ASDFOverrideLever {
+  bool pending;                 // error above trip, debounce running
+  bool tripped;
+  unsigned long since_ms;       // when the error went above trip
+};
+
+struct ASDFOverride {
+  unsigned int trip;            // error that starts the debounce, in the caller's position units
+  unsigned int clear;           // error below which the debounce is abandoned; <= trip
+  unsigned int trip_ms;         // how long the error must stay above clear to trip
+  ASDFOverrideLever lever[ASDF_OVERRIDE_MAX_LEVERS];
+};
+
+/* thresholds @trip and @clear and debounce time @trip_ms; @clear is lowered to @trip if above it.
+ * Forgets all levers */
+void asdf_override_config(ASDFOverride& ovr, unsigned int trip, unsigned int clear, unsigned int trip_ms);
+
+/* forget pending and tripped levers, e.g. once the host released them or A/T takes them again */
+void asdf_override_reset(ASDFOverride& ovr);
+
+/* feed lever @i's position as driven (@expected) and as measured at @now_ms; true if this trips it */
+bool asdf_override_update(ASDFOverride& ovr, unsigned char i, long expected, long measured, unsigned long now_ms);
+
+/* bitmask of the tripped levers (bit i = lever i), as carried by ASDF_LVR_RELS_PILOT */
+unsigned char asdf_override_tripped(const ASDFOverride& ovr);
@@ -1,10 +1,15 @@
 #include <avr/wdt.h> 
 #include <Stepper.h>
+#include "asdf_override.h"
 
 // command codes
 #define CMD_RESET	 ((unsigned char) 0x80)
 #define CMD_POLL	 ((unsigned char) 0x81)
 #define CMD_LVR_RELS ((unsigned char) 0x83)
+#define CMD_STREAM	 ((unsigned char) 0x84)
+#define CMD_POLL_SET ((unsigned char) 0x85)
+#define CMD_MODE	 ((unsigned char) 0x86)
+#define CMD_LVR_MOVE ((unsigned char) 0x87)
 #define CMD_ASDF	 ((unsigned char) 0xFF)
 
 // CMD_LVR_SET command list
@@ -21,9 +26,25 @@ constexpr unsigned int CMD_LVR_SET_LIST[] = {0x82, 0x92, 0xA2, 0xB2, 0xC2, 0xD2,
 #define	ASDF_POLL_OK	((unsigned char) 0x02)
 
 // ASDF_LVR_RELS responses
-#define ASDF_LVR_RELS_PILOT	((unsigned char) 0x03)
+#define ASDF_LVR_RELS_PILOT	((unsigned char) 0x03)	// unsolicited: the pilot overrode the motors
 #define ASDF_LVR_RELS_RESP	((unsigned char) 0x83)
 
+// unsolicited lever/button report while streaming; same payload as ASDF_POLL_OK
+#define ASDF_STREAM_REPORT	((unsigned char) 0x04)
+
+// max time between two stream reports even if nothing moved (ms)
+#define STREAM_KEEPALIVE_MS	(500)
+
+// lever data formats (CMD_MODE data[0]); boots in MODE_7BIT
+#define MODE_7BIT	(0)		// one byte per lever [0,127]
+#define MODE_12BIT	(1)		// two bytes per lever, little-endian [0,4095]
+
+// ASDF v2 framing: SYNC | LEN | SEQ | CODE | DATA[LEN] | CRC-8 of LEN..DATA (see the host's ASDFFrame.h)
+#define FRAME_SYNC		((unsigned char) 0xA5)
+#define FRAME_MAX_DATA	(16)
+#define FRAME_OVERHEAD	(5)
+#define FRAME_MAX_SIZE	(FRAME_MAX_DATA + FRAME_OVERHEAD)
+
 enum throttle_idx_t {
 	THROTTLE_LEFT = 0,
 	THROTTLE_RIGHT = 1
@@ -34,32 +55,60 @@ enum button_idx_t {
 	BUTTON_AP_DISENGAGE = 1
 };
 
-// returns true if @b is a asdf command byte, and false if @b is a data byte
-#define isCommand(b) ((b) & 0x80)
-
 // return status of button @i, given bitmap @btmp
 #define getButtonStatus(btmp, i)	((btmp) & (0x1 << i))
 
 // generate button status bitmap for (@b0, @b1)
 #define ButtonStatus(b0, b1)	(((!(b1)) << 1) | (!(b0)))
 
-// lever and button status variables
-unsigned char speed_brake_level = 0;
-unsigned char throttle_level[2] = { 0, 0 };
+// lever and button status variables; lever positions are [0,MAX_LEVER] in either mode
+unsigned int speed_brake_level = 0;
+unsigned int throttle_level[2] = { 0, 0 };		// measured; or A/T target while A/T engaged
+unsigned int throttle_measured[2] = { 0, 0 };	// always measured
 unsigned char button_status = 0;	// button status bitmap; bit 0 -> button 0; bit 1 -> button 1
 
+// lever data format; see CMD_MODE
+unsigned char lever_mode = MODE_7BIT;
+
 // A/T mode
 unsigned char AT_Engaged = 0;
 
-// max value of ASDF data byte (0-127)
-#define MAX_ASDF	(0x7F)
+// pilot override: a throttle this far (MAX_LEVER units) from where its motor has stepped it for
+// OVERRIDE_TRIP_MS, never falling back under OVERRIDE_CLEAR, is held by the pilot; see asdf_override.h
+#define OVERRIDE_TRIP		(400)
+#define OVERRIDE_CLEAR		(200)
+#define OVERRIDE_TRIP_MS	(40)
+int motor_step[2] = { 0, 0 };		// where the motors have stepped the throttles (0~50)
+ASDFOverride pilot;					// levers as in a poll report: 1 and 2 are the throttles
+unsigned char override_levers = 0;	// bit i = lever i of a poll report; latched until CMD_LVR_RELS
+unsigned char last_seq = 0;			// sequence number of the last command answered
+
+// CMD_LVR_MOVE segment the A/T targets follow, while move_active
+unsigned char move_active = 0;
+unsigned int move_start[2] = { 0, 0 };
+unsigned int move_end[2] = { 0, 0 };
+unsigned long move_start_ms = 0;
+unsigned int move_duration_ms = 0;
+
+// streaming mode; see CMD_STREAM
+unsigned char stream_period_ms = 0;		// report period (ms); 0 => streaming off
+unsigned char stream_deadband = 0;		// min lever change to report, in lever_mode units; 0 => report every period
+unsigned long stream_check_ms = 0;		// last time the levers were checked for a report
+unsigned long stream_report_ms = 0;		// last time a report was sent
+unsigned int stream_last[4] = { 0 };	// last reported button status and lever positions, in lever_mode units
+unsigned char stream_seq = 0;			// sequence number of the next report
+
+// bytes received from the host but not parsed into a frame yet
+unsigned char rx_buf[FRAME_MAX_SIZE];
+unsigned char rx_size = 0;
+
+// max lever position; MODE_7BIT sends it scaled down to MAX_LEVER_7BIT
+#define MAX_LEVER		(4095)
+#define MAX_LEVER_7BIT	(127)
 
 // max value of analogRead() (0-1024 for Leonardo)
 #define MAX_ANALOG	(1 << 10)
 
-// normalize raw analog reads to asdf ranges ([0,1023] -> [0,127])
-//#define raw2asdf(val)	((unsigned char) ((val) * ((unsigned int) MAX_ASDF) / MAX_ANALOG))
-
 // SPEED/BREAK
 #define SB_POT A3
 #define SB_AIN1 8
@@ -89,6 +138,11 @@ unsigned char AT_Engaged = 0;
 // define all motors settings
 const int stepsPerRevolution = 200; // step size for 17HS4401
 
+// one step per motor at the 2.1 rpm set in setup(), so Stepper::step(1) finds its step delay over
+// and returns without waiting
+#define STEP_INTERVAL_MS	(143)
+unsigned long last_step_ms = 0;
+
 // initialize stepper motors
 //Stepper SB_Stepper(stepsPerRevolution, SB_AIN1, SB_AIN2, SB_BIN1, SB_BIN2);
 Stepper L_Stepper(stepsPerRevolution, L_AIN1, L_AIN2, L_BIN1, L_BIN2);
@@ -110,6 +164,18 @@ void haltMotor() {
 	digitalWrite(R_BIN2, HIGH);
 }
 
+// de-energize the throttle motors so the levers move freely
+void releaseMotor() {
+	digitalWrite(L_AIN1, LOW);
+	digitalWrite(L_AIN2, LOW);
+	digitalWrite(L_BIN1, LOW);
+	digitalWrite(L_BIN2, LOW);
+	digitalWrite(R_AIN1, LOW);
+	digitalWrite(R_AIN2, LOW);
+	digitalWrite(R_BIN1, LOW);
+	digitalWrite(R_BIN2, LOW);
+}
+
 int SB_min = 0;
 int TL_min = 0;
 int TR_min = 0;
@@ -120,9 +186,10 @@ int TR_max = 0;
 void setup() {
 	Serial.begin(115200);
 	Serial.setTimeout(1);
+	asdf_override_config(pilot, OVERRIDE_TRIP, OVERRIDE_CLEAR, OVERRIDE_TRIP_MS);
 	while (!Serial) {} // Wait for serial ready
 	delay(1000);
-	Serial.write(ASDF_RESET);	// report init complete
+	writeFrame(0, ASDF_RESET, NULL, 0);	// report init complete
 
 	// for debug purposes
 	// buttons
@@ -146,12 +213,24 @@ void setup() {
 }
 
 void loop() {
-	// move motors
-	if (AT_Engaged) {
+	// A/T targets along the current segment
+	if (move_active) {
+		unsigned long t = millis() - move_start_ms;
+		if (t >= move_duration_ms)
+			move_active = 0;
+		for (int i = 0; i < 2; i++)
+			throttle_level[i] = !move_active ? move_end[i] :
+				move_start[i] + ((long)move_end[i] - (long)move_start[i]) * (long)t / move_duration_ms;
+	}
+
+	// step each throttle motor toward its A/T target, one step per STEP_INTERVAL_MS; nothing here waits
+	if (AT_Engaged && millis() - last_step_ms >= STEP_INTERVAL_MS) {
+		last_step_ms = millis();
+
 		int throttle_level_l_curr = analogRead(L_POT);
 
 		// map input to range of motors' steps(0~50), assume range of the potentiometers start from 512
-		int throttle_level_l_step = map(throttle_level[0], 0, 128, 0, 50);
+		int throttle_level_l_step = map(throttle_level[0], 0, MAX_LEVER + 1, 0, 50);
 		int throttle_level_l_curr_step = map(throttle_level_l_curr, TL_max, TL_min, 0, 50);
 
 		int throttle_level_l_diff = PosTracking(throttle_level_l_step, throttle_level_l_curr_step);
@@ -159,41 +238,65 @@ void loop() {
 		int throttle_level_r_curr = analogRead(R_POT);
 
 		// map input to range of motors' steps(0~50), assume range of the potentiometers start from 512
-		int throttle_level_r_step = map(throttle_level[1], 0, 128, 0, 50);
+		int throttle_level_r_step = map(throttle_level[1], 0, MAX_LEVER + 1, 0, 50);
 		int throttle_level_r_curr_step = map(throttle_level_r_curr, TR_max, TR_min, 0, 50);
 
 		int throttle_level_r_diff = PosTracking(throttle_level_r_step, throttle_level_r_curr_step);
 
-		if (throttle_level_l_diff > 0)
+		if (throttle_level_l_diff > 0) {
 			L_Stepper.step(-1);
-		else if (throttle_level_l_diff < 0)
+			motor_step[0]++;
+		} else if (throttle_level_l_diff < 0) {
 			L_Stepper.step(1);
-		delay(100);
-		//L_Stepper.halt();
-		//if (throttle_level_r_diff > 0)
-		//	R_Stepper.step(1);
-		//else if (throttle_level_r_diff < 0)
-		//	R_Stepper.step(-1);
-		//delay(100);
-		//R_Stepper.halt();
+			motor_step[0]--;
+		}
+		if (throttle_level_r_diff > 0) {
+			R_Stepper.step(1);
+			motor_step[1]++;
+		} else if (throttle_level_r_diff < 0) {
+			R_Stepper.step(-1);
+			motor_step[1]--;
+		}
 	}
 	
-	speed_brake_level = map(analogRead(SB_POT), SB_min, SB_max, 0, 127);
+	speed_brake_level = constrain(map(analogRead(SB_POT), SB_min, SB_max, 0, MAX_LEVER), 0, MAX_LEVER);
+	throttle_measured[0] = constrain(map(analogRead(L_POT), TL_max, TL_min, 0, MAX_LEVER), 0, MAX_LEVER); // lever for L engine
+	throttle_measured[1] = constrain(map(analogRead(R_POT), TR_max, TR_min, 0, MAX_LEVER), 0, MAX_LEVER); // lever for R engine
+	if (AT_Engaged)
+		detectOverride();
 	if (!AT_Engaged) {
-		throttle_level[0] = map(analogRead(L_POT), TL_max, TL_min, 0, 127); // lever for L engine
-		throttle_level[1] = map(analogRead(R_POT), TR_max, TR_min, 0, 127); // lever for R engine
+		throttle_level[0] = throttle_measured[0];
+		throttle_level[1] = throttle_measured[1];
 	}
 	button_status = ButtonStatus(digitalRead(L_BUTTON) == HIGH ? 1 : 0, digitalRead(R_BUTTON) == HIGH ? 1 : 0);
 	
-	unsigned char input = 0;	// 0x00 is not a command
-	if (Serial.available())
-		input = Serial.read();
+	// push a report if streaming and due
+	if (stream_period_ms != 0 && millis() - stream_check_ms >= stream_period_ms) {
+		stream_check_ms = millis();
+		if (stream_deadband == 0 || streamChanged() || millis() - stream_report_ms >= STREAM_KEEPALIVE_MS)
+			sendStreamReport();
+	}
+
+	// run every command whose frame is complete
+	while (Serial.available()) {
+		rxPush(Serial.read());
+		while (rxFrameReady()) {
+			unsigned char len = rx_buf[1];
+			runCommand(rx_buf[2], rx_buf[3], rx_buf + 4, len);
+			rxDrop(len + FRAME_OVERHEAD);
+		}
+	}
+}
 
-	if (!isCommand(input))
+// execute command @cmd sent as @seq with @len data bytes; responses echo @seq
+void runCommand(unsigned char seq, unsigned char cmd, const unsigned char* data, unsigned char len) {
+	if (commandDataSize(cmd) != len) {
+		writeFrame(seq, ASDF_ERROR, NULL, 0);	// unrecognized command or wrong length
 		return;
-	
-	// input parser
-	switch (input) {
+	}
+	last_seq = seq;
+
+	switch (cmd) {
 		case CMD_RESET:
 		{
 			hardReset();
@@ -202,70 +305,286 @@ void loop() {
 		
 	    case CMD_POLL:
 		{
-			unsigned char resp_pkt[] = {
-				ASDF_POLL_OK,			// response code
-				button_status,			// button status
-				speed_brake_level & 0x7F,		// lever positions
-				throttle_level[0] & 0x7F,
-				throttle_level[1] & 0x7F
-			};
-			Serial.write(resp_pkt, sizeof(resp_pkt));	// send resposne packet to host
+			unsigned char report[7];
+			unsigned char size = leverReport(report);		// button status and lever positions
+			writeFrame(seq, ASDF_POLL_OK, report, size);	// send resposne packet to host
 			break;
 		}
 	
-	    case CMD_LVR_RELS:
+	    case CMD_POLL_SET:	// CMD_LVR_SET(0b011) and CMD_POLL in one round trip
 		{
-			AT_Engaged = 0;
-			// TODO: thrust lever release function
-			Serial.write(ASDF_LVR_RELS_RESP); // report release done
+			if (takeLevers()) {
+				move_active = 0;
+				throttle_level[0] = getLever(data);
+				throttle_level[1] = getLever(data + leverSize());
+			}
+
+			unsigned char report[7];
+			unsigned char size = leverReport(report);		// button status and measured lever positions
+			writeFrame(seq, ASDF_POLL_OK, report, size);
+			if (override_levers != 0)
+				sendPilotOverride();
 			break;
 		}
-	
-	    // CMD_LVR_SET cases
-	    case CMD_LVR_SET_LIST[0]:
-	    case CMD_LVR_SET_LIST[1]:
-	    case CMD_LVR_SET_LIST[2]:
-	    case CMD_LVR_SET_LIST[3]:
-	    case CMD_LVR_SET_LIST[4]:
-	    case CMD_LVR_SET_LIST[5]:
-	    case CMD_LVR_SET_LIST[6]:
-	    case CMD_LVR_SET_LIST[7]:
+
+	    case CMD_LVR_MOVE:	// both throttles along a segment, and CMD_POLL
 		{
-			AT_Engaged = 1;
-//			if (shouldSetLever(input, 0)) {
-//				while (!Serial.available()) {} 	// wait until a byte is ready
-//				speed_brake_level = Serial.read();
-//				int speed_brake_level_curr = analogRead(SB_POT);
-//
-//        		// map input to range of motors' steps(0~50), assume range of the potentiometers start from 512
-//        		int speed_brake_level_step = map(speed_brake_level, 0, 127, 0, 50);
-//        		int speed_brake_level_curr_step = map(speed_brake_level_curr, 512, 1023, 0, 50);
-//
-//        		int speed_brake_step_diff = PosTracking(speed_brake_level_step, speed_brake_level_curr_step);
-//        		SB_Stepper.step(speed_brake_step_diff);
-//			}
-			if (shouldSetLever(input, 1)) {
-				while (!Serial.available()) {} 	// wait until a byte is ready
-				throttle_level[0] = Serial.read() & 0x7F;
-			}
-			if (shouldSetLever(input, 2)) {
-				while (!Serial.available()) {} 	// wait until a byte is ready
-				throttle_level[1] = Serial.read() & 0x7F;
+			// from the running A/T targets; throttle_level holds the measured levers if A/T is off
+			move_start[0] = throttle_level[0];
+			move_start[1] = throttle_level[1];
+			move_end[0] = getLever(data);
+			move_end[1] = getLever(data + leverSize());
+			move_duration_ms = data[2 * leverSize()] | (data[2 * leverSize() + 1] << 8);
+			move_start_ms = millis();
+			move_active = takeLevers();
+
+			unsigned char report[7];
+			unsigned char size = leverReport(report);
+			writeFrame(seq, ASDF_POLL_OK, report, size);
+			if (override_levers != 0)
+				sendPilotOverride();
+			break;
+		}
+
+	    case CMD_MODE:
+		{
+			if (data[0] != MODE_7BIT && data[0] != MODE_12BIT) {
+				writeFrame(seq, ASDF_ERROR, NULL, 0);
+				break;
 			}
+			lever_mode = data[0];		// responses after the ACK are in the new format
+			writeFrame(seq, ASDF_ACK, NULL, 0);
+			break;
+		}
 
-			Serial.write(ASDF_ACK);
+	    case CMD_STREAM:
+		{
+			stream_period_ms = data[0] & 0x7F;
+			stream_deadband = data[1] & 0x7F;
+			writeFrame(seq, ASDF_ACK, NULL, 0);		// ACK precedes the first report
+
+			stream_check_ms = millis();
+			if (stream_period_ms != 0)
+				sendStreamReport();
 			break;
 		}
 
+	    case CMD_LVR_RELS:
+		{
+			AT_Engaged = 0;
+			move_active = 0;
+			override_levers = 0;	// the host knows
+			// TODO: thrust lever release function
+			writeFrame(seq, ASDF_LVR_RELS_RESP, NULL, 0); // report release done
+			break;
+		}
+	
 		case CMD_ASDF:	// debug only
 		{
-			Serial.write(ASDF_ACK);
+			writeFrame(seq, ASDF_ACK, NULL, 0);
 			break;
 		}
-		
-		default:	// TODO: unrecongized command; send ASDF_ERROR?
+
+	    default:	// CMD_LVR_SET cases; commandDataSize() let nothing else through
+		{
+			if (takeLevers()) {
+				move_active = 0;
+				// speed brake (lever 0) is not driven yet; its position is skipped
+				unsigned char n = shouldSetLever(cmd, 0) ? leverSize() : 0;
+				if (shouldSetLever(cmd, 1)) {
+					throttle_level[0] = getLever(data + n);
+					n += leverSize();
+				}
+				if (shouldSetLever(cmd, 2))
+					throttle_level[1] = getLever(data + n);
+			}
+
+			writeFrame(seq, ASDF_ACK, NULL, 0);
+			if (override_levers != 0)
+				sendPilotOverride();
 			break;
+		}
+	}
+}
+
+// # of data bytes command @cmd takes; -1 if @cmd is not a command
+int commandDataSize(unsigned char cmd) {
+	switch (cmd) {
+		case CMD_RESET:
+		case CMD_POLL:
+		case CMD_LVR_RELS:
+		case CMD_ASDF:
+			return 0;
+		case CMD_MODE:
+			return 1;
+		case CMD_STREAM:
+			return 2;
+		case CMD_POLL_SET:
+			return 2 * leverSize();
+		case CMD_LVR_MOVE:
+			return 2 * leverSize() + 2;		// end positions, duration (ms)
 	}
+
+	for (unsigned int i = 0; i < sizeof(CMD_LVR_SET_LIST) / sizeof(CMD_LVR_SET_LIST[0]); i++)
+		if (cmd == CMD_LVR_SET_LIST[i])
+			return ((shouldSetLever(cmd, 0) ? 1 : 0) + (shouldSetLever(cmd, 1) ? 1 : 0) + (shouldSetLever(cmd, 2) ? 1 : 0)) * leverSize();
+
+	return -1;
+}
+
+// CRC-8 (poly 0x07, init 0) of @size bytes at @buf
+unsigned char crc8(const unsigned char* buf, unsigned char size) {
+	unsigned char crc = 0;
+	for (unsigned char i = 0; i < size; i++) {
+		crc ^= buf[i];
+		for (unsigned char bit = 0; bit < 8; bit++)
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+	}
+	return crc;
+}
+
+// send a frame with @len data bytes
+void writeFrame(unsigned char seq, unsigned char code, const unsigned char* data, unsigned char len) {
+	unsigned char frame[FRAME_MAX_SIZE];
+	unsigned char size = 0;
+	frame[size++] = FRAME_SYNC;
+	frame[size++] = len;
+	frame[size++] = seq;
+	frame[size++] = code;
+	for (unsigned char i = 0; i < len; i++)
+		frame[size++] = data[i];
+	frame[size] = crc8(frame + 1, size - 1);
+	Serial.write(frame, size + 1);
+}
+
+// drop the first @n bytes of rx_buf, then drop up to the next sync byte
+void rxDrop(unsigned char n) {
+	while (n < rx_size && rx_buf[n] != FRAME_SYNC)
+		n++;
+	memmove(rx_buf, rx_buf + n, rx_size - n);
+	rx_size -= n;
+}
+
+// add byte @b received from the host to rx_buf
+void rxPush(unsigned char b) {
+	if (rx_size == FRAME_MAX_SIZE)
+		rxDrop(1);
+	if (rx_size == 0 && b != FRAME_SYNC)
+		return;		// not the start of a frame
+	rx_buf[rx_size++] = b;
+}
+
+// true if rx_buf starts with a valid frame. a frame failing its checks is dropped up to the
+// next sync byte inside it and the rest is checked again, so one bad byte costs one command
+bool rxFrameReady() {
+	while (rx_size >= 2) {
+		unsigned char len = rx_buf[1];
+		if (len > FRAME_MAX_DATA) {
+			rxDrop(1);
+			continue;
+		}
+		if (rx_size < len + FRAME_OVERHEAD)
+			return false;
+		if (crc8(rx_buf + 1, len + 3) != rx_buf[len + 4]) {
+			rxDrop(1);
+			continue;
+		}
+		return true;
+	}
+	return false;
+}
+
+// # of bytes a lever position takes in lever_mode
+unsigned char leverSize() {
+	return lever_mode == MODE_12BIT ? 2 : 1;
+}
+
+// lever position received in lever_mode at @data, as [0,MAX_LEVER]
+unsigned int getLever(const unsigned char* data) {
+	if (lever_mode == MODE_12BIT)
+		return min(data[0] | (data[1] << 8), MAX_LEVER);
+	return ((unsigned long)(data[0] & 0x7F) * MAX_LEVER + MAX_LEVER_7BIT / 2) / MAX_LEVER_7BIT;
+}
+
+// current button status and measured lever positions in lever_mode units
+void leverState(unsigned int* state) {
+	state[0] = button_status;
+	state[1] = speed_brake_level;
+	state[2] = throttle_measured[0];
+	state[3] = throttle_measured[1];
+	for (int i = 1; i < 4 && lever_mode == MODE_7BIT; i++)
+		state[i] = ((unsigned long)state[i] * MAX_LEVER_7BIT + MAX_LEVER / 2) / MAX_LEVER;
+}
+
+// current button status and measured lever positions, as carried by ASDF_POLL_OK and ASDF_STREAM_REPORT;
+// returns the report size
+unsigned char leverReport(unsigned char* report) {
+	unsigned int state[4];
+	leverState(state);
+
+	unsigned char size = 0;
+	report[size++] = state[0];
+	for (int i = 1; i < 4; i++) {
+		report[size++] = state[i] & 0xFF;
+		if (lever_mode == MODE_12BIT)
+			report[size++] = state[i] >> 8;
+	}
+	return size;
+}
+
+// true if a button changed or a lever moved more than stream_deadband since the last report
+bool streamChanged() {
+	unsigned int state[4];
+	leverState(state);
+
+	if (state[0] != stream_last[0])
+		return true;
+	for (int i = 1; i < 4; i++)
+		if (abs((int)state[i] - (int)stream_last[i]) > stream_deadband)
+			return true;
+	return false;
+}
+
+void sendStreamReport() {
+	unsigned char report[7];
+	writeFrame(stream_seq++, ASDF_STREAM_REPORT, report, leverReport(report));
+
+	leverState(stream_last);
+	stream_report_ms = millis();
+}
+
+// A/T drives the throttles from where they are, unless the pilot overrode it; true if it does
+bool takeLevers() {
+	if (override_levers != 0)
+		return false;
+	if (!AT_Engaged) {
+		for (int i = 0; i < 2; i++)
+			motor_step[i] = map(throttle_measured[i], 0, MAX_LEVER + 1, 0, 50);
+		asdf_override_reset(pilot);
+	}
+	AT_Engaged = 1;
+	return true;
+}
+
+// compare each driven throttle with where its motor has stepped it; let go once one trips
+void detectOverride() {
+	unsigned long now = millis();
+	for (int i = 0; i < 2; i++)
+		asdf_override_update(pilot, i + 1, map(motor_step[i], 0, 50, 0, MAX_LEVER + 1), throttle_measured[i], now);
+
+	override_levers = asdf_override_tripped(pilot);
+	if (override_levers == 0)
+		return;
+
+	AT_Engaged = 0;
+	move_active = 0;
+	releaseMotor();
+	sendPilotOverride();
+}
+
+// tell the host the pilot overrode the motors; see ASDF_LVR_RELS_PILOT
+void sendPilotOverride() {
+	writeFrame(last_seq, ASDF_LVR_RELS_PILOT, &override_levers, 1);
 }
 
 int PosTracking( int pos_dest, int pos_curr){